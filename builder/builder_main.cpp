@@ -2,6 +2,7 @@
 #include <putki/builder/builder.h>
 #include <putki/liveupdate/liveupdate.h>
 #include <putki/builder/log.h>
+#include <putki/builder/profiler.h>
 #include <putki/runtime.h>
 #include <putki/sys/socket.h>
 
@@ -18,8 +19,14 @@ int run_putki_builder(int argc, char **argv)
 	const char *build_config = "Default";
 	bool incremental = false;
 	bool patch = false;
+	bool compact = false;
+	bool json_cache = false;
+	bool string_pool = false;
+	bool slot_aliases = false;
+	const char *access_profile = 0;
 	int threads = 0;
 	bool liveupdate = false;
+	const char *profile_output = 0;
 
 	std::string runtime_name;
 
@@ -66,6 +73,27 @@ int run_putki_builder(int argc, char **argv)
 		{
 			patch = true;
 		}
+		else if (!strcmp(argv[i], "--compact"))
+		{
+			compact = true;
+		}
+		else if (!strcmp(argv[i], "--json-cache"))
+		{
+			json_cache = true;
+		}
+		else if (!strcmp(argv[i], "--string-pool"))
+		{
+			string_pool = true;
+		}
+		else if (!strcmp(argv[i], "--slot-aliases"))
+		{
+			slot_aliases = true;
+		}
+		else if (!strcmp(argv[i], "--access-profile"))
+		{
+			if (i+1 < argc)
+				access_profile = argv[++i];
+		}
 		else if (!strcmp(argv[i], "--incremental"))
 		{
 			incremental = true;
@@ -79,6 +107,13 @@ int run_putki_builder(int argc, char **argv)
 		{
 			liveupdate = true;
 		}
+		else if (!strcmp(argv[i], "--profile"))
+		{
+			// output file is optional
+			if (i+1 < argc && argv[i+1][0] != '-')
+				profile_output = argv[++i];
+			putki::profiler::enable(true);
+		}
 		else if (!strcmp(argv[i], "--no-color"))
 		{
 			putki::set_use_ansi_color(false);
@@ -137,10 +172,28 @@ int run_putki_builder(int argc, char **argv)
 		}
 	}
 
+	if (string_pool && rt->platform == putki::runtime::PLATFORM_CSHARP)
+	{
+		std::cerr << "--string-pool is not supported by the C# runtime" << std::endl;
+		return -1;
+	}
+
+	if (slot_aliases && liveupdate)
+	{
+		std::cerr << "--slot-aliases can not be used with --liveupdate, aliased objects share one path" << std::endl;
+		return -1;
+	}
 
+	putki::log_async_start();
 
 	// reload build database if incremental build
 	putki::builder::data *builder = putki::builder::create(rt, ".", !incremental, build_config, threads);
+	if (json_cache)
+		putki::builder::enable_json_cache(builder);
+	if (string_pool)
+		putki::builder::enable_string_pool(builder);
+	if (slot_aliases)
+		putki::builder::enable_slot_aliases(builder);
 
 	if (single_asset)
 	{
@@ -149,11 +202,18 @@ int run_putki_builder(int argc, char **argv)
 	}
 	else
 	{
-		putki::build::full_build(builder, patch);
+		putki::build::full_build(builder, patch, compact, access_profile);
 		putki::builder::write_build_db(builder);
 	}
 
+	if (putki::profiler::enabled())
+	{
+		putki::profiler::print_summary();
+		putki::profiler::write_trace(profile_output ? profile_output : "build-profile.json");
+	}
+
 	putki::builder::free(builder);
+	putki::log_async_stop();
 
 	if (liveupdate)
 	{
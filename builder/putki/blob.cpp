@@ -5,9 +5,78 @@
 #include <memory>
 #include <cstring>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#if defined(_MSC_VER)
+	#define BLOB_TLS __declspec(thread)
+#else
+	#define BLOB_TLS __thread
+#endif
 
 namespace putki
 {
+	struct string_pool
+	{
+		std::vector<char> bytes;
+		std::unordered_map<std::string, unsigned int> offsets;
+		unsigned int refs;
+	};
+
+	namespace
+	{
+		BLOB_TLS string_pool *s_bound_pool = 0;
+
+		void pack_size_field(int size_size, char *where, unsigned int value)
+		{
+			if (size_size == 8)
+				pack_int64_field(where, value);
+			else if (size_size == 4)
+				pack_int32_field(where, value);
+			else if (size_size == 2)
+				pack_int16_field(where, value);
+			else if (size_size == 1)
+				*where = value;
+			else
+				APP_ERROR("Invalid size_size=" << size_size);
+		}
+	}
+
+	string_pool *string_pool_create()
+	{
+		string_pool *pool = new string_pool();
+		pool->refs = 0;
+		return pool;
+	}
+
+	void string_pool_free(string_pool *pool)
+	{
+		if (s_bound_pool == pool)
+			s_bound_pool = 0;
+		delete pool;
+	}
+
+	void string_pool_bind(string_pool *pool)
+	{
+		s_bound_pool = pool;
+	}
+
+	const char *string_pool_data(string_pool *pool)
+	{
+		return pool->bytes.empty() ? "" : &pool->bytes[0];
+	}
+
+	unsigned int string_pool_size(string_pool *pool)
+	{
+		return (unsigned int) pool->bytes.size();
+	}
+
+	unsigned int string_pool_refs(string_pool *pool)
+	{
+		return pool->refs;
+	}
+
 	char *pack_string_field(int size_size, char *where, const char *src, char *aux_beg, char *aux_end)
 	{
 		if (!aux_beg) {
@@ -16,18 +85,22 @@ namespace putki
 
 		unsigned int len = strlen(src);
 
+		// references need the top bit, which does not fit in narrower size fields.
+		string_pool *pool = s_bound_pool;
+		if (pool && size_size >= 4)
+		{
+			std::pair<std::unordered_map<std::string, unsigned int>::iterator, bool> ins =
+				pool->offsets.insert(std::make_pair(std::string(src, len), (unsigned int) pool->bytes.size()));
+			if (ins.second)
+				pool->bytes.insert(pool->bytes.end(), src, src + len + 1);
+
+			pack_size_field(size_size, where, STRING_POOL_REF | ins.first->second);
+			pool->refs++;
+			return aux_beg;
+		}
+
 		// write the length into the pointer slot.
-		if (size_size == 8)
-			pack_int64_field(where, len+1);
-		else if (size_size == 4)
-			pack_int32_field(where, len+1);
-		else if (size_size == 2)
-			pack_int16_field(where, len+1);
-		else if (size_size == 1)
-			*where = len + 1;
-		else
-			APP_ERROR("Invalid size_size=" << size_size);
-		
+		pack_size_field(size_size, where, len+1);
 
 		if ((unsigned int)(aux_end - aux_beg) < (len+1)) {
 			return 0;
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstring>
+#include <cstddef>
+
 namespace putki
 {
 	inline char *pack_int16_field(char *where, short val)
@@ -31,5 +34,62 @@ namespace putki
 		return where + 8;
 	}
 
+	inline bool host_is_little_endian()
+	{
+		const int one = 1;
+		return *(const char *)&one == 1;
+	}
+
+	// Packs count elements of elem_size (1, 2, 4 or 8) bytes each as little endian, which is what
+	// the pack_intXX_field functions produce one at a time. Returns 0 if it does not fit.
+	inline char *pack_pod_array(char *where, char *end, const void *src, size_t count, size_t elem_size)
+	{
+		const size_t bytes = count * elem_size;
+		if (!where || (size_t)(end - where) < bytes)
+			return 0;
+
+		if (elem_size == 1 || host_is_little_endian())
+		{
+			memcpy(where, src, bytes);
+		}
+		else
+		{
+			const char *s = (const char *) src;
+			for (size_t i=0;i!=count;i++)
+			{
+				for (size_t b=0;b!=elem_size;b++)
+					where[i * elem_size + b] = s[i * elem_size + elem_size - 1 - b];
+			}
+		}
+		return where + bytes;
+	}
+
+	// Packs the bytes as they are in memory, which is how float fields have always been written.
+	// Returns 0 if it does not fit.
+	inline char *pack_pod_array_host_order(char *where, char *end, const void *src, size_t count, size_t elem_size)
+	{
+		const size_t bytes = count * elem_size;
+		if (!where || (size_t)(end - where) < bytes)
+			return 0;
+
+		memcpy(where, src, bytes);
+		return where + bytes;
+	}
+
 	char *pack_string_field(int size_size, char *where, const char *src, char *aux_beg, char *aux_end);
+
+	// Package wide string table. While a pool is bound to the calling thread, pack_string_field
+	// stores STRING_POOL_REF | offset in the pointer slot instead of copying the string after the struct.
+	struct string_pool;
+
+	const unsigned int STRING_POOL_REF = 0x80000000;
+
+	string_pool *string_pool_create();
+	void string_pool_free(string_pool *pool);
+	void string_pool_bind(string_pool *pool);
+
+	const char *string_pool_data(string_pool *pool);
+	unsigned int string_pool_size(string_pool *pool);
+	// number of string fields written as references so far.
+	unsigned int string_pool_refs(string_pool *pool);
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <putki/sys/sstream.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+namespace putki
+{
+	// little endian encoding used by the generated write_binary/read_binary for the built
+	// object cache. strings are a length, the bytes and a terminator so paths can be used
+	// straight out of the buffer.
+	namespace binary
+	{
+		struct reader
+		{
+			const char *cur, *end;
+			// set on reading past the end, reads then return zeroes.
+			bool error;
+		};
+
+		inline void init(reader *r, const char *beg, const char *end)
+		{
+			r->cur = beg;
+			r->end = end;
+			r->error = false;
+		}
+
+		inline void write_u32(putki::sstream & out, uint32_t v)
+		{
+			const char b[4] = { (char)(v & 0xff), (char)((v >> 8) & 0xff), (char)((v >> 16) & 0xff), (char)(v >> 24) };
+			out.write(b, 4);
+		}
+
+		inline void write_byte(putki::sstream & out, unsigned char v)
+		{
+			out << (char) v;
+		}
+
+		inline void write_float(putki::sstream & out, float v)
+		{
+			uint32_t u;
+			memcpy(&u, &v, 4);
+			write_u32(out, u);
+		}
+
+		inline void write_str(putki::sstream & out, const char *str, size_t len)
+		{
+			write_u32(out, (uint32_t) len);
+			out.write(str, len);
+			out << (char) 0;
+		}
+
+		inline void write_str(putki::sstream & out, const char *str)
+		{
+			if (!str)
+				str = "";
+			write_str(out, str, strlen(str));
+		}
+
+		inline void write_str(putki::sstream & out, std::string const & str)
+		{
+			write_str(out, str.c_str(), str.size());
+		}
+
+		inline void write_bytes(putki::sstream & out, std::vector<unsigned char> const & bytes)
+		{
+			write_u32(out, (uint32_t) bytes.size());
+			if (!bytes.empty())
+				out.write(&bytes[0], bytes.size());
+		}
+
+		inline bool need(reader *r, size_t bytes)
+		{
+			if (r->error || (size_t)(r->end - r->cur) < bytes)
+			{
+				r->error = true;
+				return false;
+			}
+			return true;
+		}
+
+		inline uint32_t read_u32(reader *r)
+		{
+			if (!need(r, 4))
+				return 0;
+			const unsigned char *b = (const unsigned char *) r->cur;
+			r->cur += 4;
+			return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+		}
+
+		inline unsigned char read_byte(reader *r)
+		{
+			if (!need(r, 1))
+				return 0;
+			return (unsigned char) *r->cur++;
+		}
+
+		inline float read_float(reader *r)
+		{
+			uint32_t u = read_u32(r);
+			float v;
+			memcpy(&v, &u, 4);
+			return v;
+		}
+
+		// element count of an array, every element takes at least one byte so larger
+		// counts than what is left mean the data is broken.
+		inline uint32_t read_count(reader *r)
+		{
+			uint32_t n = read_u32(r);
+			if (!need(r, n))
+				return 0;
+			return n;
+		}
+
+		// points into the buffer, never 0.
+		inline const char *read_cstr(reader *r, size_t *len = 0)
+		{
+			uint32_t n = read_u32(r);
+			if (n == 0xffffffff || !need(r, n + 1) || r->cur[n])
+			{
+				r->error = true;
+				if (len)
+					*len = 0;
+				return "";
+			}
+			const char *str = r->cur;
+			r->cur += n + 1;
+			if (len)
+				*len = n;
+			return str;
+		}
+
+		inline void read_str(reader *r, std::string & out)
+		{
+			size_t len;
+			const char *str = read_cstr(r, &len);
+			out.assign(str, len);
+		}
+
+		inline void read_bytes(reader *r, std::vector<unsigned char> & out)
+		{
+			uint32_t n = read_count(r);
+			out.assign((const unsigned char *) r->cur, (const unsigned char *) r->cur + n);
+			r->cur += n;
+		}
+	}
+}
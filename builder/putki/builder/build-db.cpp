@@ -7,11 +7,18 @@
 #include <set>
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 #include <putki/builder/db.h>
 #include <putki/builder/log.h>
+#include <putki/builder/inputset.h>
 #include <putki/sys/thread.h>
 
+extern "C" {
+	#include <md5/md5.h>
+}
+
 namespace putki
 {
 	namespace build_db
@@ -45,6 +52,17 @@ namespace putki
 			
 			std::vector<logentry_t> logs;
 			metadata md;
+
+			// how long the last real build took, cache reads leave it alone.
+			long long build_time_us;
+
+			// md5 over the dependencies and their signatures, see update_input_signature.
+			std::string input_sig;
+			// set when something the record depends on may have changed since it was last built
+			// or taken from the cache, kept until the record is replaced.
+			bool dirty;
+			// committed after the build db was loaded.
+			bool fresh;
 		};
 
 		typedef std::map<std::string, record*> RM;
@@ -56,12 +74,42 @@ namespace putki
 			RM records;
 			RevDepMap depends;
 			sys::mutex mtx;
+
+			// from estimate_critical_paths
+			std::map<std::string, long long> critical_paths;
+			long long mean_build_time_us;
+
+			// of the input sets when stored
+			std::string inputs_sig;
+
+			// what the last full build packaged
+			std::string packaging_sig;
+			std::map<std::string, std::string> package_files;
+			std::map<std::string, std::string> package_contents;
 		};
 
+		namespace
+		{
+			void update_input_signature(record *r)
+			{
+				std::string deps;
+				for (unsigned int i=0; i!=r->input_dependencies.size(); i++)
+					deps.append("i:").append(r->input_dependencies[i].path).append("@").append(r->input_dependencies[i].signature).append("\n");
+				for (unsigned int i=0; i!=r->dependencies.size(); i++)
+					deps.append("f:").append(r->dependencies[i].path).append("@").append(r->dependencies[i].signature).append("\n");
+
+				char signature[16], signature_string[64];
+				md5_buffer(deps.c_str(), (unsigned int)deps.size(), signature);
+				md5_sig_to_string(signature, signature_string, 64);
+				r->input_sig = signature_string;
+			}
+		}
+
 		data* create(const char *path, bool load)
 		{
 			data *d = new data();
 			d->path = path;
+			d->mean_build_time_us = 0;
 
 			if (load)
 			{
@@ -97,7 +145,23 @@ namespace putki
 
 						const char *path = &line[2];
 
-						if (line[0] == '#')
+						if (line[0] == 'g' && !cur)
+						{
+							d->inputs_sig = path;
+						}
+						else if (line[0] == 'n' && !cur)
+						{
+							d->packaging_sig = path;
+						}
+						else if (line[0] == 'k' && !cur)
+						{
+							d->package_files[path] = extra;
+						}
+						else if (line[0] == 'l' && !cur)
+						{
+							d->package_contents[path] = extra;
+						}
+						else if (line[0] == '#')
 						{
 							if (cur) {
 								commit_record(d, cur);
@@ -132,6 +196,18 @@ namespace putki
 						{
 							cur->parent_object = path;
 						}
+						else if (line[0] == 'd')
+						{
+							cur->build_time_us = atoll(path);
+						}
+						else if (line[0] == 'm')
+						{
+							cur->input_sig = path;
+						}
+						else if (line[0] == 'x')
+						{
+							cur->dirty = true;
+						}
 						else
 						{
 							APP_WARNING("UNPARSED " << line)
@@ -144,6 +220,9 @@ namespace putki
 				}
 			}
 
+			for (RM::iterator i=d->records.begin(); i!=d->records.end(); i++)
+				i->second->fresh = false;
+
 			return d;
 		}
 
@@ -152,6 +231,15 @@ namespace putki
 			std::ofstream dbtxt(d->path.c_str());
 			APP_DEBUG("Writing build-db to [" << d->path << "]")
 
+			if (!d->inputs_sig.empty())
+				dbtxt << "g:" << d->inputs_sig << "\n";
+			if (!d->packaging_sig.empty())
+				dbtxt << "n:" << d->packaging_sig << "\n";
+			for (std::map<std::string, std::string>::iterator i=d->package_files.begin(); i!=d->package_files.end(); i++)
+				dbtxt << "k:" << i->first << "@" << i->second << "\n";
+			for (std::map<std::string, std::string>::iterator i=d->package_contents.begin(); i!=d->package_contents.end(); i++)
+				dbtxt << "l:" << i->first << "@" << i->second << "\n";
+
 			for (RM::iterator i=d->records.begin(); i!=d->records.end(); i++)
 			{
 				record &r = *(i->second);
@@ -161,6 +249,8 @@ namespace putki
 
 				if (!r.parent_object.empty())
 					dbtxt << "c:" << r.parent_object << "\n";
+				if (r.build_time_us > 0)
+					dbtxt << "d:" << r.build_time_us << "\n";
 
 				for (unsigned int j=0; j!=r.input_dependencies.size(); j++)
 				{
@@ -174,6 +264,12 @@ namespace putki
 					dbtxt << "i:" << r.input_dependencies[j].path << "@" << r.input_dependencies[j].signature;
 					dbtxt << "\n";
 				}
+
+				update_input_signature(&r);
+				dbtxt << "m:" << r.input_sig << "\n";
+				if (r.dirty)
+					dbtxt << "x:\n";
+
 				for (unsigned int k=0; k!=r.dependencies.size(); k++)
 					dbtxt << "f:" << r.dependencies[k].path << "@" << r.dependencies[k].signature << std::endl;
 				for (unsigned int j=0; j!=r.outputs.size(); j++)
@@ -232,6 +328,9 @@ namespace putki
 			record *r = new record();
 			r->source_path = input_path;
 			r->source_sig = input_signature;
+			r->build_time_us = 0;
+			r->dirty = false;
+			r->fresh = true;
 
 			if (builder) {
 				r->builder = builder;
@@ -282,6 +381,8 @@ namespace putki
 				std::vector<logentry_t> logs = target->logs;
 				*target = *(q->second);
 				target->logs.insert(target->logs.begin(), logs.begin(), logs.end());
+				// only copied after the dependencies checked out.
+				target->dirty = false;
 				return true;
 			}
 			return false;
@@ -297,6 +398,16 @@ namespace putki
 			r->builder = builder;
 		}
 
+		void set_build_time(record *r, long long us)
+		{
+			r->build_time_us = us;
+		}
+
+		long long get_build_time(record *r)
+		{
+			return r->build_time_us;
+		}
+
 		void add_output(record *r, const char *output_path, const char *builder)
 		{
 			// std::cout << "Adding output [" << output_path << "] [" << builder << "]" << std::endl;
@@ -421,6 +532,9 @@ namespace putki
 				// std::cout << "Inserting extra record on " << r->input_dependencies[i] << " i am " << d << std::endl;
 			}
 
+			if (r->input_sig.empty())
+				update_input_signature(r);
+
 			flush_log(r);
 
 			d->records.insert(std::make_pair(r->source_path, r));
@@ -490,7 +604,7 @@ namespace putki
 				depwalker dw;
 				dw.db = db;
 				dw.out = &rec->second->md;
-				th->walk_dependencies(obj, &dw, true);
+				putki::walk_dependencies(th, obj, &dw, true);
 			}
 			else
 			{
@@ -499,6 +613,190 @@ namespace putki
 
 		}
 
+		const char *get_input_signature(record *r)
+		{
+			return r->input_sig.c_str();
+		}
+
+		int current_input_signature(record *r, dep_sig_fn fn, void *userptr, char *out, const char **changed)
+		{
+			record cur;
+			cur.input_dependencies = r->input_dependencies;
+			cur.dependencies = r->dependencies;
+			if (changed)
+				*changed = 0;
+
+			for (unsigned int i=0; i!=cur.input_dependencies.size(); i++)
+			{
+				char sig[SIG_BUF_SIZE];
+				if (!fn(userptr, cur.input_dependencies[i].path.c_str(), false, sig))
+					return -1;
+				if (changed && !*changed && cur.input_dependencies[i].signature != sig)
+					*changed = r->input_dependencies[i].path.c_str();
+				cur.input_dependencies[i].signature = sig;
+			}
+			for (unsigned int i=0; i!=cur.dependencies.size(); i++)
+			{
+				char sig[SIG_BUF_SIZE];
+				if (!fn(userptr, cur.dependencies[i].path.c_str(), true, sig))
+					return -1;
+				if (changed && !*changed && cur.dependencies[i].signature != sig)
+					*changed = r->dependencies[i].path.c_str();
+				cur.dependencies[i].signature = sig;
+			}
+
+			update_input_signature(&cur);
+			strcpy(out, cur.input_sig.c_str());
+			return (int)(cur.input_dependencies.size() + cur.dependencies.size());
+		}
+
+		void mark_dirty_records(data *d, dep_changed_fn fn, void *userptr)
+		{
+			sys::scoped_maybe_lock _lk(&d->mtx);
+			for (RM::iterator i=d->records.begin(); i!=d->records.end(); i++)
+			{
+				record *r = i->second;
+				if (r->dirty || r->fresh)
+					continue;
+
+				r->dirty = !fn || (r->input_dependencies.empty() && r->dependencies.empty());
+				for (unsigned int j=0; !r->dirty && j!=r->input_dependencies.size(); j++)
+					r->dirty = fn(userptr, r->input_dependencies[j].path.c_str(), false);
+				for (unsigned int j=0; !r->dirty && j!=r->dependencies.size(); j++)
+					r->dirty = fn(userptr, r->dependencies[j].path.c_str(), true);
+			}
+		}
+
+		bool is_dirty(record *r)
+		{
+			return r->dirty;
+		}
+
+		void set_inputs_signature(data *d, const char *signature)
+		{
+			d->inputs_sig = signature;
+		}
+
+		const char *get_inputs_signature(data *d)
+		{
+			return d->inputs_sig.c_str();
+		}
+
+		void set_packaging_signature(data *d, const char *signature)
+		{
+			d->packaging_sig = signature;
+		}
+
+		const char *get_packaging_signature(data *d)
+		{
+			return d->packaging_sig.c_str();
+		}
+
+		void clear_packages(data *d)
+		{
+			d->package_files.clear();
+			d->package_contents.clear();
+		}
+
+		void set_package_file(data *d, const char *path, const char *stamp)
+		{
+			d->package_files[path] = stamp;
+		}
+
+		const char *get_package_file(data *d, const char *path)
+		{
+			std::map<std::string, std::string>::iterator i = d->package_files.find(path);
+			return i != d->package_files.end() ? i->second.c_str() : 0;
+		}
+
+		const char *enum_package_files(data *d, unsigned int index, const char **stamp)
+		{
+			std::map<std::string, std::string>::iterator i = d->package_files.begin();
+			for (unsigned int j=0; j<index && i!=d->package_files.end(); j++)
+				++i;
+			if (i == d->package_files.end())
+				return 0;
+			*stamp = i->second.c_str();
+			return i->first.c_str();
+		}
+
+		void set_package_contents(data *d, const char *package, const char *signature)
+		{
+			d->package_contents[package] = signature;
+		}
+
+		const char *get_package_contents(data *d, const char *package)
+		{
+			std::map<std::string, std::string>::iterator i = d->package_contents.find(package);
+			return i != d->package_contents.end() ? i->second.c_str() : 0;
+		}
+
+		namespace
+		{
+			// what has to be built after a record: its outputs get their own records and the
+			// objects it points to are added once it is done.
+			long long critical_path(data *d, const std::string & path, std::set<std::string> & visiting)
+			{
+				std::map<std::string, long long>::iterator c = d->critical_paths.find(path);
+				if (c != d->critical_paths.end())
+					return c->second;
+
+				RM::iterator q = d->records.find(path);
+				if (q == d->records.end() || !visiting.insert(path).second)
+					return 0;
+
+				record *r = q->second;
+				long long after = 0;
+				for (unsigned int i=0;i!=r->outputs.size();i++)
+				{
+					if (r->outputs[i] != path && !db::is_aux_path(r->outputs[i].c_str()))
+						after = std::max(after, critical_path(d, r->outputs[i], visiting));
+				}
+				std::set<std::string>::iterator pi = r->md.pointers.begin();
+				while (pi != r->md.pointers.end())
+				{
+					if (!db::is_aux_path(pi->c_str()))
+						after = std::max(after, critical_path(d, *pi, visiting));
+					++pi;
+				}
+
+				visiting.erase(path);
+				long long own = r->build_time_us > 0 ? r->build_time_us : d->mean_build_time_us;
+				d->critical_paths[path] = own + after;
+				return own + after;
+			}
+		}
+
+		void estimate_critical_paths(data *d)
+		{
+			sys::scoped_maybe_lock _lk(&d->mtx);
+			d->critical_paths.clear();
+
+			long long total = 0, count = 0;
+			for (RM::iterator i=d->records.begin(); i!=d->records.end(); i++)
+			{
+				if (i->second->build_time_us > 0)
+				{
+					total += i->second->build_time_us;
+					count++;
+				}
+			}
+			d->mean_build_time_us = count ? total / count : 0;
+
+			std::set<std::string> visiting;
+			for (RM::iterator i=d->records.begin(); i!=d->records.end(); i++)
+				critical_path(d, i->first, visiting);
+		}
+
+		long long estimated_critical_path(data *d, const char *path)
+		{
+			sys::scoped_maybe_lock _lk(&d->mtx);
+			std::map<std::string, long long>::iterator c = d->critical_paths.find(path);
+			if (c != d->critical_paths.end())
+				return c->second;
+			return d->mean_build_time_us;
+		}
+
 		struct deplist
 		{
 			struct entry
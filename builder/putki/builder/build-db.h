@@ -34,6 +34,49 @@ namespace putki
 		void set_builder(record *r, const char *builder);
 		void set_parent(record *r, const char *parent);
 
+		// microseconds the record took to build, persisted for scheduling the next build.
+		void set_build_time(record *r, long long us);
+		long long get_build_time(record *r);
+
+		// longest chain of build times hanging off each record in the loaded build db, used to
+		// start the work that holds up the end of the build first. records without a build time
+		// count as the mean of the others, and unknown paths get the mean.
+		void estimate_critical_paths(data *d);
+		long long estimated_critical_path(data *d, const char *path);
+
+		// md5 over the record's dependencies with the signatures they had when it was built, so
+		// checking them all against what they are now is one comparison. fn gives the current
+		// signature of a dependency (SIG_BUF_SIZE), returning false fails the whole thing with -1.
+		// otherwise returns how many dependencies went into it and changed points at the first one
+		// with a different signature, if any.
+		typedef bool (*dep_sig_fn)(void *userptr, const char *path, bool external_resource, char *sig_out);
+		const char *get_input_signature(record *r);
+		int current_input_signature(record *r, dep_sig_fn fn, void *userptr, char *out, const char **changed = 0);
+
+		// flags records loaded from disk with a dependency fn says has changed, or all of them
+		// without fn. the flag is stored and stays until the record is rebuilt or taken from the
+		// cache, so records that are clean can skip looking at their dependencies at all.
+		typedef bool (*dep_changed_fn)(void *userptr, const char *path, bool external_resource);
+		void mark_dirty_records(data *d, dep_changed_fn fn, void *userptr);
+		bool is_dirty(record *r);
+
+		// of the input sets the records were last checked against, to tell whether their
+		// differences since then are known.
+		void set_inputs_signature(data *d, const char *signature);
+		const char *get_inputs_signature(data *d);
+
+		// what the last full build packaged, to skip packaging what has not changed: a signature
+		// over what decides the packages besides the objects in them, the files written with a
+		// stamp of their size and time, and per package a signature over what was added to it.
+		void set_packaging_signature(data *d, const char *signature);
+		const char *get_packaging_signature(data *d);
+		void clear_packages(data *d);
+		void set_package_file(data *d, const char *path, const char *stamp);
+		const char *get_package_file(data *d, const char *path);
+		const char *enum_package_files(data *d, unsigned int index, const char **stamp);
+		void set_package_contents(data *d, const char *package, const char *signature);
+		const char *get_package_contents(data *d, const char *package);
+
 		void add_output(record *r, const char *output_path, const char *builder);
 		void add_input_dependency(record *r, const char *dependency, const char *signature=0);
 		void add_external_resource_dependency(record *r, const char *filepath, const char *signature);
@@ -17,6 +17,8 @@
 #include <putki/builder/write.h>
 #include <putki/builder/build-db.h>
 #include <putki/builder/log.h>
+#include <putki/builder/profiler.h>
+#include <putki/builder/tok.h>
 
 #include <putki/sys/files.h>
 #include <putki/sys/thread.h>
@@ -28,6 +30,12 @@
 #include <sstream>
 #include <vector>
 #include <set>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+	#include <md5/md5.h>
+}
 
 namespace
 {
@@ -38,15 +46,23 @@ namespace
 	struct domain_switch : public putki::db::enum_i
 	{
 		putki::db::data *input, *output;
+		// when set, lookups go through these instead and record can run on many threads.
+		putki::db::snapshot *input_snapshot, *output_snapshot;
 		bool create_unresolved;
 		bool traverse_children;
 	
 		domain_switch()
 		{
+			input_snapshot = output_snapshot = 0;
 			create_unresolved = true;
 			traverse_children = false;
 		}
 
+		const char *pathof(putki::db::data *d, putki::db::snapshot *s, putki::instance_t obj)
+		{
+			return s ? putki::db::pathof_including_unresolved(s, obj) : putki::db::pathof_including_unresolved(d, obj);
+		}
+
 		struct depwalker : public putki::depwalker_i
 		{
 			domain_switch *parent;
@@ -62,19 +78,20 @@ namespace
 				putki::type_handler_i *th;
 				putki::instance_t obj = 0;
 
-				const char *path = putki::db::pathof_including_unresolved(parent->input, *on);
+				const char *path = parent->pathof(parent->input, parent->input_snapshot, *on);
 				if (!path)
 				{
 					// this would mean the object exists neither in the input nor output domain.
-					if (!putki::db::pathof_including_unresolved(parent->output, *on)) 
+					if (!parent->pathof(parent->output, parent->output_snapshot, *on))
 					{
 						APP_ERROR("!!! A wild object appears! [" << *on << "]. Might be a [" << ptr_type << "]");
-						putki::db::pathof_including_unresolved(parent->output, *on);
 					}
 					return false;
 				}
 
-				if (!putki::db::fetch(parent->output, path, &th, &obj))
+				// the snapshot only has loaded objects, deferred ones go through the db.
+				if (!(parent->output_snapshot && putki::db::fetch(parent->output_snapshot, path, &th, &obj)) &&
+				    !putki::db::fetch(parent->output, path, &th, &obj))
 				{
 					if (parent->create_unresolved)
 					{
@@ -109,7 +126,7 @@ namespace
 				depwalker dp;
 				dp.parent = this;
 				dp.source = obj;
-				th->walk_dependencies(obj, &dp, traverse_children);
+				putki::walk_dependencies(th, obj, &dp, traverse_children);
 			}
 		}
 	};
@@ -137,37 +154,65 @@ namespace
 		}
 	};
 
-	struct write_cache_json : public putki::db::enum_i
+	std::string md5_string(putki::sstream & ss)
+	{
+		char signature[16], signature_string[64];
+		md5_buffer(ss.c_str(), (unsigned int)ss.size(), signature);
+		md5_sig_to_string(signature, signature_string, 64);
+		return signature_string;
+	}
+
+	// size, modification time and inode, empty if there is no such file. only a stat, so checking
+	// every package file stays cheap. sub-second mtime and the inode tell apart a file rewritten
+	// within the same second at the same size, where the file system keeps them.
+	std::string file_stamp(const std::string & path)
+	{
+		putki::sys::file_info info;
+		if (!putki::sys::stat(path.c_str(), &info))
+			return "";
+		putki::sstream ss;
+		ss << info.size << "." << info.mtime << "." << info.mtime_ns << "." << info.ino;
+		return ss.c_str();
+	}
+
+	// writes built objects into the cache directory, from any number of threads. the binary form
+	// is written unless json is asked for, which also removes the binary file that would win over it.
+	struct write_cache : public putki::db::enum_i
 	{
-		putki::builder::data *builder;
 		putki::db::data *db;
+		putki::db::snapshot *snapshot;
 		std::string path_base;
-		int written;
+		bool json;
+		volatile int written;
 
-		write_cache_json() 
+		write_cache()
 		{
 			written = 0;
 		}
 
 		void record(const char *path, putki::type_handler_i* th, putki::instance_t obj)
 		{
-			if (putki::db::is_aux_path(path)) {
-				return;
-			}
-
-			// forward all objects directly to the output db. we can't clone them here or all
-			// pointers to them will become wild.
 			std::string out_path = path_base;
 			out_path.append("/");
 			out_path.append(path);
-			out_path.append(".json");
 
-			putki::sstream tmp;
-			putki::write::write_object_into_stream(tmp, db, th, obj);
+			putki::write::scoped_stream buf;
+			putki::sstream & tmp = *buf.stream;
+			if (json)
+			{
+				putki::write::write_object_into_stream(tmp, db, th, obj);
+				putki::sys::remove_file((out_path + ".bin").c_str());
+				out_path.append(".json");
+			}
+			else
+			{
+				putki::write::write_object_binary(tmp, snapshot, path, th, obj);
+				out_path.append(".bin");
+			}
 
 			putki::sys::mk_dir_for_path(out_path.c_str());
-			putki::sys::write_file(out_path.c_str(), tmp.str().c_str(), tmp.str().size());
-			written++;
+			if (putki::sys::write_file(out_path.c_str(), tmp.c_str(), tmp.size()))
+				putki::sys::atomic_inc(&written);
 		}
 	};
 
@@ -195,15 +240,156 @@ namespace putki
 			builder::build_context *context;
 			std::vector<pkg_conf> packages;
 			bool make_patch;
+			bool compact;
+			bool string_pool;
+			bool slot_aliases;
+			package::access_profile *access_profile;
+			// the last build packaged with the same signature, see package_unchanged.
+			bool same_packaging;
 		};
 
-		void post_build_ptr_update(db::data *input, db::data *output)
+		// md5 over what decides the packages besides the objects going into them.
+		std::string packaging_signature(builder::data *builder, bool compact, const char *access_profile)
+		{
+			char build_sig[64];
+			builder::build_signature(builder, build_sig);
+
+			sstream ss;
+			ss << build_sig << ":" << (compact ? "compact" : "-") << ":" << (builder::json_cache(builder) ? "json" : "-");
+			ss << ":" << (builder::string_pool(builder) ? "pool" : "-") << ":" << (builder::slot_aliases(builder) ? "alias" : "-");
+			if (access_profile)
+				ss << ":" << access_profile << ":" << file_stamp(access_profile).c_str();
+			return md5_string(ss);
+		}
+
+		// whether the files the last build packaged into are all still there as it left them.
+		bool packages_up_to_date(build_db::data *bdb, const std::string & signature)
+		{
+			if (signature != build_db::get_packaging_signature(bdb))
+				return false;
+
+			unsigned int i;
+			for (i=0;;i++)
+			{
+				const char *stamp;
+				const char *path = build_db::enum_package_files(bdb, i, &stamp);
+				if (!path)
+					break;
+				if (file_stamp(path) != stamp)
+				{
+					APP_DEBUG("Package file " << path << " has changed")
+					return false;
+				}
+			}
+			return i > 0;
+		}
+
+		// md5 over the assets the packager added.
+		std::string package_contents(package::data *pkg)
+		{
+			sstream ss;
+			for (unsigned int i=0;;i++)
+			{
+				const char *path = package::get_needed_asset(pkg, i);
+				if (!path)
+					break;
+				ss << path << "\n";
+			}
+			return md5_string(ss);
+		}
+
+		// a package written by the last build from the same contents needs no writing as long
+		// as its files are untouched and every object in the manifest still has the signature
+		// it was written with. patches are always written.
+		bool package_unchanged(pkg_conf *pk, packaging_config *packaging, const std::string & contents)
+		{
+			if (packaging->make_patch || !packaging->same_packaging)
+				return false;
+
+			const char *old_contents = build_db::get_package_contents(packaging->bdb, pk->path.c_str());
+			if (!old_contents || contents != old_contents)
+				return false;
+
+			const std::string *files[] = { &pk->final_path, &pk->final_manifest_path, &pk->ptr_file };
+			for (unsigned int i=0;i!=3;i++)
+			{
+				const char *stamp = build_db::get_package_file(packaging->bdb, files[i]->c_str());
+				if (!stamp || file_stamp(*files[i]) != stamp)
+					return false;
+			}
+
+			tok::data *mf = tok::load(pk->final_manifest_path.c_str());
+			if (!mf)
+				return false;
+			tok::tokenize_newlines(mf);
+
+			bool unchanged = true;
+			for (unsigned int i=0;unchanged;i++)
+			{
+				const char *ln = tok::get(mf, i);
+				if (!ln)
+					break;
+				if (ln[0] != '#')
+					continue;
+
+				// #slot:type:path:signature:...
+				std::string line(ln);
+				size_t p0 = line.find(':');
+				size_t p1 = p0 == std::string::npos ? p0 : line.find(':', p0 + 1);
+				size_t p2 = p1 == std::string::npos ? p1 : line.find(':', p1 + 1);
+				size_t p3 = p2 == std::string::npos ? p2 : line.find(':', p2 + 1);
+				if (p3 == std::string::npos)
+				{
+					unchanged = false;
+					break;
+				}
+
+				std::string path = line.substr(p1 + 1, p2 - p1 - 1);
+				std::string signature = line.substr(p2 + 1, p3 - p2 - 1);
+
+				char buf[2048];
+				build_db::record *r;
+				if (db::base_asset_path(path.c_str(), buf, sizeof(buf)))
+					r = build_db::find(packaging->bdb, buf);
+				else
+					r = build_db::find(packaging->bdb, path.c_str());
+
+				if (!r || signature != build_db::get_signature(r))
+				{
+					APP_DEBUG("Package " << pk->path << " has changed object " << path)
+					unchanged = false;
+				}
+			}
+
+			tok::free(mf);
+			return unchanged;
+		}
+
+		void record_package(pkg_conf *pk, packaging_config *packaging, const std::string & contents)
+		{
+			build_db::set_package_contents(packaging->bdb, pk->path.c_str(), contents.c_str());
+			build_db::set_package_file(packaging->bdb, pk->final_path.c_str(), file_stamp(pk->final_path).c_str());
+			build_db::set_package_file(packaging->bdb, pk->final_manifest_path.c_str(), file_stamp(pk->final_manifest_path).c_str());
+			build_db::set_package_file(packaging->bdb, pk->ptr_file.c_str(), file_stamp(pk->ptr_file).c_str());
+		}
+
+		void post_build_ptr_update(db::data *input, db::data *output, unsigned int num_threads)
 		{
-			// Move all references from objects in the output
+			// Move all references from objects in the output. the objects are walked in parallel,
+			// each by one thread that only writes its own pointer fields, and lookups go through
+			// snapshots taken up front. the output db is still inserted into: create_unresolved
+			// adds unresolved pointers and fetching a deferred object loads it. both go through
+			// the output db's own lock, db::fetch makes concurrent fetches of the same deferred
+			// object wait for one load like during the build, and the snapshots are never
+			// written. objects inserted during the walk are not walked, as with read_all_no_fetch.
 			domain_switch dsw;
 			dsw.input = input;
 			dsw.output = output;
-			db::read_all_no_fetch(output, &dsw);
+			dsw.input_snapshot = db::take_snapshot(input);
+			dsw.output_snapshot = db::take_snapshot(output);
+			db::parallel_read_all(dsw.output_snapshot, &dsw, num_threads ? num_threads : 1);
+			db::free_snapshot(dsw.output_snapshot);
+			db::free_snapshot(dsw.input_snapshot);
 		}
 
 		void resolve_object(putki::db::data *source, const char *path)
@@ -307,12 +493,22 @@ namespace putki
 			APP_DEBUG("Registered package " << out_path);
 		}
 
-		void write_package(pkg_conf *pk, packaging_config *packaging)
+		bool write_package(pkg_conf *pk, packaging_config *packaging)
 		{
 			APP_DEBUG("Saving package to [" << pk->final_path << "]...")
+			PROFILE_SCOPE("package", "write_package", pk->final_path.c_str())
 
 			sstream mf;
+			if (packaging->access_profile)
+				putki::package::set_access_profile(pk->pkg, packaging->access_profile);
+			putki::package::set_string_pool(pk->pkg, packaging->string_pool);
+			putki::package::set_slot_aliases(pk->pkg, packaging->slot_aliases);
 			long bytes_written = putki::package::write(pk->pkg, packaging->rt, xbuf, xbufSize, packaging->bdb, mf);
+			if (bytes_written < 0)
+			{
+				APP_ERROR("Failed to write package " << pk->final_path << ", the old one is left in place")
+				return false;
+			}
 
 			APP_INFO("Wrote " << pk->final_path << " (" << bytes_written << ") bytes")
 
@@ -330,16 +526,63 @@ namespace putki
 			std::ofstream ptr(pk->ptr_file.c_str());
 			ptr << pk->ptr_file_content;
 			ptr.close();
+			return true;
+		}
+
+		// folds the patch chain just written back into the base package, so loads read one file again.
+		void compact_package(pkg_conf *pk, packaging_config *packaging)
+		{
+			if (pk->ptr_file_content == pk->path)
+				return;
+
+			PROFILE_SCOPE("package", "compact_package", pk->path.c_str())
+			if (!putki::package::compact(packaging->package_path.c_str(), pk->ptr_file_content.c_str(), pk->path.c_str()))
+			{
+				APP_WARNING("Compaction of " << pk->path << " failed, keeping the patch chain")
+				return;
+			}
+
+			for (int i=1;;i++)
+			{
+				sstream patch;
+				patch << packaging->package_path.c_str() << pk->path.c_str() << ".patch" << i;
+				std::string manifest(patch.c_str());
+				manifest.append(".manifest");
+				if (::remove(patch.c_str()) != 0)
+					break;
+				::remove(manifest.c_str());
+			}
+
+			std::ofstream ptr(pk->ptr_file.c_str());
+			ptr << pk->path;
+			ptr.close();
+
+			pk->ptr_file_content = pk->path;
+			pk->final_path = packaging->package_path + pk->path;
+			pk->final_manifest_path = pk->final_path + ".manifest";
 		}
 
-		void do_build(putki::builder::data *builder, const char *single_asset, bool make_patch)
+		void do_build(putki::builder::data *builder, const char *single_asset, bool make_patch, bool compact, const char *access_profile)
 		{
+			// with nothing changed since the packages were written there is nothing to load or build.
+			// reporting does not run either, so reports are left as the last full build wrote them.
+			build_db::data *bdb = builder::get_build_db(builder);
+			const std::string packaging_sig = packaging_signature(builder, compact, access_profile);
+			if (!make_patch && builder::inputs_unchanged(builder) && packages_up_to_date(bdb, packaging_sig))
+			{
+				APP_INFO("Nothing has changed since the last build, packages are up to date. Skipped reporting and writing the cache.")
+				return;
+			}
+
 			sys::mutex in_db_mtx, tmp_db_mtx, out_db_mtx;
 			db::data *input = putki::db::create(0, &in_db_mtx);
 			db::data *tmp = putki::db::create(input, &tmp_db_mtx);
 			db::data *output = putki::db::create(tmp, &out_db_mtx);
 
-			load_tree_into_db(builder::obj_path(builder), input);
+			{
+				PROFILE_SCOPE("phase", "load_tree", 0)
+				load_tree_into_db(builder::obj_path(builder), input);
+			}
 
 			builder::build_context *ctx = builder::create_context(builder, input, tmp, output);
 
@@ -350,10 +593,18 @@ namespace putki
 			packaging_config pconf;
 			pconf.package_path = pkg_path;
 			pconf.rt = builder::runtime(builder);
-			pconf.bdb = builder::get_build_db(builder);
+			pconf.bdb = bdb;
 			pconf.context = ctx;
 			pconf.make_patch = make_patch;
-			putki::builder::invoke_packager(output, &pconf);
+			pconf.compact = compact;
+			pconf.string_pool = builder::string_pool(builder);
+			pconf.slot_aliases = builder::slot_aliases(builder);
+			pconf.access_profile = access_profile ? package::load_access_profile(access_profile) : 0;
+			pconf.same_packaging = packaging_sig == build_db::get_packaging_signature(bdb);
+			{
+				PROFILE_SCOPE("phase", "packager", 0)
+				putki::builder::invoke_packager(output, &pconf);
+			}
 
 			// Required assets
 			std::set<std::string> req;
@@ -376,64 +627,122 @@ namespace putki
 			}
 
 			builder::context_finalize(ctx);
-			builder::context_build(ctx);
+			{
+				PROFILE_SCOPE("phase", "build", 0)
+				builder::context_build(ctx);
+			}
 
-			post_build_ptr_update(input, output);
+			{
+				PROFILE_SCOPE("phase", "post_build_ptr_update", 0)
+				post_build_ptr_update(input, output, builder::num_threads(builder));
+			}
 
 			// save built objects.
-			write_cache_json js;
-			js.path_base = builder::built_obj_path(builder);
-			js.db = output;
-			js.builder = builder;
-			for (unsigned int i=0;;i++)
+			write_cache wc;
+			wc.path_base = builder::built_obj_path(builder);
+			wc.db = output;
+			wc.json = builder::json_cache(builder);
 			{
-				const char *path = context_get_built_object(ctx, i);
-				if (!path)
-					break;
-
-				if (db::is_aux_path(path))
-					continue;
-				
-				type_handler_i *th;
-				instance_t obj;
-				if (db::fetch(output, path, &th, &obj, false))
+				PROFILE_SCOPE("phase", "write_cache", 0)
+				std::vector<std::string> paths;
+				for (unsigned int i=0;;i++)
 				{
-					js.record(path, th, obj);
+					const char *path = context_get_built_object(ctx, i);
+					if (!path)
+						break;
+
+					if (db::is_aux_path(path))
+						continue;
+
+					// the ones read from the cache are there already, unless they are wanted as json.
+					if (!wc.json && context_was_read_from_cache(ctx, i))
+						continue;
+
+					paths.push_back(path);
 				}
+
+				wc.snapshot = db::take_snapshot(output);
+				db::parallel_read(wc.snapshot, paths, &wc, builder::num_threads(builder));
+				db::free_snapshot(wc.snapshot);
 			}
 
-			if (js.written > 0)
+			if (wc.written > 0)
 			{
-				APP_INFO("Wrote " << js.written << " JSON objects to output")
+				APP_INFO("Wrote " << wc.written << (wc.json ? " JSON" : "") << " objects to output")
 			}
 
 			APP_INFO("Done building. Performing reporting step.")
 
-			builder::invoke_reporting(output, &pconf);
+			{
+				PROFILE_SCOPE("phase", "reporting", 0)
+				builder::invoke_reporting(output, &pconf);
+			}
 
 			APP_INFO("Done reporting. Writing packages")
 
+			std::vector<std::string> contents(pconf.packages.size());
+			unsigned int unchanged = 0;
+			std::vector<bool> written(pconf.packages.size(), true);
 			for (unsigned int i=0;i!=pconf.packages.size();i++)
 			{
-				write_package(&pconf.packages[i], &pconf);
+				contents[i] = package_contents(pconf.packages[i].pkg);
+				if (package_unchanged(&pconf.packages[i], &pconf, contents[i]))
+				{
+					APP_DEBUG("Package " << pconf.packages[i].path << " is unchanged")
+					putki::package::free(pconf.packages[i].pkg);
+					unchanged++;
+					continue;
+				}
+
+				written[i] = write_package(&pconf.packages[i], &pconf);
 				putki::package::free(pconf.packages[i].pkg);
+				if (written[i] && pconf.compact)
+					compact_package(&pconf.packages[i], &pconf);
+			}
+
+			if (unchanged > 0)
+			{
+				APP_INFO(unchanged << " of " << pconf.packages.size() << " packages were unchanged")
 			}
 
+			// patches and failed packages leave nothing a later build can compare with.
+			const bool all_written = std::find(written.begin(), written.end(), false) == written.end();
+			build_db::clear_packages(bdb);
+			build_db::set_packaging_signature(bdb, (make_patch || !all_written) ? "" : packaging_sig.c_str());
+			for (unsigned int i=0;i!=pconf.packages.size() && !make_patch;i++)
+			{
+				if (written[i])
+					record_package(&pconf.packages[i], &pconf, contents[i]);
+			}
+
+			if (pconf.access_profile)
+				package::free_access_profile(pconf.access_profile);
+
 			// there should be no objects outside these database now.
 			db::free_and_destroy_objs(input);
 			db::free_and_destroy_objs(tmp);
 			db::free_and_destroy_objs(output);
 			builder::context_destroy(ctx);
+
+			// resources in use are linked from where they were saved, blobs with no such link can go.
+			if (!single_asset)
+			{
+				const unsigned int pruned = resource::prune_blobs(builder);
+				if (pruned > 0)
+				{
+					APP_INFO("Removed " << pruned << " unused blobs")
+				}
+			}
 		}
 
-		void full_build(putki::builder::data *builder, bool make_patch)
+		void full_build(putki::builder::data *builder, bool make_patch, bool compact, const char *access_profile)
 		{
-			do_build(builder, 0, make_patch);
+			do_build(builder, 0, make_patch, compact, access_profile);
 		}
 
 		void single_build(putki::builder::data *builder, const char *single_asset)
 		{
-			do_build(builder, single_asset, false);
+			do_build(builder, single_asset, false, false, 0);
 		}
 	}
 }
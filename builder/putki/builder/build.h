@@ -14,13 +14,16 @@ namespace putki
 	{
 		struct packaging_config;
 
-		void full_build(builder::data *builder, bool make_patch);
+		// compact folds patch chains back into one package after writing. access_profile is an
+		// optional runtime access profile used to order the slots in the packages.
+		void full_build(builder::data *builder, bool make_patch, bool compact = false, const char *access_profile = 0);
 		void single_build(builder::data *builder, const char *path);
 		
 		// make sure it is all resolved
 		void resolve_object(db::data *source, const char *path);
 
-		void post_build_ptr_update(db::data *input, db::data *output);
+		// walks the output objects on num_threads threads.
+		void post_build_ptr_update(db::data *input, db::data *output, unsigned int num_threads = 1);
 		void post_build_merge_database(putki::db::data *source, db::data *target);
 
 		// can be called from user functions.
@@ -8,8 +8,10 @@
 #include <putki/builder/write.h>
 #include <putki/builder/log.h>
 #include <putki/builder/tool.h>
+#include <putki/builder/profiler.h>
 #include <putki/sys/files.h>
 #include <putki/sys/thread.h>
+#include <putki/sys/clock.h>
 
 #include <map>
 #include <set>
@@ -20,6 +22,10 @@
 #include <sstream>
 #include <fstream>
 
+extern "C" {
+	#include <md5/md5.h>
+}
+
 namespace putki
 {
 	namespace builder
@@ -49,6 +55,12 @@ namespace putki
 			deferred_loader *tmp_loader;
 			deferred_loader *output_loader;
 			bool liveupdates;
+			bool json_cache;
+			bool string_pool;
+			bool slot_aliases;
+			// of the input sets when the records were marked, see fetch_cached_build.
+			unsigned int input_generation, tmp_generation;
+			bool inputs_known;
 			
 			// fix this
 			db::data *grand_input;
@@ -65,6 +77,20 @@ namespace putki
 			std::string path, parent_path;
 			bool from_cache;
 			prebuild_info prebuild;
+			// estimated critical path and the order it was added, for picking what to build next.
+			long long priority;
+			unsigned int seq;
+		};
+
+		// heap order, longest estimated critical path first and otherwise in the order added.
+		struct work_item_order
+		{
+			bool operator()(const work_item *a, const work_item *b) const
+			{
+				if (a->priority != b->priority)
+					return a->priority < b->priority;
+				return a->seq > b->seq;
+			}
 		};
 
 		struct build_context
@@ -77,9 +103,16 @@ namespace putki
 			sys::mutex mtx_items, mtx_output, mtx_tmp;
 			sys::condition cnd_items;
 			unsigned int item_pos, items_finished;
+			// all items in the order added, and the heap of the ones not yet picked.
 			std::vector<work_item*> items;
+			std::vector<work_item*> ready;
 			std::vector<sys::thread*> threads;
 			std::set<std::string> added;
+
+			// scheduling statistics, under mtx_items.
+			long long busy_us, longest_us;
+			long long first_done_us, last_done_us;
+			std::string longest_path;
 		};
 
 		namespace
@@ -125,6 +158,36 @@ namespace putki
 			info->require_outputs.push_back(path);
 		}
 
+		namespace
+		{
+			std::string inputs_signature(data *d, bool loaded)
+			{
+				char input_sig[SIG_BUF_SIZE], tmp_sig[SIG_BUF_SIZE];
+				if (loaded)
+				{
+					inputset::get_loaded_signature(d->input_set, input_sig);
+					inputset::get_loaded_signature(d->tmp_input_set, tmp_sig);
+				}
+				else
+				{
+					inputset::get_signature(d->input_set, input_sig);
+					inputset::get_signature(d->tmp_input_set, tmp_sig);
+				}
+				if (!input_sig[0] || !tmp_sig[0])
+					return "";
+				return std::string(input_sig) + tmp_sig;
+			}
+
+			// by the paths the build db records them with.
+			bool dependency_changed(void *userptr, const char *path, bool external_resource)
+			{
+				data *d = (data *) userptr;
+				if (external_resource)
+					return path[0] == '%' ? inputset::res_changed(d->tmp_input_set, path + 1) : inputset::res_changed(d->input_set, path);
+				return inputset::obj_changed(d->input_set, path) || inputset::obj_changed(d->tmp_input_set, path);
+			}
+		}
+
 		data* create(runtime::descptr rt, const char *path, bool reset_build_db, const char *build_config, int numthreads)
 		{
 			data *d = new data();
@@ -132,6 +195,11 @@ namespace putki
 			d->config = build_config;
 			d->num_threads = numthreads ? numthreads : 4;
 			d->liveupdates = false;
+			d->json_cache = false;
+			d->string_pool = false;
+			d->slot_aliases = false;
+			d->tmp_loader = 0;
+			d->output_loader = 0;
 
 			d->obj_path = d->res_path = d->out_path = d->tmp_path = d->tmpobj_path = d->built_obj_path = path;
 
@@ -187,6 +255,17 @@ namespace putki
 			d->input_set = inputset::open(d->obj_path.c_str(), d->res_path.c_str(), input_db_path.c_str());
 			d->tmp_input_set = inputset::open(d->tmpobj_path.c_str(), d->tmp_path.c_str(), tmp_db_path.c_str());
 
+			// the input set differences only tell what changed for the records if the build db was
+			// stored along with the input sets they were loaded from, otherwise every record gets
+			// its dependencies checked.
+			std::string loaded = inputs_signature(d, true);
+			const bool known = !loaded.empty() && loaded == build_db::get_inputs_signature(d->build_db);
+			d->inputs_known = known;
+			build_db::mark_dirty_records(d->build_db, known ? dependency_changed : 0, d);
+			d->input_generation = inputset::generation(d->input_set);
+			d->tmp_generation = inputset::generation(d->tmp_input_set);
+			APP_DEBUG("Input sets " << (known ? "match" : "do not match") << " the build db")
+
 			d->grand_input = 0;
 			return d;
 		}
@@ -203,8 +282,12 @@ namespace putki
 			build_db::release(builder->build_db);
 			inputset::release(builder->input_set);
 			inputset::release(builder->tmp_input_set);
-			loader_decref(builder->output_loader);
-			loader_decref(builder->tmp_loader);
+
+			// a build that found nothing to do never made a context, nor the loaders.
+			if (builder->output_loader)
+				loader_decref(builder->output_loader);
+			if (builder->tmp_loader)
+				loader_decref(builder->tmp_loader);
 
 			delete builder;
 		}
@@ -214,6 +297,36 @@ namespace putki
 			data->liveupdates = true;
 		}
 
+		void enable_json_cache(builder::data *data)
+		{
+			data->json_cache = true;
+		}
+
+		bool json_cache(builder::data *data)
+		{
+			return data->json_cache;
+		}
+
+		void enable_string_pool(builder::data *data)
+		{
+			data->string_pool = true;
+		}
+
+		bool string_pool(builder::data *data)
+		{
+			return data->string_pool;
+		}
+
+		void enable_slot_aliases(builder::data *data)
+		{
+			data->slot_aliases = true;
+		}
+
+		bool slot_aliases(builder::data *data)
+		{
+			return data->slot_aliases && !data->liveupdates;
+		}
+
 		build_db::data *get_build_db(builder::data *d)
 		{
 			return d->build_db;
@@ -224,6 +337,40 @@ namespace putki
 			return d->config.c_str();
 		}
 
+		unsigned int num_threads(builder::data *d)
+		{
+			return d->num_threads;
+		}
+
+		bool inputs_unchanged(builder::data *d)
+		{
+			return d->inputs_known && !d->input_generation && !d->tmp_generation;
+		}
+
+		void build_signature(builder::data *d, char *buffer)
+		{
+			putki::sstream ss;
+			ss << runtime::desc_str(d->runtime) << ":" << d->config << "\n";
+			for (BuildersMap::iterator i=d->handlers.begin(); i!=d->handlers.end(); i++)
+			{
+				ss << "h:" << i->first;
+				for (unsigned int j=0;j!=i->second.handlers.size();j++)
+					ss << ":" << i->second.handlers[j].handler->version();
+				ss << "\n";
+			}
+			for (unsigned int i=0;;i++)
+			{
+				type_handler_i *th = typereg_get_handler_by_index(i);
+				if (!th)
+					break;
+				ss << "t:" << th->name() << ":" << th->binary_signature() << "\n";
+			}
+
+			char signature[16];
+			md5_buffer(ss.c_str(), (unsigned int)ss.size(), signature);
+			md5_sig_to_string(signature, buffer, 64);
+		}
+
 		const char *obj_path(data *d)
 		{
 			return d->obj_path.c_str();
@@ -270,14 +417,6 @@ namespace putki
 			i->second.handlers.push_back(b);
 		}
 
-		// remove this when cleaned up
-		struct destroy_deplist
-		{
-			destroy_deplist(build_db::deplist *dl) : _dl(dl) { }
-			~destroy_deplist() { build_db::deplist_free(_dl); }
-			build_db::deplist *_dl;
-		};
-
 		// This adds a newly created input object from the handler. It is an output from the handler's point of view, but really an input.
 		// Maybe we could support adding final objects too.
 		void add_handler_output(build_context *ctx, build_db::record *record, const char *path, type_handler_i *type, instance_t obj, const char *handler_version)
@@ -292,10 +431,49 @@ namespace putki
 			inputset::touched_resource(builder->tmp_input_set, path);
 		}
 
+		void touched_temp_resource(data *builder, const char *path, const char *signature)
+		{
+			inputset::force_res(builder->tmp_input_set, path, signature);
+		}
+
+		// current signatures of what records depend on, for build_db::current_input_signature.
+		struct dependency_source
+		{
+			data *builder;
+			db::data *input;
+		};
+
+		bool current_dependency_signature(void *userptr, const char *path, bool external_resource, char *sig)
+		{
+			dependency_source *src = (dependency_source *) userptr;
+			data *builder = src->builder;
+
+			if (external_resource)
+			{
+				if (path[0] != '%')
+					return inputset::get_res_sig(builder->input_set, path, sig);
+				return inputset::get_res_sig(builder->tmp_input_set, path + 1, sig);
+			}
+
+			if (builder->liveupdates)
+			{
+				strcpy(sig, "<broken signature>");
+				db::signature(src->input, path, sig);
+			}
+			else if (!inputset::get_object_sig(builder->input_set, path, sig) &&
+			         !inputset::get_object_sig(builder->tmp_input_set, path, sig))
+			{
+				BUILD_ERROR(builder, "Signature missing weirdness [" << path << "]")
+				strcpy(sig, "bonkers");
+			}
+			return true;
+		}
+
 		// returns either 0 (loaded from cache)
 		// or a reason to rebuild.
 		const char* fetch_cached_build(build_context *context, data *builder, build_db::record * newrecord, const char *handler_name, db::data *input, const char *path, type_handler_i *th)
 		{
+			PROFILE_SCOPE("cache", "fetch_cached_build", path)
 			// Time to hunt for cached object.
 			build_db::record *record = build_db::find(builder::get_build_db(builder), path);
 			if (!record)
@@ -308,83 +486,42 @@ namespace putki
 				return "builders are diffeent";
 			}
 
-			build_db::deplist *dlist = build_db::inputdeps_get(builder::get_build_db(builder), path);
-			destroy_deplist destroy(dlist);
+			// records marked clean have had nothing they depend on change since they were last checked,
+			// which holds as long as the input sets have not changed during this build either.
+			const bool clean = !builder->liveupdates && !build_db::is_dirty(record) &&
+			                   inputset::generation(builder->input_set) == builder->input_generation &&
+			                   inputset::generation(builder->tmp_input_set) == builder->tmp_generation;
 
-			if (!dlist)
+			if (clean)
 			{
-				return "no dlist";
+				RECORD_DEBUG(newrecord, "Dependencies unchanged")
 			}
-
-			bool gotmatch = false;
-
-			for (int i=0;;i++)
+			else
 			{
-				const char *entrypath = build_db::deplist_path(dlist, i);
-				if (!entrypath)
-				{
-					break;
-				}
-			
-				if (!i)
-				{
-					RECORD_DEBUG(newrecord, "Examining cache...")
-				}
-
-				const char *signature = build_db::deplist_signature(dlist, i);
-				if (!build_db::deplist_is_external_resource(dlist, i))
-				{
-					char inputsig[SIG_BUF_SIZE];
+				RECORD_DEBUG(newrecord, "Examining cache...")
 
-					if (builder->liveupdates)
-					{
-						strcpy(inputsig, "<broken signature>");
-						db::signature(input, entrypath, inputsig);
-					}
-					else
-					{
-						if (!inputset::get_object_sig(builder->input_set, entrypath, inputsig))
-						{
-							if (!inputset::get_object_sig(builder->tmp_input_set, entrypath, inputsig))
-							{
-								BUILD_ERROR(builder, "Signature missing weirdness [" << entrypath << "]")
-								strcpy(inputsig, "bonkers");
-							}
-						}
-					}
+				dependency_source src;
+				src.builder = builder;
+				src.input = input;
 
-					RECORD_DEBUG(newrecord, "=> i: " << entrypath << " old:" << signature << " new " << inputsig)
+				char current[SIG_BUF_SIZE];
+				const char *changed = 0;
+				const int deps = build_db::current_input_signature(record, current_dependency_signature, &src, current, &changed);
+				if (deps < 0)
+					return "failed to read signature on existing resource";
+				if (!deps)
+					return "there was a record but no matches nor mismatches";
 
-					// only care for builder match when the input is going to be built with this builder
-					if (strcmp(inputsig, signature))
-					{
-						RECORD_DEBUG(newrecord, "!! Detected modification in [" << entrypath << "]")
-						return "input or has been modified";
-					}
-
-					gotmatch = true;
-				}
-				else
+				if (strcmp(current, build_db::get_input_signature(record)))
 				{
-					RECORD_DEBUG(newrecord, "=> ext: " << entrypath << " old:" << signature)
-
-					char cursig[SIG_BUF_SIZE];
-					if ( (entrypath[0] != '%' && !inputset::get_res_sig(builder->input_set, entrypath, cursig)) ||
-					     (entrypath[0] == '%' && !inputset::get_res_sig(builder->tmp_input_set, entrypath+1, cursig) ))
-					{
-						RECORD_DEBUG(newrecord, "Could not get input sig for " << entrypath)
-						return "failed to read signature on existing resource";
-					}
-					
-					if (strcmp(cursig, signature))
-						return "external source data has been modified";
-
-					gotmatch = true;
+					RECORD_DEBUG(newrecord, "!! Detected modification in [" << (changed ? changed : "?") << "]")
+					return "input or external source data has been modified";
 				}
 			}
 
-			if (!gotmatch)
-				return "there was a record but no matches nor mismatches";
+			// the binary form can't be read back after the types have changed.
+			if (!is_cached_object_current(builder->built_obj_path.c_str(), path))
+				return "cached object was written with an older type layout";
 
 			// Replace the build record from the cache.
 
@@ -502,6 +639,8 @@ namespace putki
 
 						verify_obj(input, 0, th, input_obj, REQUIRE_RESOLVED | REQUIRE_HAS_PATHS, true, true);
 						output_obj = th->clone(input_obj);
+
+						PROFILE_SCOPE("handler", e->handler->version(), path)
 						e->handler->handle(context, context->builder, record, input, path, output_obj);
 					}
 					else
@@ -564,7 +703,7 @@ namespace putki
 			ad.output = context->output;
 			ad.record = record;
 			ad.name = default_name;
-			th->walk_dependencies(output_obj, &ad, true);
+			putki::walk_dependencies(th, output_obj, &ad, true);
 
 			for (unsigned int i=0;i<ad.aux_outs.size();i++)
 			{
@@ -598,15 +737,29 @@ namespace putki
 			return ctx;
 		}
 
+		namespace
+		{
+			// call with mtx_items held.
+			void schedule_item(build_context *context, work_item *wi)
+			{
+				wi->seq = (unsigned int) context->items.size();
+				context->items.push_back(wi);
+				context->ready.push_back(wi);
+				std::push_heap(context->ready.begin(), context->ready.end(), work_item_order());
+			}
+		}
+
 		void context_add_to_build(build_context *context, const char *path)
 		{
+			const long long priority = build_db::estimated_critical_path(context->builder->build_db, path);
 			sys::scoped_maybe_lock lk0(&context->mtx_items);
 			if (!context->added.count(path))
 			{
 				work_item *wi = new work_item();
 				wi->input = context->input;
 				wi->path = path;
-				context->items.push_back(wi);
+				wi->priority = priority;
+				schedule_item(context, wi);
 				context->cnd_items.broadcast();
 				context->added.insert(path);
 			}
@@ -644,6 +797,7 @@ namespace putki
 
 		void context_process_record(build_context *context, work_item *item)
 		{
+			const long long started = sys::time_us();
 			BUILD_DEBUG(context->builder, "Record: " << item->path)
 			if (!db::exists(item->input, item->path.c_str(), true))
 			{
@@ -750,6 +904,7 @@ namespace putki
 					wi->path = cr_path_ptr;
 					wi->parent_path = item->path;
 					wi->input = context->tmp;
+					wi->priority = build_db::estimated_critical_path(context->builder->build_db, cr_path_ptr);
 					sub_items.push_back(wi);
 					outpos++;
 				}
@@ -757,6 +912,10 @@ namespace putki
 
 			APP_DEBUG("Post-processing item")
 
+			// cache reads keep the time of the build that made the object.
+			if (!from_cache)
+				build_db::set_build_time(record, sys::time_us() - started);
+
 			build_db::commit_record(context->builder->build_db, record);
 
 			if (!context->builder->liveupdates)
@@ -771,7 +930,7 @@ namespace putki
 
 			context->mtx_items.lock();
 			for (unsigned int i=0;i<sub_items.size();i++)
-				context->items.push_back(sub_items[i]);
+				schedule_item(context, sub_items[i]);
 			context->cnd_items.broadcast();
 			context->mtx_items.unlock();
 		}
@@ -779,7 +938,18 @@ namespace putki
 		void context_finalize(build_context *context)
 		{
 			APP_INFO("Finalizing build context with " << context->items.size() << " records.")
+			build_db::estimate_critical_paths(context->builder->build_db);
+
+			// items without history keep a random order among themselves.
 			std::random_shuffle(context->items.begin(), context->items.end());
+			for (unsigned int i=0;i!=context->items.size();i++)
+			{
+				work_item *wi = context->items[i];
+				wi->priority = build_db::estimated_critical_path(context->builder->build_db, wi->path.c_str());
+				wi->seq = i;
+			}
+			context->ready = context->items;
+			std::make_heap(context->ready.begin(), context->ready.end(), work_item_order());
 		}
 		
 		struct buildthread
@@ -794,7 +964,8 @@ namespace putki
 			build_context *context = bt->context;
 			int id = bt->id;
 			
-			bool has_built = false;
+			work_item *built = 0;
+			long long build_us = 0, done_us = 0;
 			
 			while (true)
 			{
@@ -802,23 +973,41 @@ namespace putki
 				work_item *item;
 				context->mtx_items.lock();
 				
-				if (has_built)
+				if (built)
 				{
 					context->items_finished++;
+					context->busy_us += build_us;
+					if (build_us > context->longest_us)
+					{
+						context->longest_us = build_us;
+						context->longest_path = built->path;
+					}
 					context->cnd_items.broadcast();
 				}
 				
 				while (true)
 				{
-					if (context->item_pos < context->items.size())
+					if (!context->ready.empty())
 					{
-						item = context->items[context->item_pos++];
+						std::pop_heap(context->ready.begin(), context->ready.end(), work_item_order());
+						item = context->ready.back();
+						context->ready.pop_back();
+						context->item_pos++;
 						APP_DEBUG("Thread " << id << " picked item " << item->path)
 						context->mtx_items.unlock();
 						break;
 					}
 					if (context->items_finished == context->item_pos)
 					{
+						// out of work for good, the time from the first thread getting here to
+						// the last is the tail where cores sit idle.
+						if (built)
+						{
+							if (!context->first_done_us || done_us < context->first_done_us)
+								context->first_done_us = done_us;
+							if (done_us > context->last_done_us)
+								context->last_done_us = done_us;
+						}
 						context->mtx_items.unlock();
 						delete bt;
 						return 0;
@@ -826,8 +1015,14 @@ namespace putki
 					context->cnd_items.wait(&context->mtx_items);
 				}
 				
-				context_process_record(context, item);
-				has_built = true;
+				const long long start_us = sys::time_us();
+				{
+					PROFILE_SCOPE("build", "process_record", item->path.c_str())
+					context_process_record(context, item);
+				}
+				done_us = sys::time_us();
+				build_us = done_us - start_us;
+				built = item;
 			}
 		}
 
@@ -835,6 +1030,10 @@ namespace putki
 		{
 			context->builder->grand_input = context->input;
 			context->item_pos = context->items_finished = 0;
+			context->busy_us = context->longest_us = 0;
+			context->first_done_us = context->last_done_us = 0;
+			context->longest_path.clear();
+			const long long start_us = sys::time_us();
 
 			APP_INFO("Starting build with " << context->builder->num_threads << " threads..")
 			
@@ -860,6 +1059,17 @@ namespace putki
 			}
 			
 			APP_INFO("Finished build, total of " << context->items.size() << " build records")
+
+			const long long wall_us = sys::time_us() - start_us;
+			const long long capacity_us = wall_us * context->builder->num_threads;
+			const long long idle_us = capacity_us > context->busy_us ? capacity_us - context->busy_us : 0;
+			APP_INFO("Schedule: " << context->busy_us / 1000 << " ms of work in " << wall_us / 1000 << " ms on " << context->builder->num_threads << " threads, "
+			         << idle_us / 1000 << " ms idle (" << (capacity_us ? (100 * idle_us / capacity_us) : 0) << "%), tail "
+			         << (context->last_done_us - context->first_done_us) / 1000 << " ms")
+			if (!context->longest_path.empty())
+			{
+				APP_INFO("Longest record " << context->longest_path << " took " << context->longest_us / 1000 << " ms")
+			}
 		}
 
 		void build_source_object(data *builder, db::data *input, db::data *tmp, db::data *output, const char *path)
@@ -918,6 +1128,9 @@ namespace putki
 		}
 		void write_build_db(builder::data *d)
 		{
+			// records not looked at in this build keep track of what changed under them.
+			build_db::mark_dirty_records(d->build_db, dependency_changed, d);
+			build_db::set_inputs_signature(d->build_db, inputs_signature(d, false).c_str());
 			build_db::store(d->build_db);
 		}
 
@@ -25,10 +25,31 @@ namespace putki
 		// runtime
 		runtime::descptr runtime(builder::data *data);
 		const char *config(builder::data *data);
+		unsigned int num_threads(builder::data *data);
+
+		// true when nothing in the input sets has changed since the build db was last written.
+		bool inputs_unchanged(builder::data *data);
+		// md5 over what decides the built objects besides the input: runtime, config, handler
+		// versions and type layouts. buffer takes 64 chars.
+		void build_signature(builder::data *data, char *buffer);
 		
 		// live update functionality
 		void build_source_object(data *builder, db::data *input, db::data *tmp, db::data *output, const char *path);
 		void enable_liveupdate_builds(builder::data *data);
+
+		// write the built object cache as json instead of binary, for debugging.
+		void enable_json_cache(builder::data *data);
+		bool json_cache(builder::data *data);
+
+		// write packages with a string pool (see package::set_string_pool). the c++ runtime reads
+		// these, the c# runtime does not.
+		void enable_string_pool(builder::data *data);
+		bool string_pool(builder::data *data);
+
+		// write packages with slot aliases (see package::set_slot_aliases). never on together
+		// with liveupdate builds.
+		void enable_slot_aliases(builder::data *data);
+		bool slot_aliases(builder::data *data);
 	
 		// new api
 		struct build_context;
@@ -61,6 +82,7 @@ namespace putki
 		void add_data_builder(builder::data *builder, type_t type, handler_i *handler);
 		void add_handler_output(build_context *ctx, build_db::record *record, const char *path, type_handler_i *type, instance_t obj, const char *handler_version);
 		void touched_temp_resource(data *builder, const char *path);
+		void touched_temp_resource(data *builder, const char *path, const char *signature);
 
 		void record_log(data *builder, LogType, const char *text);
 		
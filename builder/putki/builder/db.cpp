@@ -6,6 +6,8 @@
 #include <set>
 #include <vector>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <cstdlib>
 #include <cstdio>
@@ -57,6 +59,40 @@ namespace putki
 			void *userptr;
 		};
 
+		struct cstr_hash
+		{
+			size_t operator()(const char *s) const
+			{
+				size_t h = 2166136261u;
+				while (*s)
+					h = (h ^ (unsigned char)*s++) * 16777619u;
+				return h;
+			}
+		};
+
+		struct cstr_eq
+		{
+			bool operator()(const char *a, const char *b) const
+			{
+				return !strcmp(a, b);
+			}
+		};
+
+		// strings point into the maps of the dbs it was taken from.
+		struct snapshot
+		{
+			struct record
+			{
+				const char *path;
+				type_handler_i *th;
+				instance_t obj;
+			};
+			std::vector<record> records;
+			std::unordered_map<const char *, alloc_entry, cstr_hash, cstr_eq> objs;
+			std::unordered_map<instance_t, const char *> paths;
+			std::unordered_set<const void *> unresolved;
+		};
+
 		struct data
 		{
 			std::map<std::string, entry> objs;
@@ -209,7 +245,8 @@ namespace putki
 				entry e = i->second;
 				_lk.unlock();
 				
-				putki::sstream ss;
+				write::scoped_stream buf;
+				putki::sstream & ss = *buf.stream;
 				write::write_object_into_stream(ss, d, e.th, e.obj);
 
 				char signature[16];
@@ -592,6 +629,158 @@ namespace putki
 			}
 		}
 
+		snapshot * take_snapshot(data *d)
+		{
+			snapshot *s = new snapshot();
+
+			// fetch only looks in the db itself, skipping objects still being loaded like
+			// read_all_no_fetch.
+			{
+				sys::scoped_maybe_lock _lk(d->mtx);
+				s->records.reserve(d->objs.size());
+				s->objs.reserve(d->objs.size());
+				for (std::map<std::string, entry>::iterator i = d->objs.begin(); i != d->objs.end(); i++)
+				{
+					if (d->isloading.count(i->first))
+						continue;
+					snapshot::record r;
+					r.path = i->first.c_str();
+					r.th = i->second.th;
+					r.obj = i->second.obj;
+					s->records.push_back(r);
+
+					alloc_entry e;
+					e.th = i->second.th;
+					e.obj = i->second.obj;
+					s->objs.insert(std::make_pair(r.path, e));
+				}
+			}
+
+			// pathof and is_unresolved_pointer look through the parents, nearest db first.
+			for (data *c = d; c; c = c->parent)
+			{
+				sys::scoped_maybe_lock _lk(c->mtx);
+				for (std::map<instance_t, std::string>::iterator i = c->paths.begin(); i != c->paths.end(); i++)
+					s->paths.insert(std::make_pair(i->first, i->second.c_str()));
+				s->unresolved.insert(c->unresolved.begin(), c->unresolved.end());
+			}
+			return s;
+		}
+
+		void free_snapshot(snapshot *s)
+		{
+			delete s;
+		}
+
+		const char *pathof(snapshot *s, instance_t obj)
+		{
+			std::unordered_map<instance_t, const char *>::const_iterator i = s->paths.find(obj);
+			return i != s->paths.end() ? i->second : 0;
+		}
+
+		const char *pathof_including_unresolved(snapshot *s, instance_t obj)
+		{
+			if (s->unresolved.count(obj))
+				return (const char *) obj;
+
+			std::unordered_map<instance_t, const char *>::const_iterator i = s->paths.find(obj);
+			return i != s->paths.end() ? i->second : 0;
+		}
+
+		bool fetch(snapshot *s, const char *path, type_handler_i **th, instance_t *obj)
+		{
+			std::unordered_map<const char *, alloc_entry, cstr_hash, cstr_eq>::const_iterator i = s->objs.find(path);
+			if (i == s->objs.end())
+				return false;
+			*th = i->second.th;
+			*obj = i->second.obj;
+			return true;
+		}
+
+		namespace
+		{
+			// threads take records in chunks off a shared counter.
+			const int PARALLEL_CHUNK = 256;
+
+			struct parallel_job
+			{
+				const std::vector<snapshot::record> *records;
+				enum_i *e;
+				volatile int next;
+			};
+
+			void run_parallel_job(parallel_job *job)
+			{
+				const int count = (int) job->records->size();
+				while (true)
+				{
+					const int beg = (sys::atomic_inc(&job->next) - 1) * PARALLEL_CHUNK;
+					if (beg >= count)
+						return;
+
+					const int end = beg + PARALLEL_CHUNK < count ? beg + PARALLEL_CHUNK : count;
+					for (int k=beg;k!=end;k++)
+					{
+						const snapshot::record & r = (*job->records)[k];
+						job->e->record(r.path, r.th, r.obj);
+					}
+				}
+			}
+
+			void* parallel_thread(void *userptr)
+			{
+				run_parallel_job((parallel_job *) userptr);
+				return 0;
+			}
+
+			void run_parallel(const std::vector<snapshot::record> & records, enum_i *eobj, unsigned int num_threads)
+			{
+				parallel_job job;
+				job.records = &records;
+				job.e = eobj;
+				job.next = 0;
+
+				const unsigned int chunks = (unsigned int)((records.size() + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK);
+				if (num_threads > chunks)
+					num_threads = chunks;
+
+				std::vector<sys::thread*> threads;
+				for (unsigned int i=1;i<num_threads;i++)
+					threads.push_back(sys::thread_create(parallel_thread, &job));
+
+				run_parallel_job(&job);
+
+				for (unsigned int i=0;i!=threads.size();i++)
+				{
+					sys::thread_join(threads[i]);
+					sys::thread_free(threads[i]);
+				}
+			}
+		}
+
+		void parallel_read_all(snapshot *s, enum_i *eobj, unsigned int num_threads)
+		{
+			run_parallel(s->records, eobj, num_threads);
+		}
+
+		void parallel_read(snapshot *s, const std::vector<std::string> & paths, enum_i *eobj, unsigned int num_threads)
+		{
+			std::vector<snapshot::record> records;
+			records.reserve(paths.size());
+			for (size_t i=0;i!=paths.size();i++)
+			{
+				std::unordered_map<const char *, alloc_entry, cstr_hash, cstr_eq>::const_iterator j = s->objs.find(paths[i].c_str());
+				if (j == s->objs.end())
+					continue;
+				snapshot::record r;
+				r.path = j->first;
+				r.th = j->second.th;
+				r.obj = j->second.obj;
+				records.push_back(r);
+			}
+			run_parallel(records, eobj, num_threads);
+		}
+
 		unsigned int size(data *d)
 		{
 			return (unsigned int) d->objs.size();
@@ -2,6 +2,9 @@
 
 #include <putki/builder/typereg.h>
 
+#include <string>
+#include <vector>
+
 namespace putki
 {
 	namespace sys { struct mutex; }
@@ -61,5 +64,23 @@ namespace putki
 		const char *is_unresolved_pointer(data *d, void *p);
 
 		unsigned int size(data *d);
+
+		// frozen copy of the lookup tables of a db and its parents, for whole db passes that only
+		// read them. needs no locking and can be used from any number of threads, but objects must
+		// not be overwritten or removed from the dbs while it is alive. new ones are not seen.
+		struct snapshot;
+		snapshot * take_snapshot(data *d);
+		void free_snapshot(snapshot *s);
+
+		const char *pathof(snapshot *s, instance_t obj);
+		const char *pathof_including_unresolved(snapshot *s, instance_t obj);
+		// loaded objects only, never runs deferred loads.
+		bool fetch(snapshot *s, const char *path, type_handler_i **th, instance_t *obj);
+
+		// calls record on every loaded object in the snapshotted db (not its parents) spread out
+		// over num_threads threads, so record must be thread safe.
+		void parallel_read_all(snapshot *s, enum_i *, unsigned int num_threads);
+		// same for the given paths only, the ones not loaded in the snapshot are skipped.
+		void parallel_read(snapshot *s, const std::vector<std::string> & paths, enum_i *, unsigned int num_threads);
 	}
 }
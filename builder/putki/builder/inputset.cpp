@@ -15,6 +15,7 @@
 #include <cstdlib>
 #include <cstdio>
 #include <map>
+#include <set>
 
 extern "C" {
 	#include <md5/md5.h>
@@ -54,8 +55,34 @@ namespace putki
 			ObjMap objs;
 			ResMap res;
 			sys::mutex mtx;
+
+			// paths with signatures different from the dbfile, and a count of all changes.
+			std::set<std::string> changed_objs, changed_res;
+			unsigned int generation;
+			std::string loaded_sig;
 		};
 
+		// call with the lock held.
+		void note_change(data *d, std::set<std::string> & changed, const std::string & path)
+		{
+			changed.insert(path);
+			d->generation++;
+		}
+
+		std::string state_signature(data *d)
+		{
+			std::string state;
+			for (ObjMap::iterator i = d->objs.begin(); i != d->objs.end(); ++i)
+				state.append("i:").append(i->first).append(":").append(i->second.content_sig).append("\n");
+			for (ResMap::iterator j = d->res.begin(); j != d->res.end(); ++j)
+				state.append("r:").append(j->first).append(":").append(j->second.content_sig).append("\n");
+
+			char signature[16], signature_string[64];
+			md5_buffer(state.c_str(), (long)state.size(), signature);
+			md5_sig_to_string(signature, signature_string, 64);
+			return signature_string;
+		}
+
 		std::string obj_path(const char *base, const char *path)
 		{
 			return std::string(base) + "/" + path + ".json";
@@ -140,10 +167,14 @@ namespace putki
 				db::free_and_destroy_objs(tmp);
 			}
 
-			if (sig != record.content_sig && !record.content_sig.empty())
+			if (sig != record.content_sig)
 			{
-				APP_DEBUG("New signature on object [" << sig << "], old sig = [" << record.content_sig << "]")
-				d->has_changes = true;
+				if (!record.content_sig.empty())
+				{
+					APP_DEBUG("New signature on object [" << sig << "], old sig = [" << record.content_sig << "]")
+					d->has_changes = true;
+				}
+				note_change(d, d->changed_objs, i->first);
 			}
 
 			record.content_sig = sig;
@@ -236,10 +267,14 @@ namespace putki
 				record.info = info;
 			}
 
-			if (sig != record.content_sig && !sig.empty())
+			if (sig != record.content_sig)
 			{
-				APP_DEBUG("New signature on object [" << record.content_sig << "], old sig = [" << sig << "]")
-				d->has_changes = true;
+				if (!sig.empty())
+				{
+					APP_DEBUG("New signature on object [" << record.content_sig << "], old sig = [" << sig << "]")
+					d->has_changes = true;
+				}
+				note_change(d, d->changed_res, i->first);
 			}
 
 			record.exists = true;
@@ -298,6 +333,8 @@ namespace putki
 			
 			// cleanup
 			if (tk) tok::free(tk);
+
+			d->loaded_sig = state_signature(d);
 		}
 
 		void write(data *d)
@@ -322,6 +359,8 @@ namespace putki
 		void force_obj(data *d, const char *path, const char *signature, const char *type)
 		{
 			sys::scoped_maybe_lock lk(&d->mtx);
+			if (d->objs[path].content_sig != signature)
+				note_change(d, d->changed_objs, path);
 			d->objs[path].content_sig = signature;
 			d->objs[path].type = type;
 			sys::stat(obj_path(d->objpath.c_str(), path).c_str(), &d->objs[path].info);
@@ -333,6 +372,31 @@ namespace putki
 			res_file(full_path.c_str(), (path+1), d);
 		}
 
+		// same as touched_resource, but the caller already knows the signature of the contents
+		// so the file never needs to be read back.
+		void force_res(data *d, const char *path, const char *signature)
+		{
+			std::string full_path = d->respath + "/" + (path+1);
+
+			sys::scoped_maybe_lock lk(&d->mtx);
+			r_record & record = d->res[path+1];
+			if (record.content_sig != signature)
+			{
+				d->has_changes = true;
+				note_change(d, d->changed_res, path+1);
+			}
+
+			record.path = path+1;
+			record.content_sig = signature;
+			record.exists = true;
+			if (!sys::stat(full_path.c_str(), &record.info))
+			{
+				APP_WARNING("Could not stat [" << full_path << "]")
+				record.info.size = -1;
+				record.info.mtime = -1;
+			}
+		}
+
 		data *open(const char *objpath, const char *respath, const char *dbfile)
 		{
 			data *d = new data();
@@ -340,6 +404,7 @@ namespace putki
 			d->objpath = objpath;
 			d->dbfile = dbfile;
 			d->has_changes = false;
+			d->generation = 0;
 
 			APP_DEBUG("Input set [" << objpath << "]/[" << respath << "] tracked in [" << dbfile << "]")
 
@@ -354,6 +419,7 @@ namespace putki
 				if (!i->second.exists)
 				{
 					APP_INFO("Removed object [" << i->first << "]")
+					note_change(d, d->changed_objs, i->first);
 					d->objs.erase(i++);
 					d->has_changes = true;
 					continue;
@@ -367,6 +433,7 @@ namespace putki
 				if (!j->second.exists)
 				{
 					APP_INFO("Removed resource [" << j->first << "]")
+					note_change(d, d->changed_res, j->first);
 					d->res.erase(j++);
 					d->has_changes = true;
 					continue;
@@ -426,5 +493,34 @@ namespace putki
 			}
 			return false;
 		}
+
+		void get_loaded_signature(data *d, char *buffer)
+		{
+			strcpy(buffer, d->loaded_sig.c_str());
+		}
+
+		void get_signature(data *d, char *buffer)
+		{
+			sys::scoped_maybe_lock lk(&d->mtx);
+			strcpy(buffer, state_signature(d).c_str());
+		}
+
+		bool obj_changed(data *d, const char *path)
+		{
+			sys::scoped_maybe_lock lk(&d->mtx);
+			return d->changed_objs.count(path) != 0;
+		}
+
+		bool res_changed(data *d, const char *path)
+		{
+			sys::scoped_maybe_lock lk(&d->mtx);
+			return d->changed_res.count(path) != 0;
+		}
+
+		unsigned int generation(data *d)
+		{
+			sys::scoped_maybe_lock lk(&d->mtx);
+			return d->generation;
+		}
 	}
 }
@@ -10,6 +10,7 @@ namespace putki
 		data *open(const char *objpath, const char *respath, const char *dbfile);
 		void force_obj(data *d, const char *objpath, const char *signature, const char *type);
 		void touched_resource(data *d, const char *path);
+		void force_res(data *d, const char *path, const char *signature);
 
 		void write(data *d);
 		void release(data *);
@@ -18,6 +19,17 @@ namespace putki
 		bool get_object_sig(data *d, const char *path, char *buffer);
 		const char *get_object_type(data *d, const char *path);
 		bool get_res_sig(data *d, const char *path, char *buffer);
+
+		// md5 over every path and signature, as read from the dbfile and as it is now.
+		void get_loaded_signature(data *d, char *buffer);
+		void get_signature(data *d, char *buffer);
+
+		// whether the signature has changed from the one in the dbfile, removals included.
+		bool obj_changed(data *d, const char *path);
+		bool res_changed(data *d, const char *path);
+
+		// counts up with every signature change.
+		unsigned int generation(data *d);
 	}
 }
 
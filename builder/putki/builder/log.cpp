@@ -1,9 +1,12 @@
 #include <iostream>
 #include <stdint.h>
 #include <sstream>
+#include <vector>
+#include <cstring>
 
 #include <putki/builder/log.h>
 #include <putki/sys/thread.h>
+#include <putki/sys/clock.h>
 #include <putki/sys/sstream.h>
 
 #if defined(_WIN32)
@@ -15,15 +18,175 @@ bool use_ansi_color = isatty(1);
 
 namespace putki
 {
+	LogType log_threshold = LOG_INFO;
+
 	namespace
 	{
-		LogType loglevel = LOG_INFO;
+		// held by whoever writes to stdout, which includes draining the rings.
 		sys::mutex mtx;
+
+		// Single producer (owning thread), single consumer (whoever holds mtx).
+		// head and tail only ever grow; positions are taken modulo the size.
+		struct log_ring
+		{
+			enum { SIZE = 128 * 1024 };
+			char buf[SIZE];
+			volatile unsigned int head;
+			volatile unsigned int tail;
+			volatile int orphaned;
+		};
+
+		std::vector<log_ring*> rings;
+		bool async_running = false;
+		volatile int async_stop = 0;
+		sys::thread *writer = 0;
+
+#if defined(_WIN32)
+		DWORD ring_key = FLS_OUT_OF_INDEXES;
+		#define LOG_TLS __declspec(thread)
+#else
+		pthread_key_t ring_key;
+		#define LOG_TLS __thread
+#endif
+		LOG_TLS log_ring *t_ring = 0;
+
+		// must hold mtx
+		void drain(log_ring *r)
+		{
+			const unsigned int head = r->head;
+			sys::memory_barrier();
+
+			unsigned int tail = r->tail;
+			while (tail != head)
+			{
+				unsigned int ofs = tail % log_ring::SIZE;
+				unsigned int len = head - tail;
+				if (ofs + len > log_ring::SIZE)
+					len = log_ring::SIZE - ofs;
+				std::cout.write(&r->buf[ofs], len);
+				tail += len;
+			}
+
+			sys::memory_barrier();
+			r->tail = tail;
+		}
+
+		// must hold mtx
+		void drain_all()
+		{
+			for (unsigned int i=0;i!=rings.size();i++)
+				drain(rings[i]);
+			std::cout.flush();
+		}
+
+#if defined(_WIN32)
+		void WINAPI ring_owner_exited(void *ptr)
+#else
+		void ring_owner_exited(void *ptr)
+#endif
+		{
+			if (ptr)
+				((log_ring *)ptr)->orphaned = 1;
+		}
+
+		log_ring *get_ring()
+		{
+			if (t_ring)
+				return t_ring;
+
+			sys::scoped_maybe_lock lk(&mtx);
+
+			// threads come and go with every build, so reuse the rings of dead ones.
+			log_ring *r = 0;
+			for (unsigned int i=0;i!=rings.size();i++)
+			{
+				if (rings[i]->orphaned)
+				{
+					drain(rings[i]);
+					r = rings[i];
+					break;
+				}
+			}
+
+			if (!r)
+			{
+				r = new log_ring();
+				r->head = r->tail = 0;
+				rings.push_back(r);
+			}
+
+			r->orphaned = 0;
+			t_ring = r;
+#if defined(_WIN32)
+			FlsSetValue(ring_key, r);
+#else
+			pthread_setspecific(ring_key, r);
+#endif
+			return r;
+		}
+
+		// false if it did not fit and the caller has to write it out itself.
+		bool ring_put(log_ring *r, const char *data, unsigned int size)
+		{
+			const unsigned int tail = r->tail;
+			sys::memory_barrier();
+
+			unsigned int head = r->head;
+			if (log_ring::SIZE - (head - tail) < size)
+				return false;
+
+			while (size)
+			{
+				unsigned int ofs = head % log_ring::SIZE;
+				unsigned int len = size;
+				if (ofs + len > log_ring::SIZE)
+					len = log_ring::SIZE - ofs;
+				memcpy(&r->buf[ofs], data, len);
+				data += len;
+				size -= len;
+				head += len;
+			}
+
+			sys::memory_barrier();
+			r->head = head;
+			return true;
+		}
+
+		void* writer_thread(void *)
+		{
+			while (!async_stop)
+			{
+				mtx.lock();
+				drain_all();
+				mtx.unlock();
+				sys::sleep_ms(5);
+			}
+			return 0;
+		}
+
+		void write_sync(const char *data, unsigned int size)
+		{
+			mtx.lock();
+			// keep the order of everything this thread logged before.
+			if (async_running)
+				drain_all();
+			std::cout.write(data, size);
+			std::cout.flush();
+			mtx.unlock();
+		}
+
+		void write_out(const char *data, unsigned int size, bool urgent)
+		{
+			if (!async_running || urgent || !ring_put(get_ring(), data, size))
+			{
+				write_sync(data, size);
+			}
+		}
 	}
 
 	void set_loglevel(LogType level)
 	{
-		loglevel = level;
+		log_threshold = level;
 	}
 	
 	void set_use_ansi_color(bool enabled)
@@ -31,11 +194,42 @@ namespace putki
 		use_ansi_color = enabled;
 	}
 
-	bool check_filter(LogType level)
+	void log_async_start()
 	{
-		return level >= loglevel;
+		if (async_running)
+			return;
+
+#if defined(_WIN32)
+		ring_key = FlsAlloc(ring_owner_exited);
+#else
+		pthread_key_create(&ring_key, ring_owner_exited);
+#endif
+		async_stop = 0;
+		async_running = true;
+		writer = sys::thread_create(writer_thread, 0);
 	}
-	
+
+	void log_async_stop()
+	{
+		if (!async_running)
+			return;
+
+		async_stop = 1;
+		sys::thread_join(writer);
+		sys::thread_free(writer);
+		writer = 0;
+
+		log_flush();
+		async_running = false;
+	}
+
+	void log_flush()
+	{
+		mtx.lock();
+		drain_all();
+		mtx.unlock();
+	}
+
 	void print_log(const char *indent, LogType level, const char *message)
 	{
 		print_log_multi(indent, &level, &message, 1);
@@ -44,6 +238,7 @@ namespace putki
 	void print_log_multi(const char *indent, LogType *levels, const char **messages, unsigned int count)
 	{
 		sstream buf;
+		bool has_error = false;
 
 		for (unsigned int i=0;i!=count;i++)
 		{
@@ -90,25 +285,22 @@ namespace putki
 			
 			if (levels[i] == LOG_ERROR)
 			{
-				// flush.
-				mtx.lock();
-				std::cout.write(buf.c_str(), buf.size());
-				std::cout << std::endl;
-				std::cout.flush();
-				mtx.unlock();
-#if defined(PUTKI_CRASH_ON_ERROR)
-				// crash
-				int *p = (int *) 0x23414;
-				*p = 234124;
-#endif
+				has_error = true;
 			}
 			
 			buf << "\n";
 		}
-		
-		mtx.lock();
-		std::cout.write(buf.c_str(), buf.size());
-		std::cout.flush();
-		mtx.unlock();
+
+		// errors go out right away.
+		write_out(buf.c_str(), (unsigned int)buf.size(), has_error);
+
+#if defined(PUTKI_CRASH_ON_ERROR)
+		if (has_error)
+		{
+			// crash
+			int *p = (int *) 0x23414;
+			*p = 234124;
+		}
+#endif
 	}
 }
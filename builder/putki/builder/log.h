@@ -16,8 +16,20 @@ namespace putki
 	void print_log_multi(const char *indent, LogType *levels, const char **messages, unsigned int count);
 	void print_log(const char *indent, LogType level, const char *message);
 	void set_loglevel(LogType loglevel);
-	bool check_filter(LogType);
+
+	// inline so filtered out messages never get further than a compare.
+	extern LogType log_threshold;
+	inline bool check_filter(LogType level)
+	{
+		return level >= log_threshold;
+	}
 	void set_use_ansi_color(bool enabled);
+
+	// Hand messages to per-thread buffers that a background thread writes out, instead of
+	// writing them on the calling thread. Errors are still written out immediately.
+	void log_async_start();
+	void log_async_stop();
+	void log_flush();
 	
 	
 	inline bool show_line(LogType lt)
@@ -30,9 +42,9 @@ namespace putki
 }
 
 #define BUILD_LOG(target, type, stmt) { \
-	putki::sstream __DPRINT_LINE; \
 	if (putki::check_filter(type)) \
 	{ \
+		putki::sstream __DPRINT_LINE; \
 		if (putki::show_line(type)) \
 			__DPRINT_LINE << __FILE__ << " (" << __LINE__ << "): "; \
 		__DPRINT_LINE << stmt; \
@@ -14,6 +14,7 @@ extern "C"
 
 #include <set>
 #include <map>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -41,6 +42,7 @@ namespace putki
 			unsigned int ofs_begin;
 			unsigned int ofs_end;
 			std::string bytes_signature;
+			bool pooled_strings;
 			build_db::record *r;
 		};
 		
@@ -57,6 +59,8 @@ namespace putki
 			std::string file;
 			std::string path;
 			int begin, end;
+			bool pooled_strings;
+			bool remapped;
 			std::vector<int> deps;
 		};
 		
@@ -87,6 +91,14 @@ namespace putki
 			previous_t previous;
 			std::vector<preliminary> list;
 			std::vector<use_previous> previous2use;
+			bool string_pool;
+			bool slot_aliases;
+			access_profile *profile;
+		};
+
+		struct access_profile
+		{
+			std::map<std::string, int> rank;
 		};
 		
 		void compute_previous_slot_mapping(data *target, use_previous *out)
@@ -183,6 +195,8 @@ namespace putki
 				else if (line[0] == '#')
 				{
 					manifest_slot tmp;
+					tmp.pooled_strings = false;
+					tmp.remapped = false;
 					
 					size_t split = line.find_first_of(':');
 					std::string slotnum = line.substr(1, split - 1);
@@ -195,13 +209,14 @@ namespace putki
 					slot = &pkg->slots.back();
 					
 					line.erase(0, split + 1);
-					for (int i=0;i<6;i++)
+					for (int i=0;i<7;i++)
 					{
 						split = line.find_first_of(':');
 						std::string value;
 						if (split == std::string::npos)
 						{
 							value = line;
+							line.clear();
 						}
 						else
 						{
@@ -233,7 +248,15 @@ namespace putki
 							case 5:
 								slot->end = atoi(value.c_str());
 								break;
+							case 6:
+								// strings in another package's pool, or pointers that need the remap
+								// table of a compacted package; neither is loadable from here.
+								slot->pooled_strings = (value == "pool");
+								slot->remapped = (value == "remap");
+								break;
 						}
+						if (line.empty())
+							break;
 					}
 				}
 			}
@@ -315,6 +338,9 @@ namespace putki
 		{
 			data *d = new data;
 			d->source = db;
+			d->string_pool = false;
+			d->slot_aliases = false;
+			d->profile = 0;
 			return d;
 		}
 
@@ -322,7 +348,69 @@ namespace putki
 		{
 			delete package;
 		}
+
+		void set_string_pool(data *package, bool enabled)
+		{
+			package->string_pool = enabled;
+		}
+
+		void set_slot_aliases(data *package, bool enabled)
+		{
+			package->slot_aliases = enabled;
+		}
 		
+		access_profile * load_access_profile(const char *file)
+		{
+			tok::data *tk = tok::load(file);
+			if (!tk)
+			{
+				APP_WARNING("Could not load access profile " << file)
+				return 0;
+			}
+
+			tok::tokenize_newlines(tk);
+
+			access_profile *profile = new access_profile();
+			for (unsigned int i=0;;i++)
+			{
+				const char *ln = tok::get(tk, i);
+				if (!ln)
+					break;
+				if (ln[0] && !profile->rank.count(ln))
+				{
+					const int rank = (int)profile->rank.size();
+					profile->rank[ln] = rank;
+				}
+			}
+
+			tok::free(tk);
+			APP_DEBUG("Loaded access profile " << file << " with " << profile->rank.size() << " slots")
+			return profile;
+		}
+
+		void free_access_profile(access_profile *profile)
+		{
+			delete profile;
+		}
+
+		void set_access_profile(data *package, access_profile *profile)
+		{
+			package->profile = profile;
+		}
+
+		struct access_rank_order
+		{
+			access_profile *profile;
+			bool operator()(const entry *a, const entry *b) const
+			{
+				std::map<std::string, int>::const_iterator ra = profile->rank.find(a->path);
+				std::map<std::string, int>::const_iterator rb = profile->rank.find(b->path);
+				if (rb == profile->rank.end())
+					return ra != profile->rank.end();
+				return ra != profile->rank.end() && ra->second < rb->second;
+			}
+		};
+
 		bool pick_from_previous(package::data *data, const char *path, const char *type, const char *signature, entry *fill)
 		{
 			previous_t::iterator p = data->previous.begin();
@@ -340,7 +428,7 @@ namespace putki
 				manifest_slot *slot = &p->second.slots[m->second];
 				
 				// not matching always on type, when aux & sig match then manifest contains the type.
-				if ((type && strcmp(slot->type.c_str(), type)) || strcmp(slot->signature.c_str(), signature))
+				if ((type && strcmp(slot->type.c_str(), type)) || strcmp(slot->signature.c_str(), signature) || slot->pooled_strings || slot->remapped)
 				{
 					p++;
 					continue;
@@ -372,6 +460,7 @@ namespace putki
 				
 				fill->ofs_begin = slot->begin;
 				fill->ofs_end = slot->end;
+				fill->pooled_strings = false;
 				fill->th = typereg_get_handler(slot->type.c_str());
 				
 				APP_DEBUG("Found match in " << p->first << " in slot " << m->second << " for [" << path << "]")
@@ -536,6 +625,7 @@ namespace putki
 				e.path = addpath;
 				e.ofs_begin = 0;
 				e.ofs_end = 0;
+				e.pooled_strings = false;
 				e.file_index = e.file_slot_index = -1;
 			
 				if (!db::fetch(data->source, addpath, &e.th, &e.obj))
@@ -565,7 +655,7 @@ namespace putki
 				}
 
 				// run the walk_dependencies fn always to make sure pointers are resolved.
-				data->blobs[addpath].th->walk_dependencies(data->blobs[addpath].obj, &dw, true);
+				putki::walk_dependencies(data->blobs[addpath].th, data->blobs[addpath].obj, &dw, true);
 
 				if (scandep)
 				{
@@ -679,6 +769,22 @@ namespace putki
 				++i;
 			}
 
+			// profiled slots go first, in first touch order; the rest keep their order after them.
+			unsigned int hot_slots = 0;
+			if (data->profile)
+			{
+				access_rank_order order;
+				order.profile = data->profile;
+				std::stable_sort(packlist.begin(), packlist.end(), order);
+				for (unsigned int k=0;k!=packlist.size();k++)
+				{
+					packorder[packlist[k]->path] = k;
+					packlist[k]->pack_slot_index = k;
+					if (data->profile->rank.count(packlist[k]->path))
+						hot_slots = k + 1;
+				}
+			}
+
 			data->list.clear();
 			
 			// Go through all the pointers in the object, writing slot indices (as +1 though as 0=0)
@@ -695,7 +801,7 @@ namespace putki
 			for (unsigned int i = 0;i < packlist.size();i++)
 			{
 				if (packlist[i]->file_slot_index == -1)
-					packlist[i]->th->walk_dependencies(packlist[i]->obj, &pp, true, true);
+					putki::walk_dependencies(packlist[i]->th, packlist[i]->obj, &pp, true, true);
 			}
 			
 			int written = 0;
@@ -709,16 +815,16 @@ namespace putki
 					continue;
 				}
 				
-				short write = 0;
+				unsigned int write = 0;
 				if (!packorder.count(path))
 				{
 					for (unsigned int i = 0;i < unpacked.size();i++)
 						if (unpacked[i] == path)
-							write = (short)(packlist.size() + i + 1);
+							write = (unsigned int)(packlist.size() + i + 1);
 
 					if (!write)
 					{
-						write = (short)(packlist.size() + unpacked.size() + 1);
+						write = (unsigned int)(packlist.size() + unpacked.size() + 1);
 						unpacked.push_back(path);
 					}
 				}
@@ -727,14 +833,22 @@ namespace putki
 					write = 1 + packorder[path];
 				}
 
-				// clear whole field.
-				*(pp.ptrs[i].ptr) = 0;
-				*((short*)pp.ptrs[i].ptr) = write;
+				// the generated writers pack the pointer value as an integer of the platform pointer size.
+				*(pp.ptrs[i].ptr) = (instance_t)(size_t)write;
 
 				++written;
 			}
 		
 			APP_DEBUG("In pack list: " << packlist.size() << ", unresolved:" << unpacked.size())
+
+			const size_t max_slots = rt->ptr_size < 4 ? 0xffff : 0x7fffffff;
+			if (packlist.size() + unpacked.size() > max_slots)
+			{
+				APP_ERROR("Package has " << (packlist.size() + unpacked.size()) << " slots but " << runtime::desc_str(rt) << " pointers can only index " << max_slots)
+				for (unsigned int i = 0;i < pp.ptrs.size();i++)
+					*(pp.ptrs[i].ptr) = pp.ptrs[i].value;
+				return -1;
+			}
 			
 			// --- Write package information
 			char *ptr = buffer;
@@ -742,17 +856,30 @@ namespace putki
 
 			// PTKP
 			const unsigned int header = 0x504B5450;
-			const unsigned int flags = 0x0;
+			const unsigned int PKG_HDR_STRING_POOL  = 1;
+			const unsigned int PKG_HDR_SLOT_ALIASES = 2;
+			// format version lives in the upper 16 bits of the flags; version 1 has 32 bit slot and import indices.
+			const unsigned int PKG_FORMAT_VERSION   = 1;
+			unsigned int hdr_flags = (PKG_FORMAT_VERSION << 16) | (data->string_pool ? PKG_HDR_STRING_POOL : 0);
 			
 			ptr = pack_int32_field(ptr, header);
-			ptr = pack_int32_field(ptr, flags);
+			char *hdr_flags_pos = ptr;
+			ptr = pack_int32_field(ptr, hdr_flags);
 			
 			char *header_size_pos = ptr;
 			ptr = pack_int32_field(ptr, 0); // size of header
 			ptr = pack_int32_field(ptr, 0); // size of all data
+
+			// string pool begin & end, filled in when the slots are written.
+			char *pool_pos = ptr;
+			if (data->string_pool)
+			{
+				ptr = pack_int32_field(ptr, 0);
+				ptr = pack_int32_field(ptr, 0);
+			}
 			
 			// File import list
-			ptr = pack_int16_field(ptr, (short)data->previous2use.size());
+			ptr = pack_int32_field(ptr, (int)data->previous2use.size());
 			for (int i=0;i!=data->previous2use.size();i++)
 			{
 				use_previous *use = &data->previous2use[i];
@@ -763,7 +890,7 @@ namespace putki
 				const char *name = prev->file.c_str();
 				const size_t len = prev->file.size() + 1;
 				ptr = pack_int16_field(ptr, (short)len);
-				ptr = pack_int16_field(ptr, (short)use->slot_remapping.size());
+				ptr = pack_int32_field(ptr, (int)use->slot_remapping.size());
 				
 				memcpy(ptr, name, len);
 				ptr += len;
@@ -771,8 +898,8 @@ namespace putki
 				std::map<int, int>::iterator j = use->slot_remapping.begin();
 				while (j != use->slot_remapping.end())
 				{
-					ptr = pack_int16_field(ptr, (short)j->first);
-					ptr = pack_int16_field(ptr, (short)j->second);
+					ptr = pack_int32_field(ptr, j->first);
+					ptr = pack_int32_field(ptr, j->second);
 					j++;
 				}
 			}
@@ -780,16 +907,19 @@ namespace putki
 			APP_DEBUG("File import list: " << (ptr - buffer) << " bytes.")
 			
 			std::vector<char*> filepospos;
+			std::vector<char*> flagspos;
+			std::vector<unsigned short> slotflags;
+
+			const int PKG_FLAG_PATH       = 1;
+			const int PKG_FLAG_EXTERNAL   = 2;
+			const int PKG_FLAG_INTERNAL   = 4;
+			const int PKG_FLAG_UNRESOLVED = 8;
+			const int PKG_FLAG_ALIAS      = 16;
 
 			// Now comes slot list, we add both packed & unpacked.
-			ptr = pack_int16_field(ptr, packlist.size() + unpacked.size());
+			ptr = pack_int32_field(ptr, (int)(packlist.size() + unpacked.size()));
 			for (unsigned int i=0;i!=(packlist.size() + unpacked.size());i++)
 			{
-				const int PKG_FLAG_PATH       = 1;
-				const int PKG_FLAG_EXTERNAL   = 2;
-				const int PKG_FLAG_INTERNAL   = 4;
-				const int PKG_FLAG_UNRESOLVED = 8;
-				
 				const char *path;
 				unsigned short flags = 0;
 				
@@ -812,6 +942,8 @@ namespace putki
 				}
 				
 				// path if wanted.
+				flagspos.push_back(ptr);
+				slotflags.push_back(flags);
 				ptr = pack_int16_field(ptr, flags);
 				if (flags & PKG_FLAG_PATH)
 				{
@@ -824,8 +956,8 @@ namespace putki
 				if (flags & PKG_FLAG_EXTERNAL)
 				{
 					filepospos.push_back(0);
-					ptr = pack_int16_field(ptr, packlist[i]->file_index);
-					ptr = pack_int16_field(ptr, packlist[i]->file_slot_index);
+					ptr = pack_int32_field(ptr, packlist[i]->file_index);
+					ptr = pack_int32_field(ptr, packlist[i]->file_slot_index);
 					ptr = pack_int16_field(ptr, packlist[i]->th->id());
 					ptr = pack_int32_field(ptr, packlist[i]->ofs_begin);
 					ptr = pack_int32_field(ptr, packlist[i]->ofs_end);
@@ -844,14 +976,26 @@ namespace putki
 			header_size_pos = pack_int32_field(header_size_pos, ptr - buffer);
 		
 			int total_loaded_data_size = 0;
+
+			string_pool *pool = data->string_pool ? string_pool_create() : 0;
+			string_pool_bind(pool);
+
+			// byte identical slots of the same type share one copy, if asked for.
+			std::map<std::string, int> written_slots;
+
+			int hot_bytes = 0;
 			
 			// Write actual slot content
 			for (unsigned int i = 0;i < packlist.size();i++)
 			{
+				if (i == hot_slots)
+					hot_bytes = total_loaded_data_size;
+
 				char *start = ptr;
 				
 				if (packlist[i]->file_slot_index == -1)
 				{
+					const unsigned int refs_before = pool ? string_pool_refs(pool) : 0;
 					ptr = packlist[i]->th->write_into_buffer(rt, packlist[i]->obj, ptr, end);
 					if (!ptr)
 					{
@@ -859,20 +1003,60 @@ namespace putki
 						APP_WARNING("  - Buffer could be too small (" << available << " bytes)")
 						APP_WARNING("  - Writer could fail because output platform not recognized")
 						APP_WARNING("Attempted to write_into_buffer on " << packlist[i]->th->name())
-						APP_ERROR("HELP")
-						packlist[i]->ofs_begin = 0;
-						packlist[i]->ofs_end = 0;
-						continue;
+						APP_ERROR("Failed to write [" << packlist[i]->path << "] into the package")
+						string_pool_bind(0);
+						if (pool)
+							string_pool_free(pool);
+						for (unsigned int k = 0;k < pp.ptrs.size();k++)
+							*(pp.ptrs[k].ptr) = pp.ptrs[k].value;
+						return -1;
 					}
-					
-					packlist[i]->ofs_begin = start - buffer;
-					packlist[i]->ofs_end = ptr - buffer;
-					
+
+					packlist[i]->pooled_strings = pool && string_pool_refs(pool) != refs_before;
+
+					char signature[64];
+					char signature_string[64];
+					md5_buffer(start, (long)(ptr - start), signature);
+					md5_sig_to_string(signature, signature_string, 64);
+					packlist[i]->bytes_signature = signature_string;
+
+					bool alias = false;
+					if (data->slot_aliases)
+					{
+						sstream key;
+						key << packlist[i]->th->id() << ":" << signature_string;
+						std::map<std::string, int>::iterator same = written_slots.find(key.c_str());
+						if (same != written_slots.end())
+						{
+							entry *org = packlist[same->second];
+							if (org->ofs_end - org->ofs_begin == (unsigned int)(ptr - start) && !memcmp(buffer + org->ofs_begin, start, ptr - start))
+							{
+								alias = true;
+								ptr = start;
+								packlist[i]->ofs_begin = org->ofs_begin;
+								packlist[i]->ofs_end = org->ofs_end;
+								packlist[i]->pooled_strings = org->pooled_strings;
+								pack_int16_field(flagspos[i], slotflags[i] | PKG_FLAG_ALIAS);
+								hdr_flags |= PKG_HDR_SLOT_ALIASES;
+							}
+						}
+						else
+						{
+							written_slots.insert(std::make_pair(std::string(key.c_str()), (int)i));
+						}
+					}
+
+					if (!alias)
+					{
+						packlist[i]->ofs_begin = start - buffer;
+						packlist[i]->ofs_end = ptr - buffer;
+						total_loaded_data_size += ptr - start;
+					}
+
 					// fill in with start & end offsets in this file.
 					char *tmp_ptr = filepospos[i];
-					tmp_ptr = pack_int32_field(tmp_ptr, start - buffer);
-					tmp_ptr = pack_int32_field(tmp_ptr, ptr - buffer);
-					total_loaded_data_size += ptr - start;
+					tmp_ptr = pack_int32_field(tmp_ptr, packlist[i]->ofs_begin);
+					tmp_ptr = pack_int32_field(tmp_ptr, packlist[i]->ofs_end);
 				}
 				else
 				{
@@ -907,7 +1091,10 @@ namespace putki
 				else
 					manifest << data->previous2use[packlist[i]->file_index].previous->file;
 					
-				manifest << ":" << packlist[i]->ofs_begin << ":" << packlist[i]->ofs_end << "\n";
+				manifest << ":" << packlist[i]->ofs_begin << ":" << packlist[i]->ofs_end;
+				if (packlist[i]->pooled_strings)
+					manifest << ":pool";
+				manifest << "\n";
 					   
 				int p = 0;
 				while (r)
@@ -933,6 +1120,38 @@ namespace putki
 				}
 			}
 			
+			if (data->profile)
+			{
+				if (hot_slots == packlist.size())
+					hot_bytes = total_loaded_data_size;
+				APP_DEBUG("Access profile put " << hot_slots << " of " << packlist.size() << " slots in a hot region of " << hot_bytes << " bytes")
+			}
+
+			string_pool_bind(0);
+			if (pool)
+			{
+				const unsigned int pool_size = string_pool_size(pool);
+				if ((unsigned long)(end - ptr) < pool_size)
+				{
+					// the slots already point into the pool, so there is no package without it.
+					APP_ERROR("Buffer too small for string pool of " << pool_size << " bytes")
+					string_pool_free(pool);
+					for (unsigned int i = 0;i < pp.ptrs.size();i++)
+						*(pp.ptrs[i].ptr) = pp.ptrs[i].value;
+					return -1;
+				}
+
+				memcpy(ptr, string_pool_data(pool), pool_size);
+				pool_pos = pack_int32_field(pool_pos, ptr - buffer);
+				ptr += pool_size;
+				pack_int32_field(pool_pos, ptr - buffer);
+				total_loaded_data_size += pool_size;
+				APP_DEBUG("String pool is " << pool_size << " bytes for " << string_pool_refs(pool) << " strings")
+				string_pool_free(pool);
+			}
+
+			pack_int32_field(hdr_flags_pos, hdr_flags);
+
 			// compute total size
 			pack_int32_field(header_size_pos, total_loaded_data_size);
 
@@ -944,5 +1163,476 @@ namespace putki
 
 			return ptr - buffer;
 		}
+
+		// --- patch chain compaction
+
+		struct source_file
+		{
+			std::string name;
+			std::vector<char> bytes;
+			bool loaded;
+		};
+
+		struct source_slot
+		{
+			unsigned short flags;
+			int type_id;
+			std::string path;
+			int file;         // -1 is the package itself, otherwise import index
+			int file_slot;
+			int remap_import; // remapped internal slot of an already compacted package
+			unsigned int begin, end;
+		};
+
+		struct source_import
+		{
+			std::string name;
+			std::vector<std::pair<int, int> > remaps;
+		};
+
+		static bool read_file(const std::string &path, std::vector<char> *out)
+		{
+			std::ifstream in(path.c_str(), std::ios::binary);
+			if (!in.good())
+				return false;
+			in.seekg(0, std::ios::end);
+			std::streamoff size = in.tellg();
+			in.seekg(0, std::ios::beg);
+			out->resize((size_t)size);
+			if (size > 0)
+				in.read(&(*out)[0], size);
+			return in.gcount() == size;
+		}
+
+		struct reader
+		{
+			const unsigned char *p, *end;
+			bool ok;
+
+			unsigned int u16()
+			{
+				if (end - p < 2) { ok = false; return 0; }
+				unsigned int v = p[0] | (p[1] << 8);
+				p += 2;
+				return v;
+			}
+
+			unsigned int u32()
+			{
+				if (end - p < 4) { ok = false; return 0; }
+				unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+				p += 4;
+				return v;
+			}
+
+			int index(bool wide)
+			{
+				return wide ? (int)u32() : (short)u16();
+			}
+		};
+
+		static void put16(std::vector<char> &out, unsigned int v)
+		{
+			char tmp[2];
+			pack_int16_field(tmp, (short)v);
+			out.insert(out.end(), tmp, tmp + 2);
+		}
+
+		static void put32(std::vector<char> &out, unsigned int v)
+		{
+			char tmp[4];
+			pack_int32_field(tmp, (int)v);
+			out.insert(out.end(), tmp, tmp + 4);
+		}
+
+		static void patch32(std::vector<char> &out, size_t pos, unsigned int v)
+		{
+			pack_int32_field(&out[pos], (int)v);
+		}
+
+		// pointer slot deps per slot, as listed in the manifest of the package owning the bytes.
+		// unknown ('?') deps are -1.
+		static void read_manifest_deps(const std::string &manifest, std::vector< std::vector<int> > *out)
+		{
+			tok::data *mf = tok::load(manifest.c_str());
+			if (!mf)
+				return;
+			tok::tokenize_newlines(mf);
+			for (unsigned int i=0;;i++)
+			{
+				const char *ln = tok::get(mf, i);
+				if (!ln)
+					break;
+				if (ln[0] == '#')
+					out->push_back(std::vector<int>());
+				else if (ln[0] == 'p' && ln[1] == ':' && !out->empty())
+					out->back().push_back(ln[2] == '?' ? -1 : atoi(ln + 2));
+			}
+			tok::free(mf);
+		}
+
+		bool compact(const char *basepath, const char *path, const char *out_path)
+		{
+			const std::string base = std::string(basepath) + "/";
+			const unsigned int PKG_HDR_STRING_POOL  = 1;
+			const unsigned int PKG_HDR_SLOT_ALIASES = 2;
+			const unsigned int PKG_FORMAT_VERSION   = 1;
+			const int PKG_FLAG_PATH       = 1;
+			const int PKG_FLAG_EXTERNAL   = 2;
+			const int PKG_FLAG_INTERNAL   = 4;
+			const int PKG_FLAG_ALIAS      = 16;
+			const int PKG_FLAG_REMAPPED   = 32;
+
+			source_file self;
+			self.name = path;
+			if (!read_file(base + path, &self.bytes) || self.bytes.size() < 16)
+			{
+				APP_ERROR("Could not read package " << path << " for compaction")
+				return false;
+			}
+
+			reader rd;
+			rd.p = (const unsigned char *) &self.bytes[0];
+			rd.end = rd.p + self.bytes.size();
+			rd.ok = true;
+
+			if (rd.u32() != 0x504B5450)
+			{
+				APP_ERROR(path << " is not a package")
+				return false;
+			}
+
+			const unsigned int src_flags = rd.u32();
+			const bool wide = (src_flags >> 16) >= 1;
+			if ((src_flags >> 16) > PKG_FORMAT_VERSION)
+			{
+				APP_ERROR(path << " has unsupported format version " << (src_flags >> 16))
+				return false;
+			}
+
+			rd.u32(); // header size
+			rd.u32(); // data size
+
+			unsigned int pool_begin = 0, pool_end = 0;
+			if (src_flags & PKG_HDR_STRING_POOL)
+			{
+				pool_begin = rd.u32();
+				pool_end = rd.u32();
+			}
+
+			std::vector<source_import> imports(rd.index(wide));
+			for (unsigned int i=0;rd.ok && i<imports.size();i++)
+			{
+				unsigned int name_length = rd.u16();
+				unsigned int remaps = wide ? rd.u32() : rd.u16();
+				if ((unsigned int)(rd.end - rd.p) < name_length)
+				{
+					rd.ok = false;
+					break;
+				}
+				imports[i].name = (const char *) rd.p;
+				rd.p += name_length;
+				for (unsigned int j=0;rd.ok && j<remaps;j++)
+				{
+					int from = rd.index(wide);
+					int to = rd.index(wide);
+					imports[i].remaps.push_back(std::make_pair(from, to));
+				}
+			}
+
+			std::vector<source_slot> slots(rd.ok ? (wide ? rd.u32() : rd.u16()) : 0);
+			for (unsigned int i=0;rd.ok && i<slots.size();i++)
+			{
+				source_slot &s = slots[i];
+				s.flags = (unsigned short) rd.u16();
+				s.file = s.file_slot = s.remap_import = -1;
+				s.begin = s.end = 0;
+				s.type_id = 0;
+				if (s.flags & PKG_FLAG_PATH)
+				{
+					unsigned int len = rd.u16();
+					if ((unsigned int)(rd.end - rd.p) < len)
+					{
+						rd.ok = false;
+						break;
+					}
+					s.path = (const char *) rd.p;
+					rd.p += len;
+				}
+				if (s.flags & PKG_FLAG_EXTERNAL)
+				{
+					s.file = rd.index(wide);
+					s.file_slot = rd.index(wide);
+					s.type_id = rd.u16();
+					s.begin = rd.u32();
+					s.end = rd.u32();
+				}
+				else if (s.flags & PKG_FLAG_INTERNAL)
+				{
+					s.begin = rd.u32();
+					s.end = rd.u32();
+					s.type_id = rd.u16();
+					if (s.flags & PKG_FLAG_REMAPPED)
+						s.remap_import = rd.index(wide);
+				}
+				if ((s.file >= (int)imports.size()) || (s.remap_import >= (int)imports.size()))
+					rd.ok = false;
+			}
+
+			if (!rd.ok)
+			{
+				APP_ERROR("Package " << path << " header is broken")
+				return false;
+			}
+
+			// load the files the external slots live in, and which of their slots point through remapped indices.
+			std::vector<source_file> files(imports.size());
+			std::vector< std::vector< std::vector<int> > > owner_deps(imports.size());
+			for (unsigned int i=0;i!=slots.size();i++)
+			{
+				if (slots[i].file < 0 || files[slots[i].file].loaded)
+					continue;
+
+				source_file &f = files[slots[i].file];
+				f.name = imports[slots[i].file].name;
+				if (!read_file(base + f.name, &f.bytes))
+				{
+					APP_ERROR("Could not read " << f.name << " which " << path << " imports from")
+					return false;
+				}
+				read_manifest_deps(base + f.name + ".manifest", &owner_deps[slots[i].file]);
+				f.loaded = true;
+			}
+
+			// new import table only keeps the remap tables that are still needed.
+			std::vector<int> new_import(imports.size(), -1);
+			std::vector<int> slot_import(slots.size(), -1);
+			std::vector<int> kept_imports;
+			for (unsigned int i=0;i!=slots.size();i++)
+			{
+				int imp = slots[i].file >= 0 ? slots[i].file : slots[i].remap_import;
+				if (imp < 0 || imports[imp].remaps.empty())
+					continue;
+
+				bool needs_remap = true;
+				if (slots[i].file >= 0 && slots[i].file_slot >= 0 && slots[i].file_slot < (int)owner_deps[imp].size())
+				{
+					needs_remap = false;
+					const std::vector<int> &deps = owner_deps[imp][slots[i].file_slot];
+					for (unsigned int d=0;d!=deps.size() && !needs_remap;d++)
+					{
+						if (deps[d] < 0)
+							needs_remap = true;
+						for (unsigned int r=0;r!=imports[imp].remaps.size() && !needs_remap;r++)
+							needs_remap = imports[imp].remaps[r].first == deps[d];
+					}
+				}
+
+				if (!needs_remap)
+					continue;
+
+				if (new_import[imp] < 0)
+				{
+					new_import[imp] = (int) kept_imports.size();
+					kept_imports.push_back(imp);
+				}
+				slot_import[i] = new_import[imp];
+			}
+
+			// data section; slots sharing bytes in the same file share them in the output too.
+			std::vector<char> out_data;
+			std::map<std::pair<int, unsigned int>, unsigned int> copied;
+			std::vector<unsigned int> new_begin(slots.size(), 0), new_end(slots.size(), 0);
+			std::vector<bool> alias(slots.size(), false);
+			for (unsigned int i=0;i!=slots.size();i++)
+			{
+				const source_slot &s = slots[i];
+				if (!(s.flags & (PKG_FLAG_EXTERNAL | PKG_FLAG_INTERNAL)))
+					continue;
+
+				const std::vector<char> &src = s.file >= 0 ? files[s.file].bytes : self.bytes;
+				if (s.end < s.begin || s.end > src.size())
+				{
+					APP_ERROR("Slot " << i << " [" << s.path << "] is outside its file")
+					return false;
+				}
+
+				std::pair<int, unsigned int> key(s.file, s.begin);
+				std::map<std::pair<int, unsigned int>, unsigned int>::iterator c = copied.find(key);
+				if (c != copied.end())
+				{
+					alias[i] = true;
+					new_begin[i] = c->second;
+				}
+				else
+				{
+					new_begin[i] = (unsigned int) out_data.size();
+					copied.insert(std::make_pair(key, new_begin[i]));
+					if (s.end > s.begin)
+						out_data.insert(out_data.end(), &src[0] + s.begin, &src[0] + s.end);
+				}
+				new_end[i] = new_begin[i] + (s.end - s.begin);
+			}
+
+			const bool has_pool = (src_flags & PKG_HDR_STRING_POOL) != 0;
+			unsigned int new_pool_begin = 0, new_pool_end = 0;
+			if (has_pool)
+			{
+				if (pool_end < pool_begin || pool_end > self.bytes.size())
+				{
+					APP_ERROR("String pool of " << path << " is outside the file")
+					return false;
+				}
+				new_pool_begin = (unsigned int) out_data.size();
+				if (pool_end > pool_begin)
+					out_data.insert(out_data.end(), &self.bytes[0] + pool_begin, &self.bytes[0] + pool_end);
+				new_pool_end = (unsigned int) out_data.size();
+			}
+
+			bool any_alias = false;
+			for (unsigned int i=0;i!=alias.size();i++)
+				any_alias = any_alias || alias[i];
+
+			// header; data offsets are patched once its size is known.
+			std::vector<char> hdr;
+			std::vector<std::pair<size_t, unsigned int> > offsets;
+			put32(hdr, 0x504B5450);
+			put32(hdr, (PKG_FORMAT_VERSION << 16) | (has_pool ? PKG_HDR_STRING_POOL : 0) | (any_alias ? PKG_HDR_SLOT_ALIASES : 0));
+			const size_t hdr_size_pos = hdr.size();
+			put32(hdr, 0);
+			put32(hdr, (unsigned int) out_data.size());
+			if (has_pool)
+			{
+				offsets.push_back(std::make_pair(hdr.size(), new_pool_begin));
+				put32(hdr, 0);
+				offsets.push_back(std::make_pair(hdr.size(), new_pool_end));
+				put32(hdr, 0);
+			}
+
+			put32(hdr, (unsigned int) kept_imports.size());
+			for (unsigned int i=0;i!=kept_imports.size();i++)
+			{
+				const source_import &imp = imports[kept_imports[i]];
+				put16(hdr, (unsigned int) imp.name.size() + 1);
+				put32(hdr, (unsigned int) imp.remaps.size());
+				hdr.insert(hdr.end(), imp.name.c_str(), imp.name.c_str() + imp.name.size() + 1);
+				for (unsigned int j=0;j!=imp.remaps.size();j++)
+				{
+					put32(hdr, imp.remaps[j].first);
+					put32(hdr, imp.remaps[j].second);
+				}
+			}
+
+			put32(hdr, (unsigned int) slots.size());
+			for (unsigned int i=0;i!=slots.size();i++)
+			{
+				const source_slot &s = slots[i];
+				unsigned short flags = s.flags & PKG_FLAG_PATH;
+				if (s.flags & (PKG_FLAG_EXTERNAL | PKG_FLAG_INTERNAL))
+				{
+					flags |= PKG_FLAG_INTERNAL;
+					if (alias[i])
+						flags |= PKG_FLAG_ALIAS;
+					if (slot_import[i] >= 0)
+						flags |= PKG_FLAG_REMAPPED;
+				}
+				else
+				{
+					flags = s.flags;
+				}
+
+				put16(hdr, flags);
+				if (flags & PKG_FLAG_PATH)
+				{
+					put16(hdr, (unsigned int) s.path.size() + 1);
+					hdr.insert(hdr.end(), s.path.c_str(), s.path.c_str() + s.path.size() + 1);
+				}
+				if (flags & PKG_FLAG_INTERNAL)
+				{
+					offsets.push_back(std::make_pair(hdr.size(), new_begin[i]));
+					put32(hdr, 0);
+					offsets.push_back(std::make_pair(hdr.size(), new_end[i]));
+					put32(hdr, 0);
+					put16(hdr, s.type_id);
+					if (flags & PKG_FLAG_REMAPPED)
+						put32(hdr, slot_import[i]);
+				}
+			}
+
+			const unsigned int hdr_size = (unsigned int) hdr.size();
+			patch32(hdr, hdr_size_pos, hdr_size);
+			for (unsigned int i=0;i!=offsets.size();i++)
+				patch32(hdr, offsets[i].first, hdr_size + offsets[i].second);
+
+			// manifest keeps the slot numbering; every slot now lives in the output file.
+			sstream manifest;
+			tok::data *mf = tok::load((base + path + ".manifest").c_str());
+			if (!mf)
+			{
+				APP_ERROR("Could not read manifest for " << path)
+				return false;
+			}
+			tok::tokenize_newlines(mf);
+			for (unsigned int i=0;;i++)
+			{
+				const char *ln = tok::get(mf, i);
+				if (!ln)
+					break;
+
+				std::string line(ln);
+				if (line.empty() || line[0] != '#')
+				{
+					manifest << line << "\n";
+					continue;
+				}
+
+				// #slot:type:path:signature:file:begin:end[:extra]
+				std::vector<std::string> fields;
+				size_t pos = 0;
+				while (true)
+				{
+					size_t split = line.find_first_of(':', pos);
+					fields.push_back(line.substr(pos, split == std::string::npos ? std::string::npos : split - pos));
+					if (split == std::string::npos)
+						break;
+					pos = split + 1;
+				}
+
+				int slot = atoi(line.c_str() + 1);
+				if (fields.size() < 7 || slot < 0 || slot >= (int)slots.size())
+				{
+					APP_WARNING("Skipping malformed manifest line " << line)
+					continue;
+				}
+
+				std::string extra = fields.size() > 7 ? fields[7] : "";
+				if (slot_import[slot] >= 0)
+					extra = "remap";
+
+				manifest << fields[0] << ":" << fields[1] << ":" << fields[2] << ":" << fields[3] << ":!self:";
+				manifest << (hdr_size + new_begin[slot]) << ":" << (hdr_size + new_end[slot]);
+				if (!extra.empty())
+					manifest << ":" << extra.c_str();
+				manifest << "\n";
+			}
+			tok::free(mf);
+
+			std::vector<char> out(hdr);
+			out.insert(out.end(), out_data.begin(), out_data.end());
+
+			std::string out_file = base + out_path;
+			std::ofstream pkg(out_file.c_str(), std::ios::binary);
+			if (!out.empty())
+				pkg.write(&out[0], out.size());
+			pkg.close();
+
+			std::string out_manifest = out_file + ".manifest";
+			std::ofstream pkg_mf(out_manifest.c_str(), std::ios::binary);
+			pkg_mf.write(manifest.c_str(), manifest.size());
+			pkg_mf.close();
+
+			APP_INFO("Compacted " << path << " (" << imports.size() << " imported files) into " << out_path << " with " << slots.size() << " slots, " << kept_imports.size() << " remap tables, " << out.size() << " bytes")
+			return pkg.good() && pkg_mf.good();
+		}
 	}
 }
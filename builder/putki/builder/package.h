@@ -15,12 +15,38 @@ namespace putki
 		data * create(db::data *db);
 		void free(data *);
 
+		// store strings once in a package wide table instead of after every struct. slots written
+		// this way are not reused by patches built on top of the package.
+		void set_string_pool(data *, bool enabled);
+
+		// let byte identical slots of the same type share one copy. the runtime then has one object
+		// for all their paths, so path lookups and liveupdate only know one of them. off by default,
+		// keep it off for data that is liveupdated.
+		void set_slot_aliases(data *, bool enabled);
+
+		// first touch order of slots as recorded by the runtime (pkgmgr::write_access_profile),
+		// one path per line.
+		struct access_profile;
+		access_profile * load_access_profile(const char *file);
+		void free_access_profile(access_profile *);
+
+		// lay out the slots in the profile first, in the order they were touched, followed by the
+		// rest. the hot data then sits in one region at the start of the data section, away from
+		// the cold data.
+		void set_access_profile(data *, access_profile *profile);
+
 		// need storepath = true to be able to look it up from the package in runtime.
 		void add(package::data *data, const char *path, bool storepath);
 		const char *get_needed_asset(data *d, unsigned int i);
 		
 		void add_previous_package(package::data *data, const char *basepath, const char *path);
 		
+		// returns the number of bytes written, or -1 if no valid package could be written.
 		long write(data *data, runtime::descptr rt, char *buffer, long available, build_db::data *build_db, sstream & manifest);
+
+		// rewrites the patch chain ending in 'path' into the single package 'out_path' (both relative
+		// to basepath) by copying slot bytes out of the files it imports from. nothing is rebuilt and
+		// the slot numbering is kept. the next patch is then built on top of the compacted package.
+		bool compact(const char *basepath, const char *path, const char *out_path);
 	}
 }
@@ -13,7 +13,7 @@
 #include <stack>
 #include <cstdio>
 #include <cstdlib>
-#include <unordered_map>
+#include <cstring>
 
 //#define PARSE_DEBUG(x) std::cout << x;
 #define PARSE_DEBUG(x) {}
@@ -29,7 +29,11 @@ namespace putki
 			const char *alloc;
 		};
 
-		typedef std::unordered_map<std::string, node*> objmap_t;
+		struct member
+		{
+			node *key;
+			node *value;
+		};
 
 		struct node
 		{
@@ -45,7 +49,7 @@ namespace putki
 			size_t length;
 			bool decoded;
 			
-			objmap_t object;
+			std::vector<member> object;
 			std::vector<node*> arr;
 			node *key;
 			int children_left;
@@ -69,12 +73,42 @@ namespace putki
 				return 0;
 			}
 			
-			objmap_t::iterator i = obj->object.find(field);
-			if (i != obj->object.end())
-				return i->second;
+			// scan backwards so later duplicates win, like the old map insert did.
+			size_t len = strlen(field);
+			for (size_t i=obj->object.size();i-->0;)
+			{
+				node *key = obj->object[i].key;
+				if (key->length == len && !memcmp(key->value, field, len))
+					return obj->object[i].value;
+			}
 
 			return 0;
 		}
+
+		size_t get_object_size(node *obj)
+		{
+			return obj ? obj->object.size() : 0;
+		}
+
+		node *get_object_key(node *obj, size_t i)
+		{
+			return obj->object[i].key;
+		}
+
+		node *get_object_value(node *obj, size_t i)
+		{
+			return obj->object[i].value;
+		}
+
+		unsigned int get_key_hash(node *key, unsigned int seed)
+		{
+			return key_hash(key->value, key->length, seed);
+		}
+
+		bool key_equals(node *key, const char *name, size_t length)
+		{
+			return key->length == length && !memcmp(key->value, name, length);
+		}
 		
 		inline unsigned int unhex(char c)
 		{
@@ -283,7 +317,10 @@ namespace putki
 						else
 						{
 							PARSE_DEBUG("  Completing value [" << top->key->value << "] = [" << current->value << "]" << std::endl);
-							top->object[top->key->value] = current;
+							member m;
+							m.key = top->key;
+							m.value = current;
+							top->object.push_back(m);
 							top->key = 0;
 						}
 					}
@@ -19,6 +19,26 @@ namespace putki
 
 		node *get_array_item(node *arr, size_t i);
 		node *get_object_item(node *obj, const char *field);
+
+		// member iteration in document order, used by the generated field dispatch.
+		size_t get_object_size(node *obj);
+		node *get_object_key(node *obj, size_t i);
+		node *get_object_value(node *obj, size_t i);
+		unsigned int get_key_hash(node *key, unsigned int seed);
+		bool key_equals(node *key, const char *name, size_t length);
+
+		// fnv-1a with a seed; the compiler computes the same hash for field names
+		// and picks a seed that makes them collision free within a struct.
+		inline unsigned int key_hash(const char *str, size_t length, unsigned int seed)
+		{
+			unsigned int h = 2166136261u ^ seed;
+			for (size_t i=0;i<length;i++)
+			{
+				h ^= (unsigned char) str[i];
+				h *= 16777619u;
+			}
+			return h;
+		}
 		const char *get_value_string(node *node);
 		int get_value_int(node *node);
 		float get_value_float(node *node);
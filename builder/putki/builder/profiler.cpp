@@ -0,0 +1,240 @@
+#include "profiler.h"
+
+#include <putki/builder/log.h>
+#include <putki/sys/thread.h>
+#include <putki/sys/clock.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+	#define PROFILER_TLS __declspec(thread)
+#else
+	#define PROFILER_TLS __thread
+#endif
+
+namespace putki
+{
+	namespace profiler
+	{
+		struct event
+		{
+			const char *category;
+			std::string name;
+			std::string object;
+			long long begin;
+			long long duration;
+		};
+
+		// Only ever appended to by the owning thread; read when the build is done.
+		struct thread_buffer
+		{
+			int tid;
+			std::vector<event> events;
+		};
+
+		namespace
+		{
+			bool s_enabled = false;
+			long long s_epoch = 0;
+
+			sys::mutex s_buffers_mtx;
+			std::vector<thread_buffer*> s_buffers;
+
+			PROFILER_TLS thread_buffer *t_buffer = 0;
+
+			thread_buffer *get_buffer()
+			{
+				if (!t_buffer)
+				{
+					thread_buffer *b = new thread_buffer();
+					b->events.reserve(4096);
+
+					sys::scoped_maybe_lock lk(&s_buffers_mtx);
+					b->tid = (int)s_buffers.size() + 1;
+					s_buffers.push_back(b);
+					t_buffer = b;
+				}
+				return t_buffer;
+			}
+
+			void write_escaped(std::ostream &out, const std::string &str)
+			{
+				for (std::string::size_type i=0;i!=str.size();i++)
+				{
+					const char c = str[i];
+					if (c == '"' || c == '\\')
+						out << '\\' << c;
+					else if ((unsigned char)c < 0x20)
+						out << ' ';
+					else
+						out << c;
+				}
+			}
+		}
+
+		void enable(bool enabled)
+		{
+			s_enabled = enabled;
+			if (enabled && !s_epoch)
+			{
+				s_epoch = sys::time_us();
+			}
+		}
+
+		bool enabled()
+		{
+			return s_enabled;
+		}
+
+		scope::scope(const char *category, const char *name, const char *object)
+		{
+			_category = category;
+			_name = name;
+			_object = object;
+			_begin = s_enabled ? sys::time_us() : 0;
+		}
+
+		scope::~scope()
+		{
+			if (!s_enabled || !_begin)
+			{
+				return;
+			}
+
+			thread_buffer *b = get_buffer();
+			b->events.push_back(event());
+
+			event &e = b->events.back();
+			e.category = _category;
+			e.name = _name ? _name : "";
+			if (_object)
+				e.object = _object;
+			e.begin = _begin - s_epoch;
+			e.duration = sys::time_us() - _begin;
+		}
+
+		bool write_trace(const char *path)
+		{
+			std::ofstream out(path);
+			if (!out.good())
+			{
+				APP_WARNING("Could not write profile trace to [" << path << "]")
+				return false;
+			}
+
+			sys::scoped_maybe_lock lk(&s_buffers_mtx);
+
+			out << "{\"traceEvents\":[\n";
+			bool first = true;
+			for (unsigned int i=0;i!=s_buffers.size();i++)
+			{
+				const thread_buffer *b = s_buffers[i];
+				for (unsigned int j=0;j!=b->events.size();j++)
+				{
+					const event &e = b->events[j];
+					if (!first)
+						out << ",\n";
+					first = false;
+
+					out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << b->tid << ",\"ts\":" << e.begin << ",\"dur\":" << e.duration;
+					out << ",\"cat\":\"" << e.category << "\",\"name\":\"";
+					write_escaped(out, e.name);
+					out << "\"";
+					if (!e.object.empty())
+					{
+						out << ",\"args\":{\"object\":\"";
+						write_escaped(out, e.object);
+						out << "\"}";
+					}
+					out << "}";
+				}
+			}
+			out << "\n]}\n";
+
+			APP_INFO("Wrote profile trace to [" << path << "]")
+			return true;
+		}
+
+		namespace
+		{
+			struct total
+			{
+				std::string key;
+				long long time;
+				long long max;
+				unsigned int count;
+			};
+
+			bool by_time(const total &a, const total &b)
+			{
+				return a.time > b.time;
+			}
+
+			typedef std::map<std::string, total> Totals;
+
+			void add(Totals &t, const std::string &key, long long duration)
+			{
+				total &e = t[key];
+				if (!e.count)
+				{
+					e.key = key;
+					e.time = 0;
+					e.max = 0;
+				}
+				e.count++;
+				e.time += duration;
+				e.max = std::max(e.max, duration);
+			}
+
+			void print_table(const char *title, const Totals &t, unsigned int count)
+			{
+				std::vector<total> sorted;
+				for (Totals::const_iterator i=t.begin();i!=t.end();i++)
+					sorted.push_back(i->second);
+				std::sort(sorted.begin(), sorted.end(), by_time);
+
+				APP_INFO(title)
+				for (unsigned int i=0;i<sorted.size() && i<count;i++)
+				{
+					const total &e = sorted[i];
+					APP_INFO("  " << (e.time / 1000) << " ms total, " << (e.max / 1000) << " ms max, " << e.count << "x  " << e.key)
+				}
+			}
+		}
+
+		void print_summary(unsigned int count)
+		{
+			Totals categories, handlers, objects;
+
+			sys::scoped_maybe_lock lk(&s_buffers_mtx);
+			for (unsigned int i=0;i!=s_buffers.size();i++)
+			{
+				const thread_buffer *b = s_buffers[i];
+				for (unsigned int j=0;j!=b->events.size();j++)
+				{
+					const event &e = b->events[j];
+					add(categories, std::string(e.category) + ":" + e.name, e.duration);
+					if (!strcmp(e.category, "handler"))
+						add(handlers, e.name, e.duration);
+					// the build scope covers everything done for one record; inner events would double count.
+					if (!strcmp(e.category, "build"))
+						add(objects, e.object, e.duration);
+				}
+			}
+
+			if (categories.empty())
+			{
+				return;
+			}
+
+			print_table("Profile: top events", categories, count);
+			print_table("Profile: top handlers", handlers, count);
+			print_table("Profile: top objects", objects, count);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef __PUTKI_PROFILER_H__
+#define __PUTKI_PROFILER_H__
+
+#include <string>
+
+namespace putki
+{
+	namespace profiler
+	{
+		// Off by default; when disabled a scope costs one branch.
+		void enable(bool enabled);
+		bool enabled();
+
+		// Records one complete event into the calling thread's buffer when it goes out of scope.
+		struct scope
+		{
+			scope(const char *category, const char *name, const char *object = 0);
+			~scope();
+
+			const char *_category;
+			const char *_name;
+			const char *_object;
+			long long _begin;
+		};
+
+		// chrome://tracing / Perfetto compatible json.
+		bool write_trace(const char *path);
+
+		// top handlers and objects by wall time, printed through the log.
+		void print_summary(unsigned int count = 15);
+	}
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(category, name, object) putki::profiler::scope PROFILE_CONCAT(__profile_scope_, __LINE__)(category, name, object);
+
+#endif
@@ -3,10 +3,13 @@
 #include <putki/builder/builder.h>
 #include <putki/sys/files.h>
 #include <putki/sys/thread.h>
+#include <putki/builder/log.h>
 
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <map>
+#include <vector>
 
 extern "C" {
 	#include <md5/md5.h>
@@ -36,76 +39,369 @@ namespace putki
 			return full_path + "/" + ps;
 		}
 
-		bool load(builder::data *bld, const char *path, const char **outBytes, long long *outSize)
+		struct view
+		{
+			std::string path;
+			sys::file_info info;
+			sys::mapped_file *mf;
+			const char *bytes;
+			long long size;
+			volatile int refcount;
+		};
+
+		// Only held while looking up or inserting views, never while mapping or reading files.
+		sys::mutex _views_mtx;
+		std::map<std::string, view*> _views;
+		std::map<const char*, view*> _loaded;
+
+		bool same_info(const sys::file_info & a, const sys::file_info & b)
+		{
+			return a.size == b.size && a.mtime == b.mtime && a.mtime_ns == b.mtime_ns && a.dev == b.dev && a.ino == b.ino;
+		}
+
+		// Takes a reference unless the view is already on its way out.
+		bool try_retain(view *v)
+		{
+			while (true)
+			{
+				int cur = v->refcount;
+				if (cur == 0)
+					return false;
+				if (sys::atomic_cas(&v->refcount, cur, cur + 1))
+					return true;
+			}
+		}
+
+		view* open_view(builder::data *bld, const char *path)
 		{
-			sys::scoped_maybe_lock lk(&_mtx);
-			
 			std::string full_path = real_path(bld, path);
 
-			std::ifstream f(full_path.c_str(), std::ios::binary);
-			if (!f.good())
+			// files can be replaced while mapped (save_temp relinks), only hand out views of the current
+			// one. a rename within the same second at the same size still changes the inode.
+			sys::file_info info;
+			if (!sys::stat(full_path.c_str(), &info))
 			{
 				APP_WARNING("Failed to load resource [" << full_path << "]")
+				return 0;
+			}
+
+			{
+				sys::scoped_maybe_lock lk(&_views_mtx);
+				std::map<std::string, view*>::iterator i = _views.find(full_path);
+				if (i != _views.end() && same_info(i->second->info, info) && try_retain(i->second))
+				{
+					return i->second;
+				}
+			}
+
+			view *v = new view();
+			v->path = full_path;
+			v->info = info;
+			v->refcount = 1;
+			v->mf = sys::map_file(full_path.c_str(), &v->bytes, &v->size);
+			if (!v->mf)
+			{
+				APP_WARNING("Failed to load resource [" << full_path << "]")
+				delete v;
+				return 0;
+			}
+
+			sys::scoped_maybe_lock lk(&_views_mtx);
+			std::map<std::string, view*>::iterator i = _views.find(full_path);
+			if (i != _views.end() && same_info(i->second->info, info) && try_retain(i->second))
+			{
+				// someone else mapped it in the meantime
+				view *other = i->second;
+				lk.unlock();
+				sys::unmap_file(v->mf);
+				delete v;
+				return other;
+			}
+
+			_views[full_path] = v;
+			return v;
+		}
+
+		void retain_view(view *v)
+		{
+			sys::atomic_inc(&v->refcount);
+		}
+
+		void release_view(view *v)
+		{
+			if (sys::atomic_dec(&v->refcount) > 0)
+			{
+				return;
+			}
+
+			// refcount reached zero, and try_retain will never bring it back, so this is the only owner.
+			{
+				sys::scoped_maybe_lock lk(&_views_mtx);
+				std::map<std::string, view*>::iterator i = _views.find(v->path);
+				if (i != _views.end() && i->second == v)
+				{
+					_views.erase(i);
+				}
+				std::map<const char*, view*>::iterator j = _loaded.find(v->bytes);
+				if (j != _loaded.end() && j->second == v)
+				{
+					_loaded.erase(j);
+				}
+			}
+
+			sys::unmap_file(v->mf);
+			delete v;
+		}
+
+		const char *view_bytes(view *v)
+		{
+			return v->bytes;
+		}
+
+		long long view_size(view *v)
+		{
+			return v->size;
+		}
+
+		bool load(builder::data *bld, const char *path, const char **outBytes, long long *outSize)
+		{
+			view *v = open_view(bld, path);
+			if (!v)
+			{
 				return false;
 			}
 
-			f.seekg(0, std::ios::end);
-			std::streampos size = f.tellg();
-			f.seekg(0, std::ios::beg);
+			if (v->size == 0)
+			{
+				// empty mappings all share the same address, so they can't be tracked by pointer.
+				release_view(v);
+				*outBytes = new char[1];
+				*outSize = 0;
+				return true;
+			}
 
-			char *b = new char[(size_t)size];
-			f.read(b, size);
+			{
+				sys::scoped_maybe_lock lk(&_views_mtx);
+				_loaded[v->bytes] = v;
+			}
 
-			*outBytes = b;
-			*outSize = (long long) size;
+			*outBytes = v->bytes;
+			*outSize = v->size;
 			return true;
 		}
 
 		void free(const char *data)
 		{
-			delete [] data;
+			view *v = 0;
+			{
+				sys::scoped_maybe_lock lk(&_views_mtx);
+				std::map<const char*, view*>::iterator i = _loaded.find(data);
+				if (i != _loaded.end())
+				{
+					v = i->second;
+				}
+			}
+
+			if (v)
+			{
+				release_view(v);
+			}
+			else
+			{
+				delete [] data;
+			}
 		}
 
 		std::string signature(builder::data *bld, const char *path)
 		{
-			// optimize this.
-			const char *bytes;
-			long long sz;
-			if (!load(bld, path, &bytes, &sz))
+			std::string full_path = real_path(bld, path);
+
+			std::ifstream f(full_path.c_str(), std::ios::binary);
+			if (!f.good())
 			{
 				return "(missing)";
 			}
+
+			md5_t md5;
+			md5_init(&md5);
+
+			char buf[64 * 1024];
+			while (f.good())
+			{
+				f.read(buf, sizeof(buf));
+				std::streamsize got = f.gcount();
+				if (got <= 0)
+					break;
+				md5_process(&md5, buf, (unsigned int) got);
+			}
+
+			char signature[64];
+			char signature_string[64];
+			md5_finish(&md5, signature);
+			md5_sig_to_string(signature, signature_string, 64);
+			return signature_string;
+		}
+
+		std::string content_signature(const char *bytes, long long length)
+		{
+			char signature[64];
+			char signature_string[64];
+			md5_buffer(bytes, (long)length, signature);
+			md5_sig_to_string(signature, signature_string, 64);
+			return signature_string;
+		}
+
+		// Saved resources are content addressed; the bytes are stored once in the blob store
+		// under their signature and the named paths are hard links into it. Saving the same
+		// contents again does not touch the disk.
+		std::string blob_path(builder::data *builder, const char *signature)
+		{
+			return std::string(builder::tmp_path(builder)) + "/.cas/" + signature;
+		}
+
+		enum blob_state
+		{
+			BLOB_WRITING,
+			BLOB_STORED
+		};
+
+		// Blobs known to be on disk with the right contents. Only held for lookups and inserts.
+		std::map<std::string, blob_state> _blobs;
+
+		bool blob_matches(const char *path, const char *signature)
+		{
+			const char *bytes;
+			long long size;
+			sys::mapped_file *mf = sys::map_file(path, &bytes, &size);
+			if (!mf)
+				return false;
+			bool match = content_signature(bytes, size) == signature;
+			sys::unmap_file(mf);
+			return match;
+		}
+
+		// false when the blob could not be written, or another thread is writing it right now.
+		bool store_blob(builder::data *builder, const char *signature, const char *bytes, long long length, std::string *out)
+		{
+			*out = blob_path(builder, signature);
+
+			{
+				sys::scoped_maybe_lock lk(&_mtx);
+				std::map<std::string, blob_state>::iterator i = _blobs.find(signature);
+				if (i != _blobs.end())
+					return i->second == BLOB_STORED;
+				_blobs.insert(std::make_pair(std::string(signature), BLOB_WRITING));
+			}
+
+			bool ok = blob_matches(out->c_str(), signature);
+			if (!ok)
+			{
+				// never write through, the old blob may be linked from other outputs.
+				sys::remove_file(out->c_str());
+				sys::mk_dir_for_path(out->c_str());
+				ok = sys::write_file(out->c_str(), bytes, (unsigned long)length);
+				if (!ok)
+				{
+					APP_WARNING("Failed to store blob [" << *out << "]")
+				}
+			}
+
+			sys::scoped_maybe_lock lk(&_mtx);
+			if (ok)
+				_blobs[signature] = BLOB_STORED;
 			else
+				_blobs.erase(signature);
+			return ok;
+		}
+
+		// out_path may be a link into the blob store, so it is always removed before written to.
+		bool write_unlinked(const std::string & out_path, const char *bytes, long long length)
+		{
+			sys::remove_file(out_path.c_str());
+			sys::mk_dir_for_path(out_path.c_str());
+			return sys::write_file(out_path.c_str(), bytes, (unsigned long)length);
+		}
+
+		bool save_addressed(builder::data *builder, const std::string & out_path, const char *signature, const char *bytes, long long length)
+		{
+			std::string blob;
+			if (!store_blob(builder, signature, bytes, length, &blob))
 			{
-				char signature[64];
-				char signature_string[64];
+				APP_DEBUG("Blob [" << blob << "] not available, writing [" << out_path << "] directly")
+				return write_unlinked(out_path, bytes, length);
+			}
 
-				md5_buffer(bytes, (long)sz, signature);
-				md5_sig_to_string(signature, signature_string, 64);
+			if (sys::same_file(blob.c_str(), out_path.c_str()))
+			{
+				return true;
+			}
 
-				delete [] bytes;
-				return signature_string;
+			sys::mk_dir_for_path(out_path.c_str());
+			if (sys::link_file(blob.c_str(), out_path.c_str()))
+			{
+				return true;
 			}
+
+			// different volumes or no hard link support; fall back to a plain copy.
+			return write_unlinked(out_path, bytes, length);
 		}
 
 		std::string save_temp(builder::data *builder, const char *path, const char *bytes, long long length)
 		{
 			std::string out_path = std::string(builder::tmp_path(builder)) + "/" + path;
-			sys::mk_dir_for_path(out_path.c_str());
+			std::string sig = content_signature(bytes, length);
+			std::string res_path = std::string("%") + path;
+
+			if (!save_addressed(builder, out_path, sig.c_str(), bytes, length))
+			{
+				APP_ERROR("Failed to save temp resource [" << out_path << "]")
+			}
 
-			std::ofstream f(out_path.c_str(), std::ios::binary);
-			f.write(bytes, length);
-			return std::string("%") + path;
+			builder::touched_temp_resource(builder, res_path.c_str(), sig.c_str());
+			return res_path;
 		}
 
 		std::string save_output(builder::data *builder, const char *path, const char *bytes, long long length)
 		{
 			std::string out_path = std::string(builder::out_path(builder)) + "/" + path;
-			sys::mk_dir_for_path(out_path.c_str());
+			std::string sig = content_signature(bytes, length);
 
-			std::ofstream f(out_path.c_str(), std::ios::binary);
-			f.write(bytes, length);
+			if (!save_addressed(builder, out_path, sig.c_str(), bytes, length))
+			{
+				APP_ERROR("Failed to save output resource [" << out_path << "]")
+			}
 			return path;
 		}
+
+		void collect_blob(const char *fullname, const char *name, void *userptr)
+		{
+			((std::vector<std::string> *) userptr)->push_back(name);
+		}
+
+		unsigned int prune_blobs(builder::data *builder)
+		{
+			std::string root = std::string(builder::tmp_path(builder)) + "/.cas";
+			std::vector<std::string> blobs;
+			sys::search_tree(root.c_str(), collect_blob, &blobs);
+
+			unsigned int removed = 0;
+			for (unsigned int i=0;i!=blobs.size();i++)
+			{
+				// the store's own name is the only link left.
+				std::string path = root + "/" + blobs[i];
+				sys::file_info info;
+				if (!sys::stat(path.c_str(), &info) || info.links != 1)
+					continue;
+
+				{
+					sys::scoped_maybe_lock lk(&_mtx);
+					_blobs.erase(blobs[i]);
+				}
+
+				if (sys::remove_file(path.c_str()))
+					removed++;
+			}
+			return removed;
+		}
 	}
 }
@@ -7,13 +7,27 @@ namespace putki
 
 	namespace resource
 	{
+		// bytes returned from load are a read-only view into the file and must be given back with free.
 		void free(const char *data);
 		bool load(builder::data *builder, const char *path, const char **outBytes, long long *outSize);
 
+		// Shared, refcounted read-only mapping of a resource. Opening the same path
+		// while it is already open hands out the same mapping.
+		struct view;
+		view* open_view(builder::data *builder, const char *path);
+		void retain_view(view *v);
+		void release_view(view *v);
+		const char *view_bytes(view *v);
+		long long view_size(view *v);
+
 		std::string signature(builder::data *builder, const char *path);
 		std::string save_temp(builder::data *builder, const char *path, const char *bytes, long long length);
 		std::string save_output(builder::data *builder, const char *path, const char *bytes, long long length);
 
+		// removes the blobs no saved resource links to any more, returns how many. nothing may be
+		// saved while this runs.
+		unsigned int prune_blobs(builder::data *builder);
+
 		// translate path to something that can be used to open a file with fopen
 		std::string real_path(builder::data *builder, const char *path);
 	}
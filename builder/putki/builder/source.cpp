@@ -10,11 +10,14 @@
 #include <putki/sys/thread.h>
 
 #include <putki/builder/parse.h>
+#include <putki/builder/binary.h>
+#include <putki/builder/write.h>
 #include <putki/builder/typereg.h>
 #include <putki/builder/db.h>
 #include <putki/builder/log.h>
 #include <putki/builder/tool.h>
 #include <putki/builder/build.h>
+#include <putki/builder/profiler.h>
 
 namespace putki
 {
@@ -183,6 +186,138 @@ namespace putki
 	}
 	
 	
+	namespace
+	{
+		// reads the type table of a binary object, false if any of the types has changed since.
+		bool read_binary_types(binary::reader *in, const char *path, std::vector<type_handler_i*> *types)
+		{
+			if (binary::read_u32(in) != write::BINARY_MAGIC || binary::read_u32(in) != write::BINARY_VERSION)
+			{
+				APP_WARNING("Cached object " << path << " is not in the current binary format")
+				return false;
+			}
+
+			const uint32_t count = binary::read_count(in);
+			for (uint32_t i=0;i!=count;i++)
+			{
+				const char *name = binary::read_cstr(in);
+				const uint32_t signature = binary::read_u32(in);
+				if (in->error)
+					break;
+
+				type_handler_i *h = typereg_get_handler(name);
+				if (!h || h->binary_signature() != signature)
+				{
+					APP_DEBUG("Cached object " << path << " has type " << name << " with an old layout")
+					return false;
+				}
+				if (types)
+					types->push_back(h);
+			}
+
+			return !in->error;
+		}
+	}
+
+	// the binary form from write::write_object_binary. everything is read before anything is
+	// inserted, so a broken file leaves nothing behind.
+	bool load_binary_into_db(db::data *db, const char *bytes, long long size, const char *path, sys::mutex *insert_mtx = 0)
+	{
+		binary::reader in;
+		binary::init(&in, bytes, bytes + size);
+
+		struct loaded
+		{
+			std::string path;
+			type_handler_i *th;
+			instance_t obj;
+		};
+		std::vector<loaded> objs;
+		std::vector<type_handler_i*> types;
+
+		if (read_binary_types(&in, path, &types))
+		{
+			load_resolver_store_db_ref resolver;
+			resolver.objpath = path;
+			resolver.db = db;
+
+			const uint32_t count = binary::read_count(&in);
+			for (uint32_t i=0;i!=count && !in.error;i++)
+			{
+				size_t ref_len;
+				const char *ref = binary::read_cstr(&in, &ref_len);
+				const uint32_t type = binary::read_u32(&in);
+				if (in.error || type >= types.size() || (i == 0) != (ref_len == 0))
+				{
+					in.error = true;
+					break;
+				}
+
+				loaded l;
+				l.path = path;
+				l.path.append(ref, ref_len);
+				l.th = types[type];
+				l.obj = l.th->alloc();
+				l.th->read_binary(&in, l.obj, &resolver);
+				objs.push_back(l);
+			}
+		}
+		else
+		{
+			in.error = true;
+		}
+
+		if (in.error || objs.empty())
+		{
+			APP_WARNING("Failed to read cached object <" << path << ">")
+			for (size_t i=0;i!=objs.size();i++)
+				objs[i].th->free(objs[i].obj);
+			return false;
+		}
+
+		sys::scoped_maybe_lock lk(insert_mtx);
+		db::insert(db, path, objs[0].th, objs[0].obj);
+		for (size_t i=1;i<objs.size();i++)
+		{
+			db::start_loading(db, objs[i].path.c_str());
+			db::insert(db, objs[i].path.c_str(), objs[i].th, objs[i].obj);
+		}
+		return true;
+	}
+
+	// the binary form is used when there is one, json is only looked for without it.
+	bool load_object_into_db(db::data *db, const char *sourcepath, const char *path, sys::mutex *insert_mtx)
+	{
+		std::string base = std::string(sourcepath) + "/" + path;
+
+		const char *bytes;
+		long long size;
+		if (sys::mapped_file *mf = sys::map_file((base + ".bin").c_str(), &bytes, &size))
+		{
+			const bool success = load_binary_into_db(db, bytes, size, path, insert_mtx);
+			sys::unmap_file(mf);
+			return success;
+		}
+
+		return load_json_into_db(db, (base + ".json").c_str(), (std::string(path) + ".json").c_str(), 0, insert_mtx);
+	}
+
+	bool is_cached_object_current(const char *sourcepath, const char *path)
+	{
+		std::string fullpath = std::string(sourcepath) + "/" + path + ".bin";
+		const char *bytes;
+		long long size;
+		sys::mapped_file *mf = sys::map_file(fullpath.c_str(), &bytes, &size);
+		if (!mf)
+			return true;
+
+		binary::reader in;
+		binary::init(&in, bytes, bytes + size);
+		const bool current = read_binary_types(&in, path, 0);
+		sys::unmap_file(mf);
+		return current;
+	}
+
 	bool update_with_json(db::data *db, const char *path, char *json, int size)
 	{
 		parse::data *pd = parse::parse_json(json, size);
@@ -310,11 +445,8 @@ namespace putki
 	// The end-all, be all
 	bool do_load_into_db(db::data *db, const char *path, type_handler_i **th, instance_t *obj, deferred_loader *loader, bool do_resolve)
 	{
-		// 1. Load the json file raw into the database.
-		APP_DEBUG("deferred_loader: loading " << loader->sourcepath << "/" << path << ".json")
-		
-		std::string fpath = std::string(path) + ".json";
-		std::string fullpath = std::string(loader->sourcepath) + "/" + fpath;
+		// 1. Load the file raw into the database.
+		APP_DEBUG("deferred_loader: loading " << loader->sourcepath << "/" << path)
 		
 		if (!db::start_loading(db, path))
 		{
@@ -326,7 +458,10 @@ namespace putki
 			return true;
 		}
 
-		load_json_into_db(db, fullpath.c_str(), fpath.c_str(), 0, &resolve_mtx);
+		{
+			PROFILE_SCOPE("load", "load_object", path)
+			load_object_into_db(db, loader->sourcepath.c_str(), path, &resolve_mtx);
+		}
 
 		if (!db::fetch(db, path, th, obj, false, true))
 		{
@@ -365,7 +500,7 @@ namespace putki
 			{
 				sys::scoped_maybe_lock lk0(&resolve_mtx);
 				resolver.reset_visited();
-				(*th)->walk_dependencies(*obj, &resolver, true);
+				putki::walk_dependencies(*th, *obj, &resolver, true);
 			}
 
 			if (!resolver.unresolved_count)
@@ -392,7 +527,7 @@ namespace putki
 				}
 
 				APP_DEBUG("Depload " << path << " => " << i->first << " from disk at " << i->second->sourcepath)
-				if (!load_json_into_db(i->second->db, (i->second->sourcepath + "/" + i->first + ".json").c_str(), (i->first + ".json").c_str(), 0, &resolve_mtx))
+				if (!load_object_into_db(i->second->db, i->second->sourcepath.c_str(), i->first.c_str(), &resolve_mtx))
 				{
 					APP_WARNING("Dependency " << path << " -> " << i->first << " FAILED!")
 					db::done_loading(i->second->db, i->first.c_str());
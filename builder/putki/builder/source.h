@@ -8,6 +8,9 @@ namespace putki
 
 	void load_tree_into_db(const char *sourcepath, db::data *d);
 	void load_file_into_db(const char *sourcepath, const char *path, db::data *d, bool resolve);
+
+	// false if the object has been written in binary form with types that have changed since.
+	bool is_cached_object_current(const char *sourcepath, const char *path);
 	
 	// this will modify the buffer.
 	bool update_with_json(db::data *db, const char *path, char *json, int size);
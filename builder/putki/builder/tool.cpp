@@ -65,7 +65,7 @@ namespace putki
 		dc.check_flags = check_flags;
 		dc.follow_aux_ptrs = follow_aux_ptrs;
 		dc.follow_ptrs = follow_ptrs;
-		th->walk_dependencies(obj, &dc, true);
+		putki::walk_dependencies(th, obj, &dc, true);
 	}
 	
 	bool is_valid_pointer(type_handler_i *th, const char *ptr_type)
@@ -132,7 +132,7 @@ namespace putki
 			APP_ERROR("Could not load [" << path << "]")
 		}
 		dc.db = db;
-		th->walk_dependencies(obj, &dc, true);
+		putki::walk_dependencies(th, obj, &dc, true);
 	}
 
 	namespace
@@ -169,7 +169,7 @@ namespace putki
 	{
 		unresolved_clearer cl;
 		cl.db = db;
-		th->walk_dependencies(obj, &cl, false);
+		putki::walk_dependencies(th, obj, &cl, false);
 	}
 
 
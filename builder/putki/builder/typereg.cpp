@@ -1,19 +1,31 @@
 #include "typereg.h"
 #include "log.h"
 
-#include <map>
-#include <set>
 #include <vector>
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include <stdint.h>
 
 namespace putki
 {
 	struct registry
 	{
-		std::map<std::string, type_handler_i*> handlers;
-		std::map<int, type_handler_i*> by_number;
+		struct named
+		{
+			named() : th(0) { }
+			std::string name;
+			type_handler_i *th;
+		};
+
+		// open addressing on the name hash, size is a power of two and at most half full.
+		std::vector<named> by_name;
+		unsigned int names;
+		// indexed by type id; the compiler hands them out densely from 1.
+		std::vector<type_handler_i*> by_number;
 		std::vector<type_handler_i*> list;
+
+		registry() : by_name(64), names(0) { }
 	};
 
 	namespace
@@ -23,17 +35,93 @@ namespace putki
 			static registry r;
 			return &r;
 		}
+
+		unsigned int name_hash(const char *name)
+		{
+			unsigned int h = 2166136261u;
+			for (;*name;name++)
+				h = (h ^ (unsigned char)*name) * 16777619u;
+			return h;
+		}
+
+		registry::named * find_name(std::vector<registry::named> & table, const char *name)
+		{
+			const unsigned int mask = (unsigned int)table.size() - 1;
+			unsigned int i = name_hash(name) & mask;
+			while (table[i].th && table[i].name != name)
+				i = (i + 1) & mask;
+			return &table[i];
+		}
 	}
 
+	// Open addressing set of pointer slot addresses; 0 marks an empty bucket.
 	struct depwalker_i::visited_set
 	{
-		std::set<void *> visited;
+		std::vector<void*> table;
+		size_t count;
+
+		visited_set() : table(64, (void*)0), count(0) { }
+
+		// Slots next to each other in memory land in neighbouring buckets, which keeps
+		// walks over pointer arrays cache friendly; the high bits are folded in so
+		// separate allocations don't pile up on the same buckets.
+		static size_t hash(void *p)
+		{
+			size_t v = (size_t)p >> 3;
+			return v ^ (v >> 13) ^ (v >> 27);
+		}
+
+		// false if it was already there
+		bool insert(void *p)
+		{
+			if (2 * (count + 1) > table.size())
+				grow();
+
+			const size_t mask = table.size() - 1;
+			size_t i = hash(p) & mask;
+			while (table[i])
+			{
+				if (table[i] == p)
+					return false;
+				i = (i + 1) & mask;
+			}
+			table[i] = p;
+			count++;
+			return true;
+		}
+
+		void grow()
+		{
+			std::vector<void*> old;
+			old.swap(table);
+			table.assign(old.size() * 2, (void*)0);
+
+			const size_t mask = table.size() - 1;
+			for (size_t j=0;j!=old.size();j++)
+			{
+				if (!old[j])
+					continue;
+				size_t i = hash(old[j]) & mask;
+				while (table[i])
+					i = (i + 1) & mask;
+				table[i] = old[j];
+			}
+		}
+
+		void clear()
+		{
+			if (count)
+			{
+				std::fill(table.begin(), table.end(), (void*)0);
+				count = 0;
+			}
+		}
 	};
 
 	void depwalker_i::reset_visited()
 	{
 		if (_visited)
-			_visited->visited.clear();
+			_visited->clear();
 	}
 
 	depwalker_i::depwalker_i()
@@ -48,26 +136,123 @@ namespace putki
 
 	bool depwalker_i::pointer_pre_filter(instance_t *on, const char *ptr_type)
 	{
-		bool ret = pointer_pre(on, ptr_type);
-		if (ret)
+		if (!pointer_pre(on, ptr_type))
+			return false;
+
+		if (!_visited)
+			_visited = new depwalker_i::visited_set();
+
+		return _visited->insert(on);
+	}
+
+	namespace
+	{
+		struct walk_frame
 		{
-			if (!_visited)
+			char *obj;
+			const type_layout *layout;
+			instance_t *post;
+			int field;
+			char *elem, *elem_end;
+			size_t stride;
+		};
+
+		// returns false if nothing needs to go on the stack.
+		bool enter_node(std::vector<walk_frame> & stack, type_handler_i *th, instance_t obj, depwalker_i *walker, bool traverse_children, bool skip_input_only, bool rtti_dispatch, instance_t *post)
+		{
+			const type_layout *layout = th->layout();
+			if (layout && rtti_dispatch && layout->rtti_offset >= 0)
 			{
-				_visited = new depwalker_i::visited_set();
-				_visited->visited.insert(on);
-				return true;
+				th = typereg_get_handler(*(int32_t *)((char *)obj + layout->rtti_offset));
+				layout = th->layout();
 			}
-			else if (_visited->visited.count(on))
+
+			if (!layout)
 			{
+				th->walk_dependencies(obj, walker, traverse_children, skip_input_only, rtti_dispatch);
 				return false;
 			}
+
+			if (!layout->count)
+				return false;
+
+			walk_frame f;
+			f.obj = (char *) obj;
+			f.layout = layout;
+			f.post = post;
+			f.field = -1;
+			f.elem = f.elem_end = 0;
+			f.stride = 0;
+			stack.push_back(f);
+			return true;
+		}
+	}
+
+	void walk_dependencies(type_handler_i *th, instance_t source, depwalker_i *walker, bool traverse_children, bool skip_input_only, bool rtti_dispatch)
+	{
+		std::vector<walk_frame> stack;
+		stack.reserve(32);
+
+		enter_node(stack, th, source, walker, traverse_children, skip_input_only, rtti_dispatch, 0);
+
+		while (!stack.empty())
+		{
+			walk_frame & f = stack.back();
+			if (f.elem == f.elem_end)
+			{
+				if (++f.field == (int)f.layout->count)
+				{
+					instance_t *post = f.post;
+					stack.pop_back();
+					if (post)
+						walker->pointer_post(post);
+					continue;
+				}
+
+				const type_layout_field & fd = f.layout->fields[f.field];
+				if (skip_input_only && fd.input_only)
+				{
+					f.elem = f.elem_end = 0;
+					continue;
+				}
+
+				char *field = f.obj + fd.offset;
+				if (fd.array_range)
+					fd.array_range(field, &f.elem, &f.elem_end);
+				else
+				{
+					f.elem = field;
+					f.elem_end = field + fd.stride;
+				}
+				f.stride = fd.stride;
+				continue;
+			}
+
+			const type_layout_field & fd = f.layout->fields[f.field];
+			if (fd.kind == type_layout_field::POINTER)
+			{
+				// run through the pointers until one needs descending into.
+				while (f.elem != f.elem_end)
+				{
+					instance_t *on = (instance_t *) f.elem;
+					f.elem += f.stride;
+
+					if (walker->pointer_pre_filter(on, fd.ptr_type) && traverse_children && *on)
+					{
+						// f is not valid after this, the stack may grow.
+						if (enter_node(stack, fd.handler(), *on, walker, traverse_children, skip_input_only, true, on))
+							break;
+					}
+					walker->pointer_post(on);
+				}
+			}
 			else
 			{
-				_visited->visited.insert(on);
-				return true;
+				char *elem = f.elem;
+				f.elem += f.stride;
+				enter_node(stack, fd.handler(), elem, walker, traverse_children, skip_input_only, true, 0);
 			}
 		}
-		return false;
 	}
 
 	void typereg_init()
@@ -77,18 +262,46 @@ namespace putki
 
 	void typereg_register(const char *type, type_handler_i *dt)
 	{
-		g_reg()->handlers[type] = dt;
-		g_reg()->by_number[dt->id()] = dt;
-		g_reg()->list.push_back(dt);
+		registry *reg = g_reg();
+		if (2 * (reg->names + 1) > reg->by_name.size())
+		{
+			std::vector<registry::named> old(reg->by_name.size() * 2);
+			old.swap(reg->by_name);
+			for (size_t i=0;i!=old.size();i++)
+			{
+				if (old[i].th)
+					*find_name(reg->by_name, old[i].name.c_str()) = old[i];
+			}
+		}
+
+		registry::named *n = find_name(reg->by_name, type);
+		if (!n->th)
+		{
+			n->name = type;
+			reg->names++;
+		}
+		n->th = dt;
+
+		const int id = dt->id();
+		if (id >= 0)
+		{
+			if ((unsigned int)id >= reg->by_number.size())
+				reg->by_number.resize(id + 1, 0);
+			reg->by_number[id] = dt;
+		}
+
+		reg->list.push_back(dt);
 	}
 
 	type_handler_i *typereg_get_handler(int type_id)
 	{
-		if (!g_reg()->by_number[type_id])
+		registry *reg = g_reg();
+		if ((unsigned int)type_id >= reg->by_number.size() || !reg->by_number[type_id])
 		{
 			APP_ERROR("Type id " << type_id << " has no handler");
+			return 0;
 		}
-		return g_reg()->by_number[type_id];
+		return reg->by_number[type_id];
 	}
 
 	type_handler_i *typereg_get_handler_by_index(unsigned int idx)
@@ -101,11 +314,12 @@ namespace putki
 
 	type_handler_i *typereg_get_handler(type_t t)
 	{
-		if (!g_reg()->handlers[t])
+		type_handler_i *th = find_name(g_reg()->by_name, t)->th;
+		if (!th)
 		{
 			APP_ERROR("Type " << t << " has no handler")
 		}
 	
-		return g_reg()->handlers[t];
+		return th;
 	}
 }
\ No newline at end of file
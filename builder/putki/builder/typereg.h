@@ -1,5 +1,7 @@
 #pragma once
 #include <putki/runtime.h>
+#include <cstddef>
+#include <vector>
 
 namespace putki
 {
@@ -12,7 +14,8 @@ namespace putki
 	};
 
 	namespace parse { struct node; }
-	namespace db { struct data; }
+	namespace db { struct data; struct snapshot; }
+	namespace binary { struct reader; }
 	struct sstream;
 
 	struct load_resolver_i
@@ -38,6 +41,49 @@ namespace putki
 		virtual void pointer_post(instance_t *on) { }; // post descending into pointer.
 	};
 
+	struct type_handler_i;
+
+	// Static description of where the pointers and nested structs are in a generated
+	// type, so traversals can run off tables instead of virtual walk_dependencies calls.
+	struct type_layout_field
+	{
+		enum
+		{
+			POINTER = 0,
+			STRUCT_INSTANCE = 1
+		};
+
+		int kind;
+		size_t offset;
+		// set for std::vector fields, returns the element range.
+		void (*array_range)(void *field, char **begin, char **end);
+		size_t stride;
+		const char *ptr_type;
+		type_handler_i* (*handler)();
+		// owning struct is not in the output domain.
+		bool input_only;
+	};
+
+	struct type_layout
+	{
+		const type_layout_field *fields;
+		unsigned int count;
+		// offset to the rtti type id, -1 if the type has no rtti.
+		int rtti_offset;
+	};
+
+	template<typename T>
+	void layout_vector_range(void *field, char **begin, char **end)
+	{
+		std::vector<T> *vec = (std::vector<T> *) field;
+		*begin = vec->empty() ? 0 : (char *) &(*vec)[0];
+		*end = *begin + vec->size() * sizeof(T);
+	}
+
+	// offsetof is only specified for standard layout types, which generated types with a parent
+	// are not. they only use single non-virtual inheritance, so the member address works.
+	#define PUTKI_FIELD_OFFSET(type, field) ((size_t)((char *)&((type *)0x100)->field - (char *)0x100))
+
 	struct type_handler_i
 	{
 		// info
@@ -56,12 +102,25 @@ namespace putki
 		virtual void fill_from_parsed(parse::node *pn, instance_t target, load_resolver_i *resolver) = 0;
 		virtual void write_json(putki::db::data *ref_source, instance_t source, putki::sstream & out, int indent) = 0;
 
+		// compact form for the built object cache. binary_signature changes with the field
+		// layout so data written by an older version of the type can be told apart.
+		virtual void write_binary(putki::db::snapshot *ref_source, instance_t source, putki::sstream & out) = 0;
+		virtual void read_binary(putki::binary::reader *in, instance_t target, load_resolver_i *resolver) = 0;
+		virtual unsigned int binary_signature() = 0;
+
 		virtual char* write_into_buffer(runtime::descptr rt, instance_t source, char *beg, char *end) = 0;
 
 		// recurse down and report all pointers
 		virtual void walk_dependencies(instance_t source, depwalker_i *walker, bool traverseChildren, bool skipInputOnly = false, bool rttiDispatch = false) = 0;
+
+		// generated types provide this; 0 means only walk_dependencies is available.
+		virtual const type_layout *layout() { return 0; }
 	};
 
+	// Same traversal as th->walk_dependencies, but iterative and driven by the type
+	// layouts. Falls back to walk_dependencies for types without one.
+	void walk_dependencies(type_handler_i *th, instance_t source, depwalker_i *walker, bool traverse_children, bool skip_input_only = false, bool rtti_dispatch = false);
+
 	// used by dll interface, forward decl here for getters.
 	struct ext_field_handler_i;
 	struct ext_type_handler_i;
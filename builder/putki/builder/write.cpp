@@ -6,9 +6,20 @@
 #include <string>
 
 #include <putki/builder/db.h>
+#include <putki/builder/binary.h>
 #include <putki/sys/files.h>
+#include <putki/sys/thread.h>
 #include <putki/sys/sstream.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define PUTKI_WRITE_SSE2
+#endif
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
 namespace putki
 {
 	namespace write
@@ -43,7 +54,7 @@ namespace putki
 					{
 						aw.start = start;
 						aw.ref_source = ref_source;
-						aw.th->walk_dependencies(aw.base, &aw, false);
+						putki::walk_dependencies(aw.th, aw.base, &aw, false);
 
 						for (unsigned int i=0; i<aw.paths.size(); i++)
 							subpaths.push_back(aw.paths[i]);
@@ -66,55 +77,51 @@ namespace putki
 		};
 
 
-		void write_object_into_stream(putki::sstream & out, db::data *ref_source, type_handler_i *th, instance_t obj)
+		void write_object_into_stream(putki::sstream & out, db::data *ref_source, type_handler_i *th, instance_t obj, bool compact)
 		{
-			out << "{\n";
-			out << "	type: "<< json_str(th->name()) << ",\n";
-			out << "	data: {\n";
-			th->write_json(ref_source, obj, out, 1);
-			out << "	},\n";
+			const int level = compact ? JSON_COMPACT : 0;
 
-			// collect all aux objects.
-			std::vector<std::string> paths;
+			out << (compact ? "{type:" : "{\n\ttype: ");
+			json_string(out, th->name());
+			out << (compact ? ",data:{" : ",\n\tdata: {\n");
+			th->write_json(ref_source, obj, out, level + 1);
+			out << (compact ? "}," : "\t},\n");
 
+			// collect all aux objects.
 			auxwriter aw;
 			aw.th = th;
 			aw.base = obj;
 			aw.start = obj;
 			aw.ref_source = ref_source;
-			th->walk_dependencies(obj, &aw, false);
+			putki::walk_dependencies(th, obj, &aw, false);
 
 			// merge
 			for (unsigned int i=0; i<aw.subpaths.size(); i++)
 				aw.paths.push_back(aw.subpaths[i]);
 
-			out << "	aux: [\n";
+			out << (compact ? "aux:[" : "\taux: [\n");
 			for (unsigned int i=0; i<aw.paths.size(); i++)
 			{
-				if (i > 0) {
-					out << "		,\n";
-				}
+				if (i > 0)
+					out << (compact ? "," : "\t\t,\n");
 
 				type_handler_i *th;
 				instance_t obj;
 				db::fetch(ref_source, aw.paths[i].c_str(), &th, &obj);
 
-				int sp = (int)aw.paths[i].find_first_of('#');
+				const std::string & path = aw.paths[i];
+				const size_t sp = path.find_first_of('#');
 
-				out << "		{\n";
-				out << "			ref: \""<< aw.paths[i].substr(sp, aw.paths[i].size() - sp) << "\",\n";
-				out << "			type: "<< json_str(th->name()) << ",\n";
-				out << "			data: {\n";
-				th->write_json(ref_source, obj, out, 4);
-				out << "			}\n";
-				out << "		}\n";
+				out << (compact ? "{ref:\"" : "\t\t{\n\t\t\tref: \"");
+				out.write(path.c_str() + sp, path.size() - sp);
+				out << (compact ? "\",type:" : "\",\n\t\t\ttype: ");
+				json_string(out, th->name());
+				out << (compact ? ",data:{" : ",\n\t\t\tdata: {\n");
+				th->write_json(ref_source, obj, out, level + 4);
+				out << (compact ? "}}" : "\t\t\t}\n\t\t}\n");
 			}
 
-			out << "	]\n";
-
-			// now all the aux
-
-			out << "}\n";
+			out << (compact ? "]}" : "\t]\n}\n");
 		}
 
 		bool write_object_to_fs(const char *basedir, const char *path, db::data *ref_source, type_handler_i *th, instance_t obj, char *fn_out)
@@ -123,54 +130,236 @@ namespace putki
 			out_path.append("/");
 			out_path.append(path);
 			out_path.append(".json");
-			putki::sstream ts;
-			write::write_object_into_stream(ts, ref_source, th, obj);
+			scoped_stream ts;
+			write::write_object_into_stream(*ts.stream, ref_source, th, obj);
 			sys::mk_dir_for_path(out_path.c_str());
-			return sys::write_file(out_path.c_str(), ts.str().c_str(), (unsigned long)ts.str().size());
+			return sys::write_file(out_path.c_str(), ts.stream->c_str(), (unsigned long)ts.stream->size());
 		}
 
 		namespace
 		{
-			static const char *hex = "0123456789abcdef";
+			// larger ones are freed rather than kept.
+			const size_t POOLED_STREAM_MAX = 16 * 1024 * 1024;
+
+			sys::mutex s_pool_mtx;
+			std::vector<putki::sstream*> s_pool;
 		}
 
-		void json_stringencode_byte_array(putki::sstream & out, std::vector<unsigned char> const &bytes)
+		putki::sstream * acquire_stream()
 		{
-			for (unsigned int i=0;i<bytes.size();i++)
 			{
-				out << (char)('a' + ((bytes[i] >> 4) & 0xf));
-				out << (char)('a' + ((bytes[i]) & 0xf));
+				sys::scoped_maybe_lock lk(&s_pool_mtx);
+				if (!s_pool.empty())
+				{
+					putki::sstream *s = s_pool.back();
+					s_pool.pop_back();
+					return s;
+				}
 			}
+			return new putki::sstream();
 		}
 
-		std::string json_str(const char *input)
+		void release_stream(putki::sstream *stream)
 		{
-			if (!input) {
-				return "\"\"";
+			if (stream->_len > POOLED_STREAM_MAX)
+			{
+				delete stream;
+				return;
 			}
 
-			const int len = (int)strlen(input);
+			stream->clear();
+			sys::scoped_maybe_lock lk(&s_pool_mtx);
+			s_pool.push_back(stream);
+		}
 
-			putki::sstream ss;
-			ss << "\"";
-			for (size_t i = 0; i != len; ++i) {
-				char val = input[i];
-				if (unsigned(val) < '\x20' || val == '\\' || val == '"') {
-					char buf[16];
-					buf[0] = '\\';
-					buf[1] = 'u';
-					for (int k=0;k<4;k++)
-						buf[2+k] = hex[(val >> 4*(3-k)) & 0xf];
-					buf[6] = 0;
-					ss << buf;
+		namespace
+		{
+			struct binary_aux
+			{
+				const char *path;
+				type_handler_i *th;
+				instance_t obj;
+			};
+
+			// collects the aux objects under base, each once. unlike auxwriter it never modifies
+			// the objects, ones that can't be found are left out.
+			struct binary_auxwriter : public depwalker_i
+			{
+				db::snapshot *ref_source;
+				const char *base;
+				size_t base_len;
+				instance_t start;
+				std::vector<binary_aux> found;
+
+				virtual bool pointer_pre(instance_t *on, const char *ptr_type)
+				{
+					if (!*on || *on == start)
+						return false;
+
+					const char *path = db::pathof(ref_source, *on);
+					if (!path || strncmp(path, base, base_len) || path[base_len] != '#')
+						return false;
+
+					// the snapshot hands out one string per path.
+					for (size_t i=0;i!=found.size();i++)
+					{
+						if (found[i].path == path)
+							return false;
+					}
+
+					binary_aux a;
+					a.path = path;
+					if (db::fetch(ref_source, path, &a.th, &a.obj))
+						found.push_back(a);
+					return false;
 				}
-				else
+			};
+		}
+
+		void write_object_binary(putki::sstream & out, db::snapshot *ref_source, const char *path, type_handler_i *th, instance_t obj)
+		{
+			binary_auxwriter aw;
+			aw.ref_source = ref_source;
+			aw.base = path;
+			aw.base_len = strlen(path);
+			aw.start = obj;
+			putki::walk_dependencies(th, obj, &aw, false);
+			for (size_t i=0;i!=aw.found.size();i++)
+			{
+				aw.reset_visited();
+				putki::walk_dependencies(aw.found[i].th, aw.found[i].obj, &aw, false);
+			}
+
+			std::vector<type_handler_i *> types;
+			types.push_back(th);
+			std::vector<unsigned int> type_index(aw.found.size());
+			for (size_t i=0;i!=aw.found.size();i++)
+			{
+				size_t t = 0;
+				while (t != types.size() && types[t] != aw.found[i].th)
+					t++;
+				if (t == types.size())
+					types.push_back(aw.found[i].th);
+				type_index[i] = (unsigned int) t;
+			}
+
+			binary::write_u32(out, BINARY_MAGIC);
+			binary::write_u32(out, BINARY_VERSION);
+			binary::write_u32(out, (uint32_t) types.size());
+			for (size_t t=0;t!=types.size();t++)
+			{
+				binary::write_str(out, types[t]->name());
+				binary::write_u32(out, types[t]->binary_signature());
+			}
+
+			binary::write_u32(out, (uint32_t) (aw.found.size() + 1));
+			binary::write_str(out, "");
+			binary::write_u32(out, 0);
+			th->write_binary(ref_source, obj, out);
+			for (size_t i=0;i!=aw.found.size();i++)
+			{
+				binary::write_str(out, aw.found[i].path + aw.base_len);
+				binary::write_u32(out, type_index[i]);
+				aw.found[i].th->write_binary(ref_source, aw.found[i].obj, out);
+			}
+		}
+
+		namespace
+		{
+			static const char *hex = "0123456789abcdef";
+
+			inline bool json_needs_escape(char c)
+			{
+				return (unsigned char)c < 0x20 || c == '\\' || c == '"';
+			}
+
+			inline unsigned int lowest_bit(unsigned int mask)
+			{
+#if defined(_MSC_VER)
+				unsigned long idx;
+				_BitScanForward(&idx, mask);
+				return (unsigned int) idx;
+#else
+				return (unsigned int) __builtin_ctz(mask);
+#endif
+			}
+
+			// how much of str can be copied out without escaping.
+			size_t json_plain_length(const char *str, size_t len)
+			{
+				size_t i = 0;
+#if defined(PUTKI_WRITE_SSE2)
+				const __m128i quote = _mm_set1_epi8('"');
+				const __m128i backslash = _mm_set1_epi8('\\');
+				const __m128i control = _mm_set1_epi8(0x1f);
+				for (;i + 16 <= len;i += 16)
+				{
+					const __m128i v = _mm_loadu_si128((const __m128i *)(str + i));
+					const __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+					                                 _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+					const int mask = _mm_movemask_epi8(hit);
+					if (mask)
+						return i + lowest_bit((unsigned int) mask);
+				}
+#endif
+				for (;i != len;i++)
+				{
+					if (json_needs_escape(str[i]))
+						break;
+				}
+				return i;
+			}
+		}
+
+		void json_string(putki::sstream & out, const char *str, size_t len)
+		{
+			out.need_x_more(len + 2);
+			out << '"';
+			while (true)
+			{
+				const size_t plain = json_plain_length(str, len);
+				out.write(str, plain);
+				if (plain == len)
+					break;
+
+				const char c = str[plain];
+				const char esc[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf] };
+				out.write(esc, 6);
+				str += plain + 1;
+				len -= plain + 1;
+			}
+			out << '"';
+		}
+
+		void json_string(putki::sstream & out, const char *str)
+		{
+			if (!str)
+				str = "";
+			json_string(out, str, strlen(str));
+		}
+
+		void json_stringencode_byte_array(putki::sstream & out, std::vector<unsigned char> const &bytes)
+		{
+			char buf[256];
+			size_t fill = 0;
+			for (size_t i=0;i!=bytes.size();i++)
+			{
+				buf[fill++] = (char)('a' + ((bytes[i] >> 4) & 0xf));
+				buf[fill++] = (char)('a' + ((bytes[i]) & 0xf));
+				if (fill == sizeof(buf))
 				{
-					ss << val;
+					out.write(buf, fill);
+					fill = 0;
 				}
 			}
-			ss << "\"";
-			return ss.c_str();
+			out.write(buf, fill);
+		}
+
+		std::string json_str(const char *input)
+		{
+			putki::sstream ss;
+			json_string(ss, input);
+			return std::string(ss.c_str(), ss.size());
 		}
 
 		const char *json_indent(char *buf, int level)
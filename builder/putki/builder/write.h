@@ -4,22 +4,107 @@
 #include <vector>
 #include <string>
 
+#include <putki/sys/sstream.h>
+
 namespace putki
 {
-	namespace db { struct data; }
+	namespace db { struct data; struct snapshot; }
 
-	struct sstream;
 	struct type_handler_i;
 	typedef void* instance_t;
 
 	namespace write
 	{
-		void write_object_into_stream(putki::sstream & out, db::data *ref_source, type_handler_i *th, instance_t obj);
+		void write_object_into_stream(putki::sstream & out, db::data *ref_source, type_handler_i *th, instance_t obj, bool compact = false);
 		std::string json_str(const char *input);
 		const char *json_indent(char *buf, int level);
 		void json_stringencode_byte_array(putki::sstream & out, std::vector<unsigned char> const &bytes);
+
+		// json written straight into the stream, used by the generated write_json. levels are the
+		// indentation; below zero means compact output without line breaks or indentation, and it
+		// starts far enough down to stay there however deep the nesting goes.
+		const int JSON_COMPACT = -0x10000;
+
+		// quoted and escaped, 0 is written as an empty string.
+		void json_string(putki::sstream & out, const char *str, size_t len);
+		void json_string(putki::sstream & out, const char *str);
+
+		inline void json_string(putki::sstream & out, std::string const & str)
+		{
+			json_string(out, str.c_str(), str.size());
+		}
+
+		inline void json_indent(putki::sstream & out, int level)
+		{
+			static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+			for (;level > 0;level -= 16)
+				out.write(tabs, level < 16 ? level : 16);
+		}
+
+		// quoted_key comes with its quotes.
+		inline void json_key(putki::sstream & out, int level, const char *quoted_key, size_t len)
+		{
+			json_indent(out, level);
+			out.write(quoted_key, len);
+			if (level < 0)
+				out << ':';
+			else
+				out.write(": ", 2);
+		}
+
+		inline void json_field_end(putki::sstream & out, int level, bool more)
+		{
+			if (more)
+				out << ',';
+			if (level >= 0)
+				out << '\n';
+		}
+
+		// between array elements.
+		inline void json_delim(putki::sstream & out, int level)
+		{
+			if (level < 0)
+				out << ',';
+			else
+				out.write(", ", 2);
+		}
+
+		inline void json_open(putki::sstream & out, int level)
+		{
+			if (level < 0)
+				out << '{';
+			else
+				out.write("{\n", 2);
+		}
+
+		inline void json_close(putki::sstream & out, int level)
+		{
+			json_indent(out, level);
+			out << '}';
+		}
+
+		// streams to write objects into, kept around and handed out again so the buffers don't
+		// have to grow from nothing for every object.
+		putki::sstream * acquire_stream();
+		void release_stream(putki::sstream *stream);
+
+		struct scoped_stream
+		{
+			putki::sstream *stream;
+			scoped_stream() : stream(acquire_stream()) { }
+			~scoped_stream() { release_stream(stream); }
+		};
 		
 		bool write_object_to_fs(const char *basedir, const char *path, db::data *ref_source, type_handler_i *th, instance_t obj, char *fn_out);
+
+		// binary form of write_object_into_stream, for the built object cache. only reads the
+		// snapshot so any number of objects can be written at once.
+		void write_object_binary(putki::sstream & out, db::snapshot *ref_source, const char *path, type_handler_i *th, instance_t obj);
+
+		// file header of the binary form; the type table holds name and binary_signature of each
+		// object type in the file.
+		const unsigned int BINARY_MAGIC = 0x424b5450; // PTKB
+		const unsigned int BINARY_VERSION = 1;
 	}
 }
 
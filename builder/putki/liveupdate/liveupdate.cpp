@@ -163,7 +163,8 @@ namespace putki
 				return;
 			}
 			
-			sstream tmp;
+			write::scoped_stream buf;
+			sstream & tmp = *buf.stream;
 			write::write_object_into_stream(tmp, db, th, obj);
 			const char *str = tmp.c_str();
 
@@ -747,7 +748,11 @@ namespace putki
 					
 					APP_INFO("Package is " << bytes << " bytes")
 
-					if (send(ptr->socket, buf, bytes, 0) != bytes)
+					if (bytes < 0)
+					{
+						APP_ERROR("Could not write package for " << tobuild)
+					}
+					else if (send(ptr->socket, buf, bytes, 0) != bytes)
 					{
 						// broken pipe
 						APP_INFO("Failed to write all data, socket was closed?")
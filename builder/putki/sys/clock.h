@@ -0,0 +1,41 @@
+#ifndef __SYS_CLOCK_H__
+#define __SYS_CLOCK_H__
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace putki
+{
+	namespace sys
+	{
+		// monotonic time in microseconds, for measuring intervals only.
+		inline long long time_us()
+		{
+#if defined(_WIN32)
+			LARGE_INTEGER freq, now;
+			QueryPerformanceFrequency(&freq);
+			QueryPerformanceCounter(&now);
+			return (long long)(now.QuadPart / (freq.QuadPart / 1000000.0));
+#else
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+		}
+
+		inline void sleep_ms(unsigned int ms)
+		{
+#if defined(_WIN32)
+			Sleep(ms);
+#else
+			usleep(ms * 1000);
+#endif
+		}
+	}
+}
+
+#endif
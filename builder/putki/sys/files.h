@@ -9,6 +9,13 @@ namespace putki
 		{
 			long long mtime;
 			long long size;
+			// sub-second part of mtime in nanoseconds, 0 where the file system has no such thing.
+			long long mtime_ns;
+			// which file it is, a file replaced by a rename gets a new one.
+			unsigned long long dev;
+			unsigned long long ino;
+			// number of hard links to the file.
+			long long links;
 		};
 		
 		typedef void (*file_enum_t) (const char *fullname, const char *name, void *userptr);
@@ -17,6 +24,17 @@ namespace putki
 		void search_tree(const char *root_directory, file_enum_t callback, void *userptr);
 		void mk_dir_for_path(const char *path);
 		bool write_file(const char *path, const char *str, unsigned long size);
+		// false if there was no such file.
+		bool remove_file(const char *path);
+		// make dst refer to the same file as src (hard link), replacing dst if it exists.
+		bool link_file(const char *src, const char *dst);
+		// true if both paths refer to the same file on disk.
+		bool same_file(const char *a, const char *b);
+
+		// read-only memory mapping of a whole file.
+		struct mapped_file;
+		mapped_file* map_file(const char *path, const char **bytes, long long *size);
+		void unmap_file(mapped_file *mf);
 
 		void chdir_push(const char *path);
 		void chdir_pop();
@@ -11,6 +11,7 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 
 namespace putki
 {
@@ -36,6 +37,14 @@ namespace putki
 			{
 				out->mtime = tmp.st_mtime;
 				out->size = tmp.st_size;
+#if defined(__APPLE__)
+				out->mtime_ns = tmp.st_mtimespec.tv_nsec;
+#else
+				out->mtime_ns = tmp.st_mtim.tv_nsec;
+#endif
+				out->dev = (unsigned long long) tmp.st_dev;
+				out->ino = (unsigned long long) tmp.st_ino;
+				out->links = (long long) tmp.st_nlink;
 				return true;
 			}
 			return false;
@@ -111,6 +120,75 @@ namespace putki
 			close(fd);		
 			return true;
 		}
+
+		bool remove_file(const char *path)
+		{
+			return unlink(path) == 0;
+		}
+
+		bool link_file(const char *src, const char *dst)
+		{
+			unlink(dst);
+			return link(src, dst) == 0;
+		}
+
+		bool same_file(const char *a, const char *b)
+		{
+			struct ::stat sa, sb;
+			if (::stat(a, &sa) || ::stat(b, &sb))
+				return false;
+			return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+		}
+
+		struct mapped_file
+		{
+			void *addr;
+			size_t size;
+		};
+
+		mapped_file* map_file(const char *path, const char **bytes, long long *size)
+		{
+			int fd = open(path, O_RDONLY);
+			if (fd == -1)
+				return 0;
+
+			struct ::stat st;
+			if (fstat(fd, &st))
+			{
+				close(fd);
+				return 0;
+			}
+
+			mapped_file *mf = new mapped_file();
+			mf->size = (size_t) st.st_size;
+			mf->addr = 0;
+
+			if (mf->size > 0)
+			{
+				mf->addr = mmap(0, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mf->addr == MAP_FAILED)
+				{
+					close(fd);
+					delete mf;
+					return 0;
+				}
+			}
+
+			// the mapping stays valid after the descriptor is gone.
+			close(fd);
+
+			static const char empty = 0;
+			*bytes = mf->addr ? (const char *) mf->addr : &empty;
+			*size = (long long) mf->size;
+			return mf;
+		}
+
+		void unmap_file(mapped_file *mf)
+		{
+			if (mf->addr)
+				munmap(mf->addr, mf->size);
+			delete mf;
+		}
 	}
 }
 
@@ -84,6 +84,88 @@ namespace putki
 			return wmWritten == size;
 		}
 
+		bool remove_file(const char *path)
+		{
+			return DeleteFile(path) != 0;
+		}
+
+		bool link_file(const char *src, const char *dst)
+		{
+			DeleteFile(dst);
+			return CreateHardLink(dst, src, NULL) != 0;
+		}
+
+		bool same_file(const char *a, const char *b)
+		{
+			BY_HANDLE_FILE_INFORMATION ia, ib;
+			bool ok = false;
+			HANDLE ha = CreateFile(a, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			HANDLE hb = CreateFile(b, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (ha != INVALID_HANDLE_VALUE && hb != INVALID_HANDLE_VALUE &&
+			    GetFileInformationByHandle(ha, &ia) && GetFileInformationByHandle(hb, &ib))
+			{
+				ok = ia.dwVolumeSerialNumber == ib.dwVolumeSerialNumber &&
+				     ia.nFileIndexHigh == ib.nFileIndexHigh &&
+				     ia.nFileIndexLow == ib.nFileIndexLow;
+			}
+			if (ha != INVALID_HANDLE_VALUE) CloseHandle(ha);
+			if (hb != INVALID_HANDLE_VALUE) CloseHandle(hb);
+			return ok;
+		}
+
+		struct mapped_file
+		{
+			HANDLE mapping;
+			const void *view;
+		};
+
+		mapped_file* map_file(const char *path, const char **bytes, long long *size)
+		{
+			HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (hFile == INVALID_HANDLE_VALUE)
+				return 0;
+
+			LARGE_INTEGER sz;
+			if (!GetFileSizeEx(hFile, &sz))
+			{
+				CloseHandle(hFile);
+				return 0;
+			}
+
+			mapped_file *mf = new mapped_file();
+			mf->mapping = 0;
+			mf->view = 0;
+
+			if (sz.QuadPart > 0)
+			{
+				mf->mapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (mf->mapping)
+					mf->view = MapViewOfFile(mf->mapping, FILE_MAP_READ, 0, 0, 0);
+
+				if (!mf->view)
+				{
+					if (mf->mapping) CloseHandle(mf->mapping);
+					CloseHandle(hFile);
+					delete mf;
+					return 0;
+				}
+			}
+
+			CloseHandle(hFile);
+
+			static const char empty = 0;
+			*bytes = mf->view ? (const char *) mf->view : &empty;
+			*size = (long long) sz.QuadPart;
+			return mf;
+		}
+
+		void unmap_file(mapped_file *mf)
+		{
+			if (mf->view) UnmapViewOfFile(mf->view);
+			if (mf->mapping) CloseHandle(mf->mapping);
+			delete mf;
+		}
+
 		bool stat(const char *path, file_info *out)
 		{
 			struct ::stat tmp;
@@ -91,6 +173,28 @@ namespace putki
 			{
 				out->mtime = tmp.st_mtime;
 				out->size = tmp.st_size;
+				out->mtime_ns = 0;
+				out->dev = 0;
+				out->ino = 0;
+				out->links = 1;
+
+				// st_ino is always 0 here, the file index and write time come from the handle.
+				HANDLE h = CreateFile(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+				if (h != INVALID_HANDLE_VALUE)
+				{
+					BY_HANDLE_FILE_INFORMATION fi;
+					if (GetFileInformationByHandle(h, &fi))
+					{
+						ULARGE_INTEGER wt;
+						wt.LowPart = fi.ftLastWriteTime.dwLowDateTime;
+						wt.HighPart = fi.ftLastWriteTime.dwHighDateTime;
+						out->mtime_ns = (long long)(wt.QuadPart % 10000000) * 100;
+						out->dev = fi.dwVolumeSerialNumber;
+						out->ino = ((unsigned long long) fi.nFileIndexHigh << 32) | fi.nFileIndexLow;
+						out->links = fi.nNumberOfLinks;
+					}
+					CloseHandle(h);
+				}
 				return true;
 			}
 			return false;
@@ -193,6 +193,14 @@ namespace putki
 			return *this;
 		}
 
+		inline sstream & write(const void *data, size_t size)
+		{
+			need_x_more(size);
+			memcpy(_writeptr, data, size);
+			_writeptr += size;
+			return *this;
+		}
+
 		template<typename T>
 		inline sstream & hex(T val)
 		{
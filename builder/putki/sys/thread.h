@@ -35,6 +35,27 @@ namespace putki
 			delete thr;
 		}
 		
+		// returns the new value
+		inline int atomic_inc(volatile int *v)
+		{
+			return __sync_add_and_fetch(v, 1);
+		}
+
+		inline int atomic_dec(volatile int *v)
+		{
+			return __sync_sub_and_fetch(v, 1);
+		}
+
+		inline bool atomic_cas(volatile int *v, int expected, int value)
+		{
+			return __sync_bool_compare_and_swap(v, expected, value);
+		}
+
+		inline void memory_barrier()
+		{
+			__sync_synchronize();
+		}
+
 		struct mutex
 		{
 			mutex()
@@ -45,6 +45,27 @@ namespace putki
 			delete thr;
 		}
 
+		// returns the new value
+		inline int atomic_inc(volatile int *v)
+		{
+			return (int)InterlockedIncrement((volatile LONG*)v);
+		}
+
+		inline int atomic_dec(volatile int *v)
+		{
+			return (int)InterlockedDecrement((volatile LONG*)v);
+		}
+
+		inline bool atomic_cas(volatile int *v, int expected, int value)
+		{
+			return InterlockedCompareExchange((volatile LONG*)v, value, expected) == expected;
+		}
+
+		inline void memory_barrier()
+		{
+			MemoryBarrier();
+		}
+
 		struct mutex
 		{	
 			mutex()
@@ -851,6 +851,7 @@ public class Compiler
 		CppGenerator.generateInkiImplementation(c, writer);
 		CppGenerator.generateOutkiHeader(c, writer);
 		CppGenerator.generateOutkiImplementation(c, writer);
+		CppGenerator.generateNetkiHeader(c, writer);
 		writer.write();
 	}
 }
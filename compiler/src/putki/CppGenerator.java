@@ -308,6 +308,39 @@ public class CppGenerator
 			return outkiFieldType(p, pf);
 	}
 
+	static String netkiFieldType(Compiler.ParsedField pf)
+	{
+		switch (pf.type)
+		{
+			case STRUCT_INSTANCE:
+				return structName(pf.resolvedRefStruct);
+			case ENUM:
+				return enumName(pf.resolvedEnum);
+			case STRING:
+				return "std::string";
+			default:
+				return ouktiFieldtypePod(pf.type);
+		}
+	}
+
+	// netki packets carry no paths, files or pointers; the C# generator skips them as well.
+	static boolean isNetkiField(Compiler.ParsedField pf)
+	{
+		return pf.type != FieldType.FILE && pf.type != FieldType.PATH && pf.type != FieldType.POINTER;
+	}
+
+	// int arrays go through the bulk compressed int calls, same bits as one value at a time.
+	static String netkiBulkArray(Compiler.ParsedField pf)
+	{
+		if (!pf.isArray)
+			return null;
+		if (pf.type == FieldType.UINT32)
+			return "compressed_ints";
+		if (pf.type == FieldType.INT32)
+			return "compressed_signed_ints";
+		return null;
+	}
+
 	static String getTypeHandler(Compiler.ParsedStruct struct)
 	{
 		return "type_" + struct.uniqueId + "_" + withUnderscore(struct.name) + "_handler";
@@ -558,6 +591,21 @@ public class CppGenerator
 		sb.append(prefix).append("};");
 	}
 
+	// Arrays whose inki element type has the same size and representation as the outki one.
+	static boolean isBulkPackable(Compiler.ParsedField field)
+	{
+		switch (field.type)
+		{
+			case BYTE:
+			case INT32:
+			case UINT32:
+			case FLOAT:
+				return true;
+			default:
+				return false;
+		}
+	}
+
 	public static void writeInkiOutkiFns(Compiler comp, Platform runtime, StringBuilder sb, Compiler.ParsedStruct struct, String prefix)
 	{
 		String inkiSn = "inki::" + structName(struct);
@@ -581,6 +629,25 @@ public class CppGenerator
 				continue;
 			}
 
+			if (field.isArray && isBulkPackable(field))
+			{
+				// same element layout in and out, one bounds checked copy instead of the element loop.
+				String szExpr = refIn + ".size()";
+				String outType = inkiOutkiFieldtype(runtime, field);
+				sb.append(indent).append("{");
+				sb.append(indent).append("\t" + refOut + " = 0;");
+				sb.append(indent).append("\t" + refOut + "_size = (" + outkiArraySizeType(runtime) + ")" + szExpr +";");
+				sb.append(indent).append("\tif (!" + refIn + ".empty())");
+				sb.append(indent).append("\t{");
+				// floats are copied in host order like the single float fields, integers go out little endian.
+				String packFn = field.type == FieldType.FLOAT ? "putki::pack_pod_array_host_order" : "putki::pack_pod_array";
+				sb.append(indent).append("\t\tout_beg = " + packFn + "(out_beg, out_end, &" + refIn + "[0], " + szExpr + ", sizeof(" + outType + "));");
+				sb.append(indent).append("\t\tif (!out_beg) return 0;");
+				sb.append(indent).append("\t}");
+				sb.append(indent).append("}");
+				continue;
+			}
+
 			if (field.isArray)
 			{
 				String szExpr = refIn + ".size()";
@@ -588,6 +655,7 @@ public class CppGenerator
 				sb.append(indent).append("{");
 				sb.append(indent).append("\t" + refOut + " = 0;");
 				sb.append(indent).append("\t" + refOut + "_size = (" + outkiArraySizeType(runtime) + ")" + szExpr +";");
+				sb.append(indent).append("\tif ((size_t)(out_end - out_beg) < " + szExpr + " * sizeof(" + outType + ")) return 0;");
 				sb.append(indent).append("\t" + outType + "* outp = reinterpret_cast<" + outType + "*>(out_beg);");
 				sb.append(indent).append("\tout_beg += " + szExpr + " * sizeof(" + outType + ");");
 				sb.append(indent).append("\tfor (size_t i=0;i<" + szExpr + ";i++)");
@@ -617,9 +685,11 @@ public class CppGenerator
 				case PATH:
 				case STRING:
 					sb.append(indent).append("out_beg = putki::pack_string_field(" + runtime.ptrSize + ", (char*)&" + refOut + ", " + refIn + ".c_str(), out_beg, out_end);");
+					sb.append(indent).append("if (!out_beg) return 0;");
 					break;
 				case STRUCT_INSTANCE:
 					sb.append(indent).append("out_beg = " + writeAux(field.resolvedRefStruct) + "(&" + refIn + ", &" + refOut + ", out_beg, out_end);");
+					sb.append(indent).append("if (!out_beg) return 0;");
 					break;
 				default:
 					break;
@@ -651,12 +721,460 @@ public class CppGenerator
 		for (int i=parents.size()-1;i>=0;i--)
 		{
 			sb.append(p0).append("out_beg = " + writeAux(parents.get(i)) +"(in, d, out_beg, out_end);");
+			sb.append(p0).append("if (!out_beg) return 0;");
 		}
 
 		sb.append(p0).append("return " + writeAux(struct) +"(in, d, out_beg, out_end);");
 		sb.append(prefix).append("}");
 	}
 
+	static String layoutName(Compiler.ParsedStruct struct)
+	{
+		return "s_layout_" + struct.uniqueId + "_" + withUnderscore(struct.name);
+	}
+
+	// Pointer and struct instance fields of the whole hierarchy, root first, in the
+	// same order walk_dependencies visits them.
+	public static void writeInkiLayout(StringBuilder sb, Compiler.ParsedStruct struct, String prefix)
+	{
+		ArrayList<Compiler.ParsedStruct> chain = new ArrayList<Compiler.ParsedStruct>();
+		for (Compiler.ParsedStruct s = struct; s != null; s = s.resolvedParent)
+		{
+			chain.add(0, s);
+		}
+
+		String sn = structName(struct);
+		String fieldsName = layoutName(struct) + "_fields";
+		int count = 0;
+
+		for (Compiler.ParsedStruct owner : chain)
+		{
+			boolean inputOnly = (owner.domains & Compiler.DOMAIN_OUTPUT) == 0;
+			for (Compiler.ParsedField field : owner.fields)
+			{
+				if (field.isBuildConfig || field.isParentField)
+				{
+					continue;
+				}
+				if (field.type != FieldType.POINTER && field.type != FieldType.STRUCT_INSTANCE)
+				{
+					continue;
+				}
+
+				if (count == 0)
+				{
+					sb.append(prefix).append("const putki::type_layout_field " + fieldsName + "[] = {");
+				}
+				else
+				{
+					sb.append(",");
+				}
+
+				String et = putkiFieldType(field);
+				String kind = field.type == FieldType.POINTER ? "putki::type_layout_field::POINTER" : "putki::type_layout_field::STRUCT_INSTANCE";
+				String range = field.isArray ? "&putki::layout_vector_range<" + et + " >" : "0";
+				String ptrType = field.type == FieldType.POINTER ? "\"" + field.resolvedRefStruct.name + "\"" : "0";
+
+				sb.append(prefix).append("\t{ " + kind + ", PUTKI_FIELD_OFFSET(" + sn + ", " + fieldName(field) + "), " + range + ", sizeof(" + et + "), ");
+				sb.append(ptrType + ", &" + getTypeHandlerFn(field.resolvedRefStruct) + ", " + (inputOnly ? "true" : "false") + " }");
+				count++;
+			}
+		}
+
+		if (count > 0)
+		{
+			sb.append(prefix).append("};");
+		}
+
+		String rtti = (struct.isTypeRoot || struct.resolvedParent != null) ? "(int) PUTKI_FIELD_OFFSET(" + sn + ", " + rttiField() + ")" : "-1";
+		sb.append(prefix).append("const putki::type_layout " + layoutName(struct) + " = { " + (count > 0 ? fieldsName : "0") + ", " + count + ", " + rtti + " };");
+	}
+
+	// FNV-1a as computed by putki::parse::key_hash.
+	static int fieldKeyHash(String name, int seed)
+	{
+		int h = 0x811c9dc5 ^ seed;
+		for (byte b : name.getBytes(java.nio.charset.StandardCharsets.UTF_8))
+		{
+			h ^= (b & 0xff);
+			h *= 16777619;
+		}
+		return h;
+	}
+
+	// Input fields of this level of the hierarchy; parent fields are dispatched from the nested 'parent' object.
+	static ArrayList<Compiler.ParsedField> fillFields(Compiler.ParsedStruct struct)
+	{
+		ArrayList<Compiler.ParsedField> res = new ArrayList<Compiler.ParsedField>();
+		if ((struct.domains & Compiler.DOMAIN_INPUT) == 0)
+			return res;
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (field.isBuildConfig)
+				continue;
+			if (field.isParentField && fillFields(struct.resolvedParent).isEmpty())
+				continue;
+			res.add(field);
+		}
+		return res;
+	}
+
+	// Smallest seed that gives every field name a distinct hash, so the names can be switch cases.
+	static int fieldKeySeed(ArrayList<Compiler.ParsedField> fields)
+	{
+		for (int seed = 0;; seed++)
+		{
+			java.util.HashSet<Integer> seen = new java.util.HashSet<Integer>();
+			boolean ok = true;
+			for (Compiler.ParsedField field : fields)
+			{
+				if (!seen.add(fieldKeyHash(field.name, seed)))
+				{
+					ok = false;
+					break;
+				}
+			}
+			if (ok)
+				return seed;
+		}
+	}
+
+	static String hexConstant(int v)
+	{
+		return String.format("0x%08xu", v);
+	}
+
+	// Field layout as the binary cache sees it, hashed into binary_signature. Nested structs
+	// and enum values are part of it since they change what the bytes mean.
+	static void binaryLayout(StringBuilder sb, Compiler.ParsedStruct struct)
+	{
+		sb.append(struct.name).append("{");
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (field.isBuildConfig)
+				continue;
+			sb.append(field.name).append(":").append(field.type.name());
+			if (field.isArray)
+				sb.append("[]");
+			if (field.type == FieldType.STRUCT_INSTANCE)
+				binaryLayout(sb, field.resolvedRefStruct);
+			else if (field.type == FieldType.ENUM)
+			{
+				for (Compiler.EnumValue v : field.resolvedEnum.values)
+					sb.append(v.name).append("=").append(v.value).append(",");
+			}
+			sb.append(";");
+		}
+		sb.append("}");
+	}
+
+	static int binarySignature(Compiler.ParsedStruct struct)
+	{
+		StringBuilder sb = new StringBuilder();
+		binaryLayout(sb, struct);
+		return fieldKeyHash(sb.toString(), 0);
+	}
+
+	// write_binary / read_binary / binary_signature of the type handler. Fields go in declaration
+	// order with the parent's inline, the same set write_json writes.
+	public static void writeBinaryFns(StringBuilder sb, Compiler.ParsedStruct struct, String prefix)
+	{
+		String sn = structName(struct);
+		String p1 = prefix + "\t";
+
+		ArrayList<Compiler.ParsedField> fields = new ArrayList<Compiler.ParsedField>();
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (!field.isBuildConfig)
+				fields.add(field);
+		}
+
+		sb.append(prefix).append("unsigned int binary_signature() { return " + hexConstant(binarySignature(struct)) + "; }");
+
+		sb.append(prefix).append("void write_binary(putki::db::snapshot *ref_source, putki::instance_t source, putki::sstream & out) {");
+		if (!fields.isEmpty())
+			sb.append(p1).append(sn + "* obj = (" + sn + "*) source;");
+		for (Compiler.ParsedField field : fields)
+			writeBinaryField(sb, field, p1);
+		sb.append(prefix).append("}");
+
+		sb.append(prefix).append("void read_binary(putki::binary::reader *in, putki::instance_t target_, putki::load_resolver_i *resolver) {");
+		if (!fields.isEmpty())
+			sb.append(p1).append(sn + "* target = (" + sn + "*) target_;");
+		for (Compiler.ParsedField field : fields)
+			readBinaryField(sb, field, p1);
+		sb.append(prefix).append("}");
+	}
+
+	static void writeBinaryField(StringBuilder sb, Compiler.ParsedField field, String prefix)
+	{
+		String ref = "obj->" + fieldName(field);
+		String indent = prefix;
+
+		if (field.isParentField)
+		{
+			sb.append(prefix).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->write_binary(ref_source, obj, out);");
+			return;
+		}
+
+		if (field.isArray && field.type == FieldType.BYTE)
+		{
+			sb.append(prefix).append("putki::binary::write_bytes(out, " + ref + ");");
+			return;
+		}
+
+		if (field.isArray)
+		{
+			sb.append(prefix).append("putki::binary::write_u32(out, (uint32_t) " + ref + ".size());");
+			sb.append(prefix).append("for (size_t i=0;i<" + ref + ".size();i++)");
+			sb.append(prefix).append("{");
+			ref = ref + "[i]";
+			indent = prefix + "\t";
+		}
+
+		switch (field.type)
+		{
+			case STRING:
+			case FILE:
+			case PATH:
+				sb.append(indent).append("putki::binary::write_str(out, " + ref + ");");
+				break;
+			case INT32:
+			case UINT32:
+			case ENUM:
+				sb.append(indent).append("putki::binary::write_u32(out, (uint32_t) " + ref + ");");
+				break;
+			case FLOAT:
+				sb.append(indent).append("putki::binary::write_float(out, " + ref + ");");
+				break;
+			case BYTE:
+				sb.append(indent).append("putki::binary::write_byte(out, " + ref + ");");
+				break;
+			case BOOL:
+				sb.append(indent).append("putki::binary::write_byte(out, " + ref + " ? 1 : 0);");
+				break;
+			case POINTER:
+				sb.append(indent).append("putki::binary::write_str(out, putki::db::pathof_including_unresolved(ref_source, " + ref + "));");
+				break;
+			case STRUCT_INSTANCE:
+				sb.append(indent).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->write_binary(ref_source, &" + ref + ", out);");
+				break;
+			default:
+				break;
+		}
+
+		if (field.isArray)
+			sb.append(prefix).append("}");
+	}
+
+	static void readBinaryField(StringBuilder sb, Compiler.ParsedField field, String prefix)
+	{
+		String ref = "target->" + fieldName(field);
+		String indent = prefix;
+
+		if (field.isParentField)
+		{
+			sb.append(prefix).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->read_binary(in, target, resolver);");
+			return;
+		}
+
+		if (field.isArray && field.type == FieldType.BYTE)
+		{
+			sb.append(prefix).append("putki::binary::read_bytes(in, " + ref + ");");
+			return;
+		}
+
+		if (field.isArray)
+		{
+			sb.append(prefix).append("{");
+			sb.append(prefix).append("\tconst uint32_t count = putki::binary::read_count(in);");
+			sb.append(prefix).append("\t" + ref + ".resize(count);");
+			sb.append(prefix).append("\tfor (uint32_t i=0;i!=count;i++)");
+			sb.append(prefix).append("\t{");
+			ref = ref + "[i]";
+			indent = prefix + "\t\t";
+		}
+
+		switch (field.type)
+		{
+			case STRING:
+			case FILE:
+			case PATH:
+				sb.append(indent).append("putki::binary::read_str(in, " + ref + ");");
+				break;
+			case INT32:
+			case UINT32:
+			case ENUM:
+				sb.append(indent).append(ref + " = (" + putkiFieldType(field) + ") putki::binary::read_u32(in);");
+				break;
+			case FLOAT:
+				sb.append(indent).append(ref + " = putki::binary::read_float(in);");
+				break;
+			case BYTE:
+				sb.append(indent).append(ref + " = putki::binary::read_byte(in);");
+				break;
+			case BOOL:
+				sb.append(indent).append(ref + " = putki::binary::read_byte(in) != 0;");
+				break;
+			case POINTER:
+				sb.append(indent).append("{");
+				sb.append(indent).append("\tconst char *str = putki::binary::read_cstr(in);");
+				sb.append(indent).append("\tif (!str[0])");
+				sb.append(indent).append("\t\t" + ref + " = 0;");
+				sb.append(indent).append("\telse");
+				sb.append(indent).append("\t\tresolver->resolve_pointer((putki::instance_t *)&" + ref + ", str);");
+				sb.append(indent).append("}");
+				break;
+			case STRUCT_INSTANCE:
+				sb.append(indent).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->read_binary(in, &" + ref + ", resolver);");
+				break;
+			default:
+				break;
+		}
+
+		if (field.isArray)
+		{
+			sb.append(prefix).append("\t}");
+			sb.append(prefix).append("}");
+		}
+	}
+
+	// One pass over the members of the parsed object, dispatching on the key hash. Parent
+	// fields are filled inline from the nested 'parent' object instead of going through
+	// the parent's type handler.
+	public static void writeFillMembers(StringBuilder sb, Compiler.ParsedStruct struct, String nodeVar, String prefix, int depth)
+	{
+		ArrayList<Compiler.ParsedField> fields = fillFields(struct);
+		if (fields.isEmpty())
+			return;
+
+		int seed = fieldKeySeed(fields);
+		String m = "m" + depth;
+		String count = "count" + depth;
+		String key = "key" + depth;
+		String value = "value" + depth;
+		String p1 = prefix + "\t";
+		String p2 = prefix + "\t\t";
+		String p3 = prefix + "\t\t\t";
+
+		// arrays missing from the object end up empty, as when every field was looked up by name.
+		// byte arrays were left alone by parse_stringencoded_byte_array and still are.
+		for (Compiler.ParsedField field : fields)
+		{
+			if (field.isArray && !field.isParentField && field.type != FieldType.BYTE)
+				sb.append(prefix).append("target->" + fieldName(field) + ".clear();");
+		}
+
+		sb.append(prefix).append("for (size_t " + m + "=0, " + count + "=putki::parse::get_object_size(" + nodeVar + ");" + m + "!=" + count + ";" + m + "++)");
+		sb.append(prefix).append("{");
+		sb.append(p1).append("putki::parse::node *" + key + " = putki::parse::get_object_key(" + nodeVar + ", " + m + ");");
+		sb.append(p1).append("putki::parse::node *" + value + " = putki::parse::get_object_value(" + nodeVar + ", " + m + ");");
+		sb.append(p1).append("switch (putki::parse::get_key_hash(" + key + ", " + seed + "u))");
+		sb.append(p1).append("{");
+		for (Compiler.ParsedField field : fields)
+		{
+			sb.append(p2).append("case " + hexConstant(fieldKeyHash(field.name, seed)) + ":");
+			sb.append(p3).append("if (!putki::parse::key_equals(" + key + ", \"" + field.name + "\", " + field.name.getBytes(java.nio.charset.StandardCharsets.UTF_8).length + "))");
+			sb.append(p3).append("\tbreak;");
+			if (field.isParentField)
+				writeFillMembers(sb, struct.resolvedParent, value, p3, depth + 1);
+			else
+				writeFillField(sb, field, "target->" + fieldName(field), value, p3);
+			sb.append(p3).append("break;");
+		}
+		sb.append(p2).append("default:");
+		sb.append(p3).append("break;");
+		sb.append(p1).append("}");
+		sb.append(prefix).append("}");
+	}
+
+	public static void writeFillField(StringBuilder sb, Compiler.ParsedField field, String ref, String node, String prefix)
+	{
+		String indent = prefix;
+		String arrIndent = prefix;
+
+		if (field.isArray)
+		{
+			if (field.type == FieldType.BYTE)
+			{
+				sb.append(prefix).append("if (!putki::parse::parse_stringencoded_byte_array(" + node + ", " + ref + "))");
+				sb.append(prefix).append("{");
+				arrIndent = prefix + "\t";
+			}
+			sb.append(arrIndent).append("{");
+			sb.append(arrIndent).append("\t" + ref + ".clear();");
+			sb.append(arrIndent).append("\tsize_t i = 0;");
+			sb.append(arrIndent).append("\tputki::parse::node *arr = " + node + ";");
+			sb.append(arrIndent).append("\twhile (putki::parse::node * narr = putki::parse::get_array_item(arr, i)) {");
+			sb.append(arrIndent).append("\t\t" + putkiFieldType(field) + " tmp;");
+			sb.append(arrIndent).append("\t\t(void)narr;");
+			sb.append(arrIndent).append("\t\t" + ref + ".push_back(tmp);");
+			sb.append(arrIndent).append("\t\t++i;");
+			sb.append(arrIndent).append("\t}");
+			sb.append(arrIndent).append("\ti = 0;");
+			sb.append(arrIndent).append("\twhile (putki::parse::node * narr = putki::parse::get_array_item(arr, i)) {");
+			sb.append(arrIndent).append("\t\t" + putkiFieldType(field) + " & obj = " + ref + "[i];");
+			ref = "obj";
+			indent = arrIndent + "\t\t";
+			node = "narr";
+		}
+
+		String indent2 = indent + "\t";
+		String indent3 = indent + "\t\t";
+
+		sb.append(indent).append("{");
+		sb.append(indent2).append("putki::parse::node *n = " + node + ";");
+		sb.append(indent2).append("if (n)");
+		sb.append(indent2).append("{");
+
+		switch (field.type)
+		{
+			case STRING:
+			case FILE:
+			case PATH:
+				sb.append(indent3).append(ref + " = putki::parse::get_value_string(n);");
+				break;
+			case FLOAT:
+				sb.append(indent3).append(ref + " = atof(putki::parse::get_value_string(n));");
+				break;
+			case UINT32:
+			case INT32:
+			case BYTE:
+				sb.append(indent3).append(ref + " = (" + putkiFieldtypePod(field.type) + ") putki::parse::get_value_int(n);");
+				break;
+			case BOOL:
+				sb.append(indent3).append(ref + " = putki::parse::get_value_int(n) != 0;");
+				break;
+			case STRUCT_INSTANCE:
+				sb.append(indent3).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->fill_from_parsed(n, &" + ref + ", resolver);");
+				break;
+			case ENUM:
+				sb.append(indent3).append(ref + " = " + enumFromString(field.resolvedEnum) + "(putki::parse::get_value_string(n));");
+				break;
+			case POINTER:
+				sb.append(indent3).append("const char* str = putki::parse::get_value_string(n);");
+				sb.append(indent3).append("if (!str || !str[0])");
+				sb.append(indent3).append("\t" + ref + " = 0;");
+				sb.append(indent3).append("else");
+				sb.append(indent3).append("\tresolver->resolve_pointer((putki::instance_t *)&" + ref + ", str);");
+				break;
+			default:
+		}
+		sb.append(indent2).append("}");
+		sb.append(indent).append("}");
+
+		if (field.isArray)
+		{
+			sb.append(arrIndent).append("\t\ti++;");
+			sb.append(arrIndent).append("\t}");
+			sb.append(arrIndent).append("}");
+			if (field.type == FieldType.BYTE)
+			{
+				sb.append(prefix).append("}");
+			}
+		}
+	}
+
     public static void generateInkiHeader(Compiler comp, CodeWriter writer)
     {
         for (Compiler.ParsedTree tree : comp.allTrees())
@@ -669,6 +1187,7 @@ public class CppGenerator
 	            StringBuilder sb = new StringBuilder();
 	            sb.append("#pragma once\n\n");
 	            sb.append("#include <putki/builder/write.h>\n");
+	            sb.append("#include <putki/builder/binary.h>\n");
 	            sb.append("#include <putki/builder/typereg.h>\n");
 	            sb.append("#include <string>\n");
 	            sb.append("#include <cstring>\n");
@@ -770,6 +1289,7 @@ public class CppGenerator
             		String pfx0 = "\n\t";
             		String pfx1 = "\n\t\t";
             		String pfx2 = "\n\t\t\t";
+            		writeInkiLayout(sb, struct, pfx0);
             		sb.append(pfx0).append("struct " + getTypeHandler(struct) + " : putki::type_handler_i {");
             		sb.append(pfx1).append("putki::instance_t alloc() { return new " + sn + "; }");
             		sb.append(pfx1).append("putki::instance_t clone(putki::instance_t source) { " + sn + "* tmp = (" + sn + "*)alloc(); *tmp = *((" + sn + "*) source); return tmp; }");
@@ -781,6 +1301,7 @@ public class CppGenerator
             		else
             			sb.append(pfx1).append("type_handler_i* parent_type() { return 0; }");
             		sb.append(pfx1).append("bool in_output() { return " + ((struct.domains & Compiler.DOMAIN_OUTPUT) != 0 ? "true" : "false") + "; }");
+            		sb.append(pfx1).append("const putki::type_layout* layout() { return &" + layoutName(struct) + "; }");
             		sb.append(pfx1).append("void walk_dependencies(putki::instance_t source, putki::depwalker_i *walker, bool traverse_children, bool skip_input_only, bool rtti_dispatch) {");
 
             		if (struct.isTypeRoot || struct.resolvedParent != null)
@@ -886,42 +1407,34 @@ public class CppGenerator
 					for (int f=0;f<tmp.size();f++)
 	                {
 		                Compiler.ParsedField field = tmp.get(f);
-	                	if (field.isBuildConfig)
-	                	{
-	                		continue;
-	                	}
 	                	if (firstJson)
 	                	{
 	                		sb.append(pfx2).append(sn + "* obj = (" + sn + "*) source;");
-	                		sb.append(pfx2).append("char ibuf[128];");
 	                		firstJson = false;
 	                	}
 
 						String ref = "obj->" + fieldName(field);
 	                	String indent = pfx2;
-	                	String delim = "";
+	                	String more = (f < tmp.size()-1) ? "true" : "false";
 
-	                	sb.append(pfx2).append("out << putki::write::json_indent(ibuf, indent+1) << \"\\\"" + field.name + "\\\": \";");
+	                	sb.append(pfx2).append("putki::write::json_key(out, indent + 1, \"\\\"" + field.name + "\\\"\", " + (field.name.length() + 2) + ");");
 
 						if (field.isArray && field.type == FieldType.BYTE)
 						{
-							sb.append(pfx2).append("out << \"\\\"\"; putki::write::json_stringencode_byte_array(out, " + ref + "); out << \"\\\"\";");
-							if (f < tmp.size()-1)
-								sb.append(pfx2).append("out << \",\";");
-							sb.append(pfx2).append("out << \"\\n\";");
+							sb.append(pfx2).append("out << '\"'; putki::write::json_stringencode_byte_array(out, " + ref + "); out << '\"';");
+							sb.append(pfx2).append("putki::write::json_field_end(out, indent, " + more + ");");
 							continue;
 						}
 
 						if (field.isArray)
 						{
+							sb.append(pfx2).append("out << '[';");
+							sb.append(pfx2).append("for (size_t i=0;i<" + ref + ".size();i++)");
 							sb.append(pfx2).append("{");
-							sb.append(pfx2).append("\tout << \"[\";");
-							sb.append(pfx2).append("\tconst char *delim = \"\";");
-							sb.append(pfx2).append("\tfor (size_t i=0;i<" + ref + ".size();i++)");
-							sb.append(pfx2).append("\t{");
+							sb.append(pfx2).append("\tif (i)");
+							sb.append(pfx2).append("\t\tputki::write::json_delim(out, indent);");
 							ref = ref + "[i]";
-							delim = "delim <<";
-							indent = pfx2 + "\t\t";
+							indent = pfx2 + "\t";
 						}
 
 						switch (field.type)
@@ -929,30 +1442,28 @@ public class CppGenerator
 							case STRING:
 							case FILE:
 							case PATH:
-								sb.append(indent).append("out << " + delim + "putki::write::json_str(" + ref + ".c_str());");
+								sb.append(indent).append("putki::write::json_string(out, " + ref + ");");
 								break;
 							case INT32:
 							case UINT32:
-								sb.append(indent).append("out << " + delim + ref+ ";");
-								break;
 							case FLOAT:
-								sb.append(indent).append("out << " + delim + ref+ ";");
+								sb.append(indent).append("out << " + ref + ";");
 								break;
 							case BYTE:
-								sb.append(indent).append("out << " + delim + "(unsigned int)" + ref + ";");
+								sb.append(indent).append("out << (unsigned int)" + ref + ";");
 								break;
 							case ENUM:
-								sb.append(indent).append("out << " + delim + " \"\\\"\" << " + enumToString(field.resolvedEnum) + "(" + ref + ") << \"\\\"\";");
+								sb.append(indent).append("out << '\"' << " + enumToString(field.resolvedEnum) + "(" + ref + ") << '\"';");
 								break;
 							case POINTER:
-								sb.append(indent).append("out << " + delim +  "putki::write::json_str(putki::db::pathof_including_unresolved(ref_source, " + ref + "));");
+								sb.append(indent).append("putki::write::json_string(out, putki::db::pathof_including_unresolved(ref_source, " + ref + "));");
 								break;
 							case STRUCT_INSTANCE:
 								{
 									String ptrRef = field.isParentField ? "obj" : ("&" + ref);
-									sb.append(indent).append("out << " + delim + "\"{\\n\";");
+									sb.append(indent).append("putki::write::json_open(out, indent);");
 									sb.append(indent).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->write_json(ref_source, " + ptrRef + ", out, indent + 1);");
-									sb.append(indent).append("out << putki::write::json_indent(ibuf, indent+1) << \"}\";");
+									sb.append(indent).append("putki::write::json_close(out, indent + 1);");
 									break;
 								}
 							default:
@@ -962,128 +1473,20 @@ public class CppGenerator
 
 						if (field.isArray)
 						{
-							sb.append(pfx2).append("\t\tdelim = \", \";");
-							sb.append(pfx2).append("\t}");
-							sb.append(pfx2).append("\tout << \"]\";");
 							sb.append(pfx2).append("}");
+							sb.append(pfx2).append("out << ']';");
 						}
 
-						if (f < tmp.size()-1)
-						{
-							sb.append(pfx2).append("out << \",\";");
-						}
-
-						sb.append(pfx2).append("out << \"\\n\";");
+						sb.append(pfx2).append("putki::write::json_field_end(out, indent, " + more + ");");
 					}
 
             		sb.append(pfx1).append("}");
+            		writeBinaryFns(sb, struct, pfx1);
             		sb.append(pfx1).append("void fill_from_parsed(putki::parse::node *pn, putki::instance_t target_, putki::load_resolver_i *resolver) {");
 
             		sb.append(pfx2).append(sn + "* target = (" + sn + "*) target_;");
 
-	                for (Compiler.ParsedField field : struct.fields)
-	                {
-	                    if ((struct.domains & Compiler.DOMAIN_INPUT) == 0)
-	                        continue;
-	                    if (field.isBuildConfig)
-	                    	continue;
-
-	                    String ref = "target->" + fieldName(field);
-	                    String node = "putki::parse::get_object_item(pn, \"" + field.name + "\")";
-	                    String indent = pfx2;
-	                    String arrIndent = pfx2;
-
-	                    if (field.isParentField)
-	                    {
-	            			sb.append(pfx2).append("putki::parse::node *parent = " + node + ";");
-	            			sb.append(pfx2).append("if (parent)");
-	            			sb.append(pfx2).append("{");
-	            			sb.append(pfx2).append("\t" + getTypeHandlerFn(struct.resolvedParent) + "()->fill_from_parsed(parent, target_, resolver);");
-	            			sb.append(pfx2).append("}");
-	            			continue;
-	                    }
-
-	                    if (field.isArray)
-	                    {
-	                    	if (field.type == FieldType.BYTE)
-	                    	{
-	                    		sb.append(pfx2).append("if (!putki::parse::parse_stringencoded_byte_array(" + node + ", " + ref + "))");
-	                    		sb.append(pfx2).append("{");
-	                    		arrIndent = pfx2 + "\t";
-	                    	}
-                    		sb.append(arrIndent).append("{");
-                    		sb.append(arrIndent).append("\t" + ref + ".clear();");
-                    		sb.append(arrIndent).append("\tsize_t i = 0;");
-                    		sb.append(arrIndent).append("\tputki::parse::node *arr = " + node + ";");
-                    		sb.append(arrIndent).append("\twhile (putki::parse::node * narr = putki::parse::get_array_item(arr, i)) {");
-                    		sb.append(arrIndent).append("\t\t" + putkiFieldType(field) + " tmp;");
-                    		sb.append(arrIndent).append("\t\t(void)narr;");
-                    		sb.append(arrIndent).append("\t\t" + ref + ".push_back(tmp);");
-                    		sb.append(arrIndent).append("\t\t++i;");
-                    		sb.append(arrIndent).append("\t}");
-                    		sb.append(arrIndent).append("\ti = 0;");
-                    		sb.append(arrIndent).append("\twhile (putki::parse::node * narr = putki::parse::get_array_item(arr, i)) {");
-                    		sb.append(arrIndent).append("\t\t" + putkiFieldType(field) + " & obj = " + ref + "[i];");
-                    		ref = "obj";
-                    		indent = arrIndent + "\t\t";
-                    		node = "narr";
-	                    }
-
-	                    String indent2 = indent + "\t";
-	                    String indent3 = indent + "\t\t";
-
-						sb.append(indent).append("{");
-	                    sb.append(indent2).append("putki::parse::node *n = " + node + ";");
-	                    sb.append(indent2).append("if (n)");
-	                    sb.append(indent2).append("{");
-
-	                    switch (field.type)
-	                    {
-	                    	case STRING:
-	                    	case FILE:
-	                    	case PATH:
-	                    		sb.append(indent3).append(ref + " = putki::parse::get_value_string(n);");
-	                    		break;
-	                    	case FLOAT:
-	                    		sb.append(indent3).append(ref + " = atof(putki::parse::get_value_string(n));");
-	                    		break;
-	                    	case UINT32:
-	                    	case INT32:
-	                    	case BYTE:
-	                    		sb.append(indent3).append(ref + " = (" + putkiFieldtypePod(field.type) + ") putki::parse::get_value_int(n);");
-	                    		break;
-	                    	case BOOL:
-	                    		sb.append(indent3).append(ref + " = putki::parse::get_value_int(n) != 0;");
-	                    		break;
-	                    	case STRUCT_INSTANCE:
-	                    		sb.append(indent3).append(getTypeHandlerFn(field.resolvedRefStruct) + "()->fill_from_parsed(n, &" + ref + ", resolver);");
-	                    		break;
-	                    	case ENUM:
-	                    		sb.append(indent3).append(ref + " = " + enumFromString(field.resolvedEnum) + "(putki::parse::get_value_string(n));");
-	                    		break;
-	                    	case POINTER:
-	                    		sb.append(indent3).append("const char* str = putki::parse::get_value_string(n);");
-	                    		sb.append(indent3).append("if (!str || !str[0])");
-	                    		sb.append(indent3).append("\t" + ref + " = 0;");
-	                    		sb.append(indent3).append("else");
-	                    		sb.append(indent3).append("\tresolver->resolve_pointer((putki::instance_t *)&" + ref + ", str);");
-	                    		break;
-							default:
-	                    }
-	                    sb.append(indent2).append("}");
-	                    sb.append(indent).append("}");
-
-	                    if (field.isArray)
-	                    {
-	                    	sb.append(arrIndent).append("\t\ti++;");
-	                    	sb.append(arrIndent).append("\t}");
-	                    	sb.append(arrIndent).append("}");
-	                    	if (field.type == FieldType.BYTE)
-	                    	{
-	                    		sb.append(pfx2).append("}");
-	                    	}
-	                    }
-	                }
+            		writeFillMembers(sb, struct, "pn", pfx2, 0);
 
             		sb.append(pfx1).append("}");
             		sb.append(pfx1).append("char* write_into_buffer(putki::runtime::descptr rt, putki::instance_t source, char *beg, char *end) {");
@@ -1132,6 +1535,359 @@ public class CppGenerator
     }
 
 
+	// Straight line bitstream code per packet type, same wire format as the C# netki structs.
+	public static void writeNetkiStruct(Compiler comp, StringBuilder sb, Compiler.ParsedStruct struct, String prefix)
+	{
+		String sn = structName(struct);
+		String p0 = prefix + "\t";
+		String p1 = prefix + "\t\t";
+
+		sb.append(prefix).append("struct " + sn + " {");
+		sb.append(p0).append("enum { TYPE_ID = " + struct.uniqueId + " };");
+
+		sb.append(p0).append(sn + "()");
+		sb.append(p0).append("{");
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (!isNetkiField(field) || field.isArray || field.type == FieldType.STRUCT_INSTANCE)
+				continue;
+
+			String defValue = field.defValue;
+			if (defValue == null)
+			{
+				if (field.type == FieldType.STRING)
+					continue;
+				defValue = "0";
+			}
+
+			if (field.type == FieldType.ENUM)
+				sb.append(p1).append(fieldName(field) + " = (" + enumName(field.resolvedEnum) + ") " + enumValue(defValue) + ";");
+			else
+				sb.append(p1).append(fieldName(field) + " = " + defValue + ";");
+		}
+		sb.append(p0).append("}");
+
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (!isNetkiField(field))
+				continue;
+			if (field.isArray)
+				sb.append(p0).append("std::vector<" + netkiFieldType(field) + "> " + fieldName(field) + ";");
+			else
+				sb.append(p0).append(netkiFieldType(field) + " " + fieldName(field) + ";");
+		}
+
+		sb.append("\n");
+		sb.append(p0).append("bool operator==(const " + sn + " & o) const");
+		sb.append(p0).append("{");
+		boolean firstCmp = true;
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (!isNetkiField(field))
+				continue;
+			sb.append(p1).append(firstCmp ? "return " : "    && ").append(fieldName(field) + " == o." + fieldName(field));
+			firstCmp = false;
+		}
+		sb.append(firstCmp ? p1 + "return true;" : ";");
+		sb.append(p0).append("}");
+		sb.append(p0).append("bool operator!=(const " + sn + " & o) const { return !(*this == o); }");
+
+		sb.append("\n");
+		sb.append(p0).append("void write_into_bitstream(netki::bitstream::buffer *buf) const");
+		sb.append(p0).append("{");
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (isNetkiField(field))
+				writeNetkiFieldWrite(sb, field, p1);
+		}
+		sb.append(p0).append("}");
+
+		sb.append(p0).append("bool read_from_bitstream(netki::bitstream::buffer *buf)");
+		sb.append(p0).append("{");
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (isNetkiField(field))
+				writeNetkiFieldRead(sb, field, p1);
+		}
+		sb.append(p1).append("return buf->error == 0;");
+		sb.append(p0).append("}");
+
+		// Against a baseline: one bit per field, then the field only if it changed. Nested
+		// structs are diffed field by field.
+		sb.append(p0).append("void write_delta_into_bitstream(netki::bitstream::buffer *buf, const " + sn + " & base) const");
+		sb.append(p0).append("{");
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (!isNetkiField(field))
+				continue;
+			String fn = fieldName(field);
+			if (field.type == FieldType.STRUCT_INSTANCE && !field.isArray)
+			{
+				sb.append(p1).append(fn + ".write_delta_into_bitstream(buf, base." + fn + ");");
+				continue;
+			}
+			sb.append(p1).append("if (" + fn + " != base." + fn + ")");
+			sb.append(p1).append("{");
+			sb.append(p1).append("\tnetki::bitstream::insert_bits<1>(buf, 1);");
+			writeNetkiFieldWrite(sb, field, p1 + "\t");
+			sb.append(p1).append("}");
+			sb.append(p1).append("else");
+			sb.append(p1).append("{");
+			sb.append(p1).append("\tnetki::bitstream::insert_bits<1>(buf, 0);");
+			sb.append(p1).append("}");
+		}
+		sb.append(p0).append("}");
+
+		sb.append(p0).append("bool read_delta_from_bitstream(netki::bitstream::buffer *buf, const " + sn + " & base)");
+		sb.append(p0).append("{");
+		for (Compiler.ParsedField field : struct.fields)
+		{
+			if (!isNetkiField(field))
+				continue;
+			String fn = fieldName(field);
+			if (field.type == FieldType.STRUCT_INSTANCE && !field.isArray)
+			{
+				sb.append(p1).append(fn + ".read_delta_from_bitstream(buf, base." + fn + ");");
+				continue;
+			}
+			sb.append(p1).append("if (netki::bitstream::read_bits<1>(buf))");
+			sb.append(p1).append("{");
+			writeNetkiFieldRead(sb, field, p1 + "\t");
+			sb.append(p1).append("}");
+			sb.append(p1).append("else");
+			sb.append(p1).append("{");
+			sb.append(p1).append("\t" + fn + " = base." + fn + ";");
+			sb.append(p1).append("}");
+		}
+		sb.append(p1).append("return buf->error == 0;");
+		sb.append(p0).append("}");
+		sb.append(prefix).append("};");
+	}
+
+	static void writeNetkiFieldWrite(StringBuilder sb, Compiler.ParsedField field, String p1)
+	{
+		String p = p1;
+		String ref = fieldName(field);
+		if (field.isArray)
+		{
+			sb.append(p1).append("netki::bitstream::insert_compressed_int(buf, (uint32_t) " + ref + ".size());");
+			if (netkiBulkArray(field) != null)
+			{
+				sb.append(p1).append("if (!" + ref + ".empty())");
+				sb.append(p1).append("\tnetki::bitstream::insert_" + netkiBulkArray(field) + "(buf, &" + ref + "[0], " + ref + ".size());");
+				return;
+			}
+			sb.append(p1).append("for (size_t i=0;i!=" + ref + ".size();i++)");
+			p = p1 + "\t";
+			ref = ref + "[i]";
+		}
+
+		switch (field.type)
+		{
+			case BOOL:
+				sb.append(p).append("netki::bitstream::insert_bits<1>(buf, " + ref + " ? 1 : 0);");
+				break;
+			case BYTE:
+				sb.append(p).append("netki::bitstream::insert_bits<8>(buf, " + ref + ");");
+				break;
+			case FLOAT:
+				sb.append(p).append("netki::bitstream::insert_float(buf, " + ref + ");");
+				break;
+			case UINT32:
+				sb.append(p).append("netki::bitstream::insert_compressed_int(buf, " + ref + ");");
+				break;
+			case INT32:
+				sb.append(p).append("netki::bitstream::insert_compressed_signed_int(buf, " + ref + ");");
+				break;
+			case ENUM:
+				sb.append(p).append("netki::bitstream::insert_compressed_signed_int(buf, (int32_t) " + ref + ");");
+				break;
+			case STRING:
+				sb.append(p).append("netki::bitstream::insert_string(buf, " + ref + ");");
+				break;
+			case STRUCT_INSTANCE:
+				sb.append(p).append(ref + ".write_into_bitstream(buf);");
+				break;
+			default:
+				break;
+		}
+	}
+
+	static void writeNetkiFieldRead(StringBuilder sb, Compiler.ParsedField field, String p1)
+	{
+		String p = p1;
+		String ref = fieldName(field);
+		if (field.isArray)
+		{
+			sb.append(p1).append("{");
+			// every element takes at least one bit, so a longer count can only be garbage.
+			sb.append(p1).append("\tuint32_t count = netki::bitstream::read_compressed_int(buf);");
+			sb.append(p1).append("\tif (buf->error || count > (uint32_t) netki::bitstream::bits_left(buf)) { buf->error = 1; count = 0; }");
+			sb.append(p1).append("\t" + ref + ".resize(count);");
+			if (netkiBulkArray(field) != null)
+			{
+				sb.append(p1).append("\tif (count)");
+				sb.append(p1).append("\t\tnetki::bitstream::read_" + netkiBulkArray(field) + "(buf, &" + ref + "[0], count);");
+				sb.append(p1).append("}");
+				return;
+			}
+			sb.append(p1).append("\tfor (uint32_t i=0;i!=count;i++)");
+			p = p1 + "\t\t";
+			ref = ref + "[i]";
+		}
+
+		switch (field.type)
+		{
+			case BOOL:
+				sb.append(p).append(ref + " = netki::bitstream::read_bits<1>(buf) == 1;");
+				break;
+			case BYTE:
+				sb.append(p).append(ref + " = (unsigned char) netki::bitstream::read_bits<8>(buf);");
+				break;
+			case FLOAT:
+				sb.append(p).append(ref + " = netki::bitstream::read_float(buf);");
+				break;
+			case UINT32:
+				sb.append(p).append(ref + " = netki::bitstream::read_compressed_int(buf);");
+				break;
+			case INT32:
+				sb.append(p).append(ref + " = netki::bitstream::read_compressed_signed_int(buf);");
+				break;
+			case ENUM:
+				sb.append(p).append(ref + " = (" + enumName(field.resolvedEnum) + ") netki::bitstream::read_compressed_signed_int(buf);");
+				break;
+			case STRING:
+				sb.append(p).append("netki::bitstream::read_string(buf, &" + ref + ");");
+				break;
+			case STRUCT_INSTANCE:
+				sb.append(p).append(ref + ".read_from_bitstream(buf);");
+				break;
+			default:
+				break;
+		}
+
+		if (field.isArray)
+			sb.append(p1).append("}");
+	}
+
+    public static void generateNetkiHeader(Compiler comp, CodeWriter writer)
+    {
+        for (Compiler.ParsedTree tree : comp.allTrees())
+        {
+            Path netki = tree.genCodeRoot.resolve("cpp").resolve("netki");
+            for (Compiler.ParsedFile file : tree.parsedFiles)
+            {
+                Path headerFn = netki.resolve(file.sourcePath).resolve(file.fileName + ".h");
+
+                StringBuilder sb = new StringBuilder();
+                sb.append("#pragma once\n\n");
+                sb.append("#include <netki/bitstream.h>\n");
+                sb.append("#include <netki/packet.h>\n");
+                sb.append("#include <string>\n");
+                sb.append("#include <vector>\n");
+                sb.append("#include <stdint.h>\n");
+
+                for (String include : file.includes)
+                {
+                    sb.append("#include \"" + include.replace("$PFX$", "netki/") + ".h\"\n");
+                }
+
+                sb.append("\n");
+                sb.append("namespace netki\n");
+                sb.append("{");
+
+                for (Compiler.ParsedEnum e : file.enums)
+                {
+                    writeEnum(comp, sb, e, "\n\t", true);
+                    sb.append("\n");
+                }
+
+                for (Compiler.ParsedStruct struct : file.structs)
+                {
+                    if ((struct.domains & Compiler.DOMAIN_NETKI) == 0)
+                        continue;
+                    writeNetkiStruct(comp, sb, struct, "\n\t");
+                    sb.append("\n");
+                }
+                sb.append("\n}\n");
+                writer.addOutput(headerFn, sb.toString().getBytes());
+            }
+
+            // Master header with the type id dispatch.
+            String mn = withUnderscore(tree.moduleName);
+            Path masterFn = netki.resolve(mn + ".h");
+            StringBuilder sb = new StringBuilder();
+            sb.append("#pragma once\n\n");
+            for (Compiler.ParsedFile file : tree.parsedFiles)
+            {
+                Path hdrFn = netki.resolve(file.sourcePath).resolve(file.fileName + ".h");
+                sb.append("#include \"" + netki.relativize(hdrFn).toString().replace('\\', '/') + "\"\n");
+            }
+
+            String p0 = "\n\t";
+            String p1 = "\n\t\t";
+            sb.append("\nnamespace netki");
+            sb.append("\n{");
+            sb.append(p0).append("inline const packet_handler* " + mn + "_packet_handler(int type_id)");
+            sb.append(p0).append("{");
+            sb.append(p1).append("static const packet_handler handlers[] = {");
+            ArrayList<Compiler.ParsedStruct> packets = new ArrayList<Compiler.ParsedStruct>();
+            for (Compiler.ParsedFile file : tree.parsedFiles)
+            {
+                for (Compiler.ParsedStruct struct : file.structs)
+                {
+                    if ((struct.domains & Compiler.DOMAIN_NETKI) == 0)
+                        continue;
+                    sb.append(p1).append("\tmake_packet_handler<" + structName(struct) + ">(),");
+                    packets.add(struct);
+                }
+            }
+            if (packets.isEmpty())
+            {
+                sb.append(p1).append("\t{ -1, 0, 0, 0, 0 }");
+            }
+            sb.append(p1).append("};");
+            sb.append(p1).append("switch (type_id)");
+            sb.append(p1).append("{");
+            for (int i=0;i<packets.size();i++)
+            {
+                sb.append(p1).append("\tcase " + packets.get(i).uniqueId + ": return &handlers[" + i + "];");
+            }
+            sb.append(p1).append("\tdefault: return 0;");
+            sb.append(p1).append("}");
+            sb.append(p0).append("}");
+            sb.append("\n");
+            sb.append(p0).append("inline bool " + mn + "_decode(bitstream::buffer *buf, int type_id, decoded_packet *pkt)");
+            sb.append(p0).append("{");
+            sb.append(p1).append("pkt->type_id = -1;");
+            sb.append(p1).append("pkt->packet = 0;");
+            sb.append(p1).append("pkt->handler = " + mn + "_packet_handler(type_id);");
+            sb.append(p1).append("if (!pkt->handler)");
+            sb.append(p1).append("\treturn false;");
+            sb.append(p1).append("void *packet = pkt->handler->create();");
+            sb.append(p1).append("if (!pkt->handler->read(buf, packet))");
+            sb.append(p1).append("{");
+            sb.append(p1).append("\tpkt->handler->destroy(packet);");
+            sb.append(p1).append("\treturn false;");
+            sb.append(p1).append("}");
+            sb.append(p1).append("pkt->type_id = type_id;");
+            sb.append(p1).append("pkt->packet = packet;");
+            sb.append(p1).append("return true;");
+            sb.append(p0).append("}");
+            sb.append("\n");
+            sb.append(p0).append("inline bool " + mn + "_encode(bitstream::buffer *buf, int type_id, const void *packet)");
+            sb.append(p0).append("{");
+            sb.append(p1).append("const packet_handler *h = " + mn + "_packet_handler(type_id);");
+            sb.append(p1).append("if (!h)");
+            sb.append(p1).append("\treturn false;");
+            sb.append(p1).append("h->write(buf, packet);");
+            sb.append(p1).append("return buf->error == 0;");
+            sb.append(p0).append("}");
+            sb.append("\n}\n");
+            writer.addOutput(masterFn, sb.toString().getBytes());
+        }
+    }
+
     public static void generateOutkiHeader(Compiler comp, CodeWriter writer)
     {
         for (Compiler.ParsedTree tree : comp.allTrees())
@@ -2,6 +2,19 @@
 #define __NETKI_BITSTREAM_H__
 
 #include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+// bits are packed from the lowest bit of each byte and upwards, same as Bitstream.cs. values
+// are read with 64 bit little endian word loads where the buffer allows it and written with
+// the fewest stores that cover the touched bytes.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	#error netki bitstream assumes a little endian host
+#endif
 
 namespace netki
 {
@@ -18,7 +31,7 @@ namespace netki
 			int error;
 		};
 
-		void flip_buffer(buffer *buf)
+		inline void flip_buffer(buffer *buf)
 		{
 			if (buf->bitpos)
 				buf->bufsize = buf->bytepos + 1;
@@ -41,126 +54,113 @@ namespace netki
 
 		static const uint8_t bitmask[9] = {0x0, 0x1, 0x3, 0x7, 0xf, 0x1f, 0x3f, 0x7f, 0xff};
 
-		long bits_left(buffer *buf)
+		inline long bits_left(buffer *buf)
 		{
-			return (buf->bufsize - buf->bytepos) * 8 - buf->bitpos;
+			return (long)(buf->bufsize - buf->bytepos) * 8 - buf->bitpos;
 		}
 
-		long bytes_left(buffer *buf)
+		inline long bytes_left(buffer *buf)
 		{
-			return buf->bufsize - buf->bytepos - 1;
+			return (long)buf->bufsize - buf->bytepos - 1;
 		}
 
-		void set_bits(uint8_t *in, bitofs_t ofs, uint8_t value)
+		inline uint64_t low_bits(unsigned int count)
 		{
-			if (!ofs)
-			{
-				*in = value;
-			}
-			else
-			{
-				(*in) = (*in) | (value << ofs);
-			}
+			return count >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << count) - 1);
 		}
 
-		template<int bits>
-		uint8_t get_bits(uint8_t *in, bitofs_t ofs)
+		inline uint64_t load_word(const uint8_t *p)
 		{
-			return ((*in) >> ofs) & bitmask[bits];
+			uint64_t w;
+			memcpy(&w, p, 8);
+			return w;
 		}
 
-		template<int bits>
-		void insert_bits(buffer *target, uint32_t value)
+		template<int bytes>
+		void store_bytes(uint8_t *p, uint64_t w)
+		{
+			memcpy(p, &w, bytes);
+		}
+
+		// write 'count' (at most 32) bits. bits above the write position in the touched bytes
+		// are cleared, bytes after them are left alone.
+		inline void insert_bits(buffer *target, unsigned int count, uint32_t value)
 		{
-			if (bits_left(target) < bits)
+			if (bits_left(target) < (long)count)
 			{
 				target->error = 1;
 				return;
 			}
-			
-			if (bits > 8)
-			{
-				insert_bits<8>(target, value & 0xff);
-				insert_bits<bits - 8>(target, value >> 8);
-				return;
-			}
 
-			const bitofs_t left = (8 - target->bitpos);
-			set_bits(&target->buf[target->bytepos], target->bitpos, value);
+			if (!count)
+				return;
 
-			bitofs_t np = target->bitpos + bits;
+			uint8_t *p = target->buf + target->bytepos;
+			const unsigned int end_bit = target->bitpos + count;
+			const unsigned int touched = (end_bit + 7) >> 3;
+			// count is at most 32 and end_bit at most 39, so this fits and touches at most 5 bytes.
+			const uint64_t w = (((uint64_t)value & (((uint64_t)1 << count) - 1)) << target->bitpos) | (p[0] & bitmask[target->bitpos]);
 
-			if (bits > left)
-				set_bits(&target->buf[target->bytepos+1], 0, value >> left);
+			// store exactly the touched bytes with as few stores as possible; loading the whole word
+			// back right after the previous store would stall on store forwarding.
+			switch (touched)
+			{
+				case 1: p[0] = (uint8_t)w; break;
+				case 2: store_bytes<2>(p, w); break;
+				case 3: store_bytes<2>(p, w); p[2] = (uint8_t)(w >> 16); break;
+				case 4: store_bytes<4>(p, w); break;
+				default: store_bytes<4>(p, w); p[4] = (uint8_t)(w >> 32); break;
+			}
 
-			target->bytepos = target->bytepos + (np >> 3);
-			target->bitpos = np & 7;
+			target->bytepos += end_bit >> 3;
+			target->bitpos = end_bit & 7;
 		}
 
-		template<> void insert_bits<0>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-1>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-2>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-3>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-4>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-5>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-6>(buffer *target, uint32_t value) { }
-		template<> void insert_bits<-7>(buffer *target, uint32_t value) { }
-
-		uint32_t read_bits(buffer *source, unsigned int count);
-
-		// MAX bits is 8
-		template<int bits>
-		uint32_t read_bits(buffer *source)
+		inline uint32_t read_bits(buffer *source, unsigned int count)
 		{
-			if (bits_left(source) < bits)
+			if (bits_left(source) < (long)count)
 			{
 				source->error = 1;
 				return 0;
 			}
-		
-			if (bits > 8)
-			{
-				return read_bits(source, bits);
-			}
-
-			const bitofs_t left = (8 - source->bitpos);
 
-			uint32_t fetch_first = left < bits ? left : bits;
-			uint32_t value = (source->buf[source->bytepos] >> source->bitpos) & bitmask[fetch_first];
+			if (!count)
+				return 0;
 
-			bitofs_t np = source->bitpos + bits;
-			source->bytepos = source->bytepos + (np >> 3);
-			source->bitpos = np & 7;
+			const uint8_t *p = source->buf + source->bytepos;
+			const unsigned int end_bit = source->bitpos + count;
 
-			if (fetch_first != bits)
+			uint64_t w;
+			if (source->bufsize - source->bytepos >= 8)
 			{
-				uint32_t remaining = bits - fetch_first;
-				value = value | ((source->buf[source->bytepos] & bitmask[remaining]) << fetch_first);
-				source->bitpos = remaining;
+				w = load_word(p);
 			}
-			
-			return value;
+			else
+			{
+				w = 0;
+				const unsigned int touched = (end_bit + 7) >> 3;
+				for (unsigned int i=0;i!=touched;i++)
+					w |= (uint64_t)p[i] << (8 * i);
+			}
+
+			source->bytepos += end_bit >> 3;
+			source->bitpos = end_bit & 7;
+			return (uint32_t)((w >> (end_bit - count)) & low_bits(count));
+		}
+
+		template<int bits>
+		void insert_bits(buffer *target, uint32_t value)
+		{
+			insert_bits(target, bits, value);
 		}
 
-		uint32_t read_bits(buffer *source, unsigned int count)
+		template<int bits>
+		uint32_t read_bits(buffer *source)
 		{
-			switch (count)
-			{
-				case 0: return 0;
-				case 1: return read_bits<1>(source);
-				case 2: return read_bits<2>(source);
-				case 3: return read_bits<3>(source);
-				case 4: return read_bits<4>(source);
-				case 5: return read_bits<5>(source);
-				case 6: return read_bits<6>(source);
-				case 7: return read_bits<7>(source);
-				case 8: return read_bits<8>(source);
-				default:
-					return read_bits<8>(source) | (read_bits(source, count - 8) << 8);
-			}
+			return read_bits(source, bits);
 		}
 
-		void sync_byte(buffer *target)
+		inline void sync_byte(buffer *target)
 		{
 			if (target->bitpos)
 			{
@@ -169,7 +169,7 @@ namespace netki
 			}
 		}
 
-		bool insert_bytes(buffer *target, uint8_t *buf, int size)
+		inline bool insert_bytes(buffer *target, uint8_t *buf, int size)
 		{
 			sync_byte(target);
 			if (bytes_left(target) < size)
@@ -177,32 +177,30 @@ namespace netki
 				target->error = 1;
 				return false;
 			}
-				
-			for (int i=0; i!=size; i++)
-				target->buf[target->bytepos + i] = buf[i];
+
+			memcpy(&target->buf[target->bytepos], buf, size);
 			target->bytepos += size;
 			return true;
 		}
 
-		bool read_bytes(buffer *source, uint8_t *buf, int size)
+		inline bool read_bytes(buffer *source, uint8_t *buf, int size)
 		{
 			sync_byte(source);
-		
+
 			if (bytes_left(source) < size)
 			{
 				source->error = 1;
 				return false;
 			}
-				
-			for (int i=0; i!=size; i++)
-				buf[i] = source->buf[source->bytepos + i];
+
+			memcpy(buf, &source->buf[source->bytepos], size);
 			source->bytepos += size;
 			return true;
 		}
 
-		void *alloc(buffer *target, uint32_t size)
+		inline void *alloc(buffer *target, uint32_t size)
 		{
-			if (bytes_left(target) < size)
+			if (bytes_left(target) < (long)size)
 			{
 				target->error = 1;
 				return 0;
@@ -212,59 +210,157 @@ namespace netki
 			target->bytepos += size;
 			return ptr;
 		}
-		
-		void insert_compressed_int(buffer *target, uint32_t value)
+
+		// long runs of small fields go through these instead of the buffer calls. bits collect in a
+		// 64 bit scratch word that is stored 32 bits at a time, and the buffer position is only
+		// brought up to date by end_write/end_read.
+		struct writer
 		{
-			uint32_t bits;
-			if (value == 0xffffffff)
+			buffer *target;
+			uint8_t *out;
+			uint64_t scratch;
+			unsigned int scratch_bits;
+		};
+
+		struct reader
+		{
+			buffer *source;
+			const uint8_t *in;
+			uint64_t scratch;
+			unsigned int scratch_bits;
+			// bits still unread in the buffer, including the scratch.
+			long left;
+		};
+
+		inline void begin_write(writer *w, buffer *target)
+		{
+			w->target = target;
+			w->out = target->buf + target->bytepos;
+			w->scratch = target->bitpos ? (w->out[0] & bitmask[target->bitpos]) : 0;
+			w->scratch_bits = target->bitpos;
+		}
+
+		inline void put_bits(writer *w, unsigned int count, uint32_t value)
+		{
+			buffer *t = w->target;
+			const long used = (long)(w->out - t->buf) * 8 + w->scratch_bits;
+			if ((long)t->bufsize * 8 - used < (long)count)
 			{
-				insert_bits<6>(target, 0);
-				insert_bits<6>(target, 1);
+				t->error = 1;
+				return;
 			}
-			else if (value > 0xffff) 
+
+			w->scratch |= ((uint64_t)value & low_bits(count)) << w->scratch_bits;
+			w->scratch_bits += count;
+			if (w->scratch_bits >= 32)
 			{
-				insert_bits<5>(target, 0);
-				insert_bits<1>(target, 1);
-				insert_bits<32>(target, value);
+				const uint32_t word = (uint32_t)w->scratch;
+				memcpy(w->out, &word, 4);
+				w->out += 4;
+				w->scratch >>= 32;
+				w->scratch_bits -= 32;
 			}
-			else if (value > 0xfff)
+		}
+
+		inline void end_write(writer *w)
+		{
+			const unsigned int touched = (w->scratch_bits + 7) >> 3;
+			for (unsigned int i=0;i!=touched;i++)
+				w->out[i] = (uint8_t)(w->scratch >> (8 * i));
+
+			w->target->bytepos = (int)(w->out - w->target->buf) + (w->scratch_bits >> 3);
+			w->target->bitpos = w->scratch_bits & 7;
+		}
+
+		inline void begin_read(reader *r, buffer *source)
+		{
+			r->source = source;
+			r->in = source->buf + source->bytepos;
+			r->scratch = 0;
+			r->scratch_bits = 0;
+			r->left = bits_left(source);
+			if (source->bitpos && r->left > 0)
 			{
-				insert_bits<4>(target, 0);
-				insert_bits<1>(target, 1);
-				insert_bits<15>(target, value);
+				r->scratch = *r->in++ >> source->bitpos;
+				r->scratch_bits = 8 - source->bitpos;
 			}
-			else if (value > 0xff)
+		}
+
+		inline uint32_t get_bits(reader *r, unsigned int count)
+		{
+			if (r->left < (long)count)
 			{
-				insert_bits<3>(target, 0);
-				insert_bits<1>(target, 1);
-				insert_bits<12>(target, value);
+				r->source->error = 1;
+				return 0;
 			}
-			else if (value > 0xf)
+
+			if (r->scratch_bits < count)
 			{
-				insert_bits<2>(target, 0);
-				insert_bits<1>(target, 1);
-				insert_bits<8>(target, value);
+				const uint8_t *end = r->source->buf + r->source->bufsize;
+				if (end - r->in >= 4)
+				{
+					uint32_t word;
+					memcpy(&word, r->in, 4);
+					r->scratch |= (uint64_t)word << r->scratch_bits;
+					r->in += 4;
+					r->scratch_bits += 32;
+				}
+				else
+				{
+					while (r->scratch_bits < count)
+					{
+						r->scratch |= (uint64_t)(*r->in++) << r->scratch_bits;
+						r->scratch_bits += 8;
+					}
+				}
 			}
-			else if (value > 0)
+
+			const uint32_t value = (uint32_t)(r->scratch & low_bits(count));
+			r->scratch >>= count;
+			r->scratch_bits -= count;
+			r->left -= count;
+			return value;
+		}
+
+		inline void end_read(reader *r)
+		{
+			const long consumed = (long)(r->in - r->source->buf) * 8 - r->scratch_bits;
+			r->source->bytepos = (int)(consumed >> 3);
+			r->source->bitpos = (bitofs_t)(consumed & 7);
+		}
+
+		// prefix of n zero bits and a one, then 4, 8, 12, 16 or 32 bits of value. six zeros is
+		// 0xffffffff. matches PutCompressedUint/ReadCompressedUint in Bitstream.cs.
+		inline void insert_compressed_int(buffer *target, uint32_t value)
+		{
+			if (value == 0xffffffff)
 			{
-				insert_bits<1>(target, 0);
-				insert_bits<1>(target, 1);
-				insert_bits<4>(target, value);
+				insert_bits<6>(target, 0);
 			}
-			else
+			else if (value > 0xffff)
 			{
-				insert_bits<1>(target, 1);
+				insert_bits<6>(target, 1 << 5);
+				insert_bits<32>(target, value);
 			}
+			// prefix and value go in as one field below.
+			else if (value > 0xfff)
+				insert_bits(target, 5 + 16, (value << 5) | (1 << 4));
+			else if (value > 0xff)
+				insert_bits(target, 4 + 12, (value << 4) | (1 << 3));
+			else if (value > 0xf)
+				insert_bits(target, 3 + 8, (value << 3) | (1 << 2));
+			else if (value > 0)
+				insert_bits(target, 2 + 4, (value << 2) | (1 << 1));
+			else
+				insert_bits<1>(target, 1);
 		}
-		
-		uint32_t read_compressed_int(buffer *source)
+
+		inline uint32_t read_compressed_int(buffer *source)
 		{
 			if (read_bits<1>(source) == 1)
 				return 0;
 			if (read_bits<1>(source) == 1)
 				return read_bits<4>(source);
-			if (read_bits<1>(source) == 1)
-				return read_bits<4>(source);
 			if (read_bits<1>(source) == 1)
 				return read_bits<8>(source);
 			if (read_bits<1>(source) == 1)
@@ -275,6 +371,288 @@ namespace netki
 				return read_bits<32>(source);
 			return 0xffffffff;
 		}
+
+		// sign bit, then the magnitude as above. PutCompressedInt/ReadCompressedInt.
+		inline void insert_compressed_signed_int(buffer *target, int32_t value)
+		{
+			if (value < 0)
+			{
+				insert_bits<1>(target, 1);
+				insert_compressed_int(target, 0u - (uint32_t)value);
+			}
+			else
+			{
+				insert_bits<1>(target, 0);
+				insert_compressed_int(target, (uint32_t)value);
+			}
+		}
+
+		inline int32_t read_compressed_signed_int(buffer *source)
+		{
+			if (read_bits<1>(source) == 0)
+				return (int32_t)read_compressed_int(source);
+			return (int32_t)(0u - read_compressed_int(source));
+		}
+
+		// bulk versions of the above for arrays. same bits as calling the per value functions in
+		// a loop, but capacity is checked once and each value is one table lookup and one store
+		// into a 64 bit accumulator.
+		struct compressed_class
+		{
+			uint8_t prefix;
+			uint8_t bits;
+		};
+
+		// by bit length of the value. 0xffffffff is special cased on the side.
+		static const compressed_class compressed_classes[33] = {
+			{1, 0},
+			{2, 4}, {2, 4}, {2, 4}, {2, 4},
+			{3, 8}, {3, 8}, {3, 8}, {3, 8},
+			{4, 12}, {4, 12}, {4, 12}, {4, 12},
+			{5, 16}, {5, 16}, {5, 16}, {5, 16},
+			{6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32},
+			{6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}, {6, 32}
+		};
+
+		// value bits following a prefix of n zeros and a one.
+		static const uint8_t compressed_value_bits[6] = {0, 4, 8, 12, 16, 32};
+
+		inline unsigned int bit_length(uint32_t v)
+		{
+#if defined(_MSC_VER)
+			unsigned long idx;
+			return _BitScanReverse(&idx, v) ? (unsigned int)idx + 1 : 0;
+#else
+			return v ? 32 - __builtin_clz(v) : 0;
+#endif
+		}
+
+		inline unsigned int trailing_zeros(uint64_t v)
+		{
+#if defined(_MSC_VER)
+			unsigned long idx;
+			_BitScanForward64(&idx, v);
+			return (unsigned int)idx;
+#else
+			return __builtin_ctzll(v);
+#endif
+		}
+
+		// the whole code for one value, prefix in the low bits. at most 38 bits.
+		inline uint64_t compressed_code(uint32_t value, unsigned int *bits)
+		{
+			if (value == 0xffffffff)
+			{
+				*bits = 6;
+				return 0;
+			}
+			const compressed_class c = compressed_classes[bit_length(value)];
+			*bits = c.prefix + c.bits;
+			return ((uint64_t)value << c.prefix) | ((uint64_t)1 << (c.prefix - 1));
+		}
+
+		// decodes one value from w, which must hold at least 38 valid bits.
+		inline uint32_t decode_compressed(uint64_t w, unsigned int *bits)
+		{
+			// the or caps the prefix at six zeros, which is 0xffffffff.
+			const unsigned int zeros = trailing_zeros(w | 64);
+			if (zeros == 6)
+			{
+				*bits = 6;
+				return 0xffffffff;
+			}
+			const unsigned int vbits = compressed_value_bits[zeros];
+			*bits = zeros + 1 + vbits;
+			return (uint32_t)((w >> (zeros + 1)) & low_bits(vbits));
+		}
+
+		template<typename T>
+		struct compressed_coding;
+
+		template<>
+		struct compressed_coding<uint32_t>
+		{
+			static uint64_t encode(uint32_t value, unsigned int *bits)
+			{
+				return compressed_code(value, bits);
+			}
+			static uint32_t decode(uint64_t w, unsigned int *bits)
+			{
+				return decode_compressed(w, bits);
+			}
+		};
+
+		// sign bit first, like insert_compressed_signed_int.
+		template<>
+		struct compressed_coding<int32_t>
+		{
+			static uint64_t encode(int32_t value, unsigned int *bits)
+			{
+				const uint64_t sign = value < 0 ? 1 : 0;
+				const uint64_t code = compressed_code(sign ? 0u - (uint32_t)value : (uint32_t)value, bits);
+				*bits += 1;
+				return (code << 1) | sign;
+			}
+			static int32_t decode(uint64_t w, unsigned int *bits)
+			{
+				const uint32_t v = decode_compressed(w >> 1, bits);
+				*bits += 1;
+				return (w & 1) ? (int32_t)(0u - v) : (int32_t)v;
+			}
+		};
+
+		template<typename T>
+		bool insert_compressed_array(buffer *target, const T *values, size_t count)
+		{
+			if (!count)
+				return true;
+
+			uint64_t total = 0;
+			for (size_t i=0;i!=count;i++)
+			{
+				unsigned int bits;
+				compressed_coding<T>::encode(values[i], &bits);
+				total += bits;
+			}
+
+			if ((uint64_t)bits_left(target) < total)
+			{
+				target->error = 1;
+				return false;
+			}
+
+			uint8_t *out = target->buf + target->bytepos;
+			uint8_t *end = target->buf + target->bufsize;
+			uint64_t acc = out[0] & bitmask[target->bitpos];
+			unsigned int acc_bits = target->bitpos;
+
+			// the word stores run up to 7 bytes past the data, put those back afterwards so the
+			// bytes after the written ones are left alone like with insert_bits.
+			uint8_t *after = out + ((acc_bits + total + 7) >> 3);
+			uint8_t saved[8];
+			const size_t saved_size = (end - after) < 8 ? (size_t)(end - after) : 8;
+			memcpy(saved, after, saved_size);
+
+			size_t i = 0;
+			while (i != count && end - out >= 8)
+			{
+				unsigned int bits;
+				acc |= compressed_coding<T>::encode(values[i++], &bits) << acc_bits;
+				acc_bits += bits;
+				store_bytes<8>(out, acc);
+				out += acc_bits >> 3;
+				acc >>= acc_bits & ~7u;
+				acc_bits &= 7;
+			}
+
+			memcpy(after, saved, saved_size);
+			if (acc_bits)
+				out[0] = (uint8_t)acc;
+			target->bytepos = (int)(out - target->buf);
+			target->bitpos = acc_bits;
+
+			// the last few values near the end of the buffer.
+			for (;i!=count;i++)
+			{
+				unsigned int bits;
+				const uint64_t code = compressed_coding<T>::encode(values[i], &bits);
+				if (bits > 32)
+				{
+					insert_bits(target, 32, (uint32_t)code);
+					insert_bits(target, bits - 32, (uint32_t)(code >> 32));
+				}
+				else
+				{
+					insert_bits(target, bits, (uint32_t)code);
+				}
+			}
+			return true;
+		}
+
+		inline bool insert_compressed_ints(buffer *target, const uint32_t *values, size_t count)
+		{
+			return insert_compressed_array<uint32_t>(target, values, count);
+		}
+
+		inline bool insert_compressed_signed_ints(buffer *target, const int32_t *values, size_t count)
+		{
+			return insert_compressed_array<int32_t>(target, values, count);
+		}
+
+		// 64 bits starting at bit 'pos', zero filled past the end of the buffer.
+		inline uint64_t peek_word(const buffer *source, uint64_t pos)
+		{
+			const uint64_t byte = pos >> 3;
+			uint64_t w;
+			if (byte + 8 <= source->bufsize)
+			{
+				w = load_word(source->buf + byte);
+			}
+			else
+			{
+				w = 0;
+				for (uint64_t i=byte;i<source->bufsize;i++)
+					w |= (uint64_t)source->buf[i] << (8 * (i - byte));
+			}
+			return w >> (pos & 7);
+		}
+
+		template<typename T>
+		bool read_compressed_array(buffer *source, T *values, size_t count)
+		{
+			// every value is at least one bit.
+			const long left = bits_left(source);
+			if ((uint64_t)left < count)
+			{
+				source->error = 1;
+				return false;
+			}
+
+			const uint64_t start = (uint64_t)source->bytepos * 8 + source->bitpos;
+			const uint64_t limit = start + left;
+			uint64_t pos = start;
+			for (size_t i=0;i!=count;i++)
+			{
+				unsigned int bits;
+				values[i] = compressed_coding<T>::decode(peek_word(source, pos), &bits);
+				pos += bits;
+			}
+
+			if (pos > limit)
+			{
+				source->error = 1;
+				return false;
+			}
+
+			source->bytepos = (int)(pos >> 3);
+			source->bitpos = (bitofs_t)(pos & 7);
+			return true;
+		}
+
+		inline bool read_compressed_ints(buffer *source, uint32_t *values, size_t count)
+		{
+			return read_compressed_array<uint32_t>(source, values, count);
+		}
+
+		inline bool read_compressed_signed_ints(buffer *source, int32_t *values, size_t count)
+		{
+			return read_compressed_array<int32_t>(source, values, count);
+		}
+
+		inline void insert_float(buffer *target, float value)
+		{
+			uint32_t bits;
+			memcpy(&bits, &value, 4);
+			insert_bits<32>(target, bits);
+		}
+
+		inline float read_float(buffer *source)
+		{
+			const uint32_t bits = read_bits<32>(source);
+			float value;
+			memcpy(&value, &bits, 4);
+			return value;
+		}
 	}
 }
 
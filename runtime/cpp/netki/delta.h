@@ -0,0 +1,112 @@
+#ifndef __NETKI_DELTA_H__
+#define __NETKI_DELTA_H__
+
+#include <netki/bitstream.h>
+
+namespace netki
+{
+	namespace delta
+	{
+		// recent snapshots of one packet type for one connection, slot is sequence % SIZE. the
+		// sender keeps what it sent and encodes against the newest one the other end acknowledged,
+		// the receiver keeps what it decoded so later deltas have something to apply to.
+		template<typename T, int SIZE = 32>
+		struct baseline_ring
+		{
+			T snapshot[SIZE];
+			uint32_t sequence[SIZE];
+			bool used[SIZE];
+			bool has_acked;
+			uint32_t acked;
+		};
+
+		template<typename T, int SIZE>
+		void reset(baseline_ring<T, SIZE> *ring)
+		{
+			for (int i=0;i!=SIZE;i++)
+				ring->used[i] = false;
+			ring->has_acked = false;
+			ring->acked = 0;
+		}
+
+		template<typename T, int SIZE>
+		void store(baseline_ring<T, SIZE> *ring, uint32_t sequence, const T & packet)
+		{
+			const uint32_t slot = sequence % SIZE;
+			ring->snapshot[slot] = packet;
+			ring->sequence[slot] = sequence;
+			ring->used[slot] = true;
+		}
+
+		template<typename T, int SIZE>
+		const T* find(const baseline_ring<T, SIZE> *ring, uint32_t sequence)
+		{
+			const uint32_t slot = sequence % SIZE;
+			if (ring->used[slot] && ring->sequence[slot] == sequence)
+				return &ring->snapshot[slot];
+			return 0;
+		}
+
+		// sender side, when the other end confirms it has 'sequence'. older acks are ignored,
+		// sequence numbers may wrap.
+		template<typename T, int SIZE>
+		void acknowledge(baseline_ring<T, SIZE> *ring, uint32_t sequence)
+		{
+			if (!find(ring, sequence))
+				return;
+			if (!ring->has_acked || (int32_t)(sequence - ring->acked) > 0)
+			{
+				ring->acked = sequence;
+				ring->has_acked = true;
+			}
+		}
+
+		// sequence, then a bit telling if it is a delta and if so how far back the baseline is,
+		// then the packet written in full or against the baseline.
+		template<typename T, int SIZE>
+		void write(bitstream::buffer *buf, baseline_ring<T, SIZE> *sent, uint32_t sequence, const T & packet)
+		{
+			const T *base = sent->has_acked ? find(sent, sent->acked) : 0;
+			bitstream::insert_compressed_int(buf, sequence);
+			if (base)
+			{
+				bitstream::insert_bits<1>(buf, 1);
+				bitstream::insert_compressed_int(buf, sequence - sent->acked);
+				packet.write_delta_into_bitstream(buf, *base);
+			}
+			else
+			{
+				bitstream::insert_bits<1>(buf, 0);
+				packet.write_into_bitstream(buf);
+			}
+			store(sent, sequence, packet);
+		}
+
+		// fails if the baseline the sender used is no longer in the ring.
+		template<typename T, int SIZE>
+		bool read(bitstream::buffer *buf, baseline_ring<T, SIZE> *received, T *packet, uint32_t *sequence)
+		{
+			*sequence = bitstream::read_compressed_int(buf);
+			if (bitstream::read_bits<1>(buf))
+			{
+				const uint32_t distance = bitstream::read_compressed_int(buf);
+				const T *base = buf->error ? 0 : find(received, *sequence - distance);
+				if (!base)
+				{
+					buf->error = 1;
+					return false;
+				}
+				if (!packet->read_delta_from_bitstream(buf, *base))
+					return false;
+			}
+			else if (!packet->read_from_bitstream(buf))
+			{
+				return false;
+			}
+			store(received, *sequence, *packet);
+			return true;
+		}
+	}
+}
+
+#endif
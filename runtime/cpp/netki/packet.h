@@ -0,0 +1,100 @@
+#ifndef __NETKI_PACKET_H__
+#define __NETKI_PACKET_H__
+
+#include <netki/bitstream.h>
+#include <string>
+
+namespace netki
+{
+	// one of these per generated packet type; generated headers keep a table of them indexed
+	// by TYPE_ID. field coding is all inline in the generated read/write functions.
+	struct packet_handler
+	{
+		int type_id;
+		void* (*create)();
+		void (*destroy)(void *packet);
+		bool (*read)(bitstream::buffer *buf, void *packet);
+		void (*write)(bitstream::buffer *buf, const void *packet);
+	};
+
+	struct decoded_packet
+	{
+		int type_id;
+		void *packet;
+		const packet_handler *handler;
+	};
+
+	template<typename T>
+	void* create_packet()
+	{
+		return new T();
+	}
+
+	template<typename T>
+	void destroy_packet(void *packet)
+	{
+		delete (T*) packet;
+	}
+
+	template<typename T>
+	bool read_packet(bitstream::buffer *buf, void *packet)
+	{
+		return ((T*)packet)->read_from_bitstream(buf);
+	}
+
+	template<typename T>
+	void write_packet(bitstream::buffer *buf, const void *packet)
+	{
+		((const T*)packet)->write_into_bitstream(buf);
+	}
+
+	template<typename T>
+	packet_handler make_packet_handler()
+	{
+		packet_handler h = { T::TYPE_ID, create_packet<T>, destroy_packet<T>, read_packet<T>, write_packet<T> };
+		return h;
+	}
+
+	inline void free_packet(decoded_packet *pkt)
+	{
+		if (pkt->packet)
+			pkt->handler->destroy(pkt->packet);
+		pkt->packet = 0;
+	}
+
+	namespace bitstream
+	{
+		// length as a signed compressed int, then the bytes without byte alignment, like
+		// PutString/ReadString. empty and null strings are both written with length 0.
+		inline void insert_string(buffer *target, const std::string & value)
+		{
+			insert_compressed_signed_int(target, (int32_t) value.size());
+			for (size_t i=0;i!=value.size();i++)
+				insert_bits<8>(target, (uint8_t) value[i]);
+		}
+
+		inline void read_string(buffer *source, std::string *value)
+		{
+			const int32_t len = read_compressed_signed_int(source);
+			value->clear();
+			if (len > 65536)
+			{
+				source->error = 4;
+				return;
+			}
+			if (len <= 0 || source->error)
+				return;
+			if (bits_left(source) < (long)len * 8)
+			{
+				source->error = 1;
+				return;
+			}
+
+			value->resize(len);
+			for (int32_t i=0;i!=len;i++)
+				(*value)[i] = (char) read_bits<8>(source);
+		}
+	}
+}
+
+#endif
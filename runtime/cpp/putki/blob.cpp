@@ -1,9 +1,28 @@
 #include "log/log.h"
 
+#if defined(_MSC_VER)
+	#define BLOB_TLS __declspec(thread)
+#else
+	#define BLOB_TLS __thread
+#endif
+
 namespace putki
 {
 	typedef unsigned short strsize_t;
 
+	// matches STRING_POOL_REF in the builder.
+	static const unsigned int STRING_POOL_REF = 0x80000000;
+
+	// per thread, since lazily loaded packages post load their slots on whichever thread resolves them.
+	static BLOB_TLS const char *s_pool_beg = 0;
+	static BLOB_TLS const char *s_pool_end = 0;
+
+	void post_blob_load_set_string_pool(const char *beg, const char *end)
+	{
+		s_pool_beg = beg;
+		s_pool_end = end;
+	}
+
 	char* post_blob_load_string(const char **string, char* aux_beg, char* aux_end)
 	{
 		if (!aux_beg) {
@@ -15,6 +34,18 @@ namespace putki
 
 		*string = "<UNPACK FAIL>";
 
+		if (len & STRING_POOL_REF)
+		{
+			unsigned int ofs = len & ~STRING_POOL_REF;
+			if (!s_pool_beg || ofs >= (unsigned int)(s_pool_end - s_pool_beg))
+			{
+				PTK_ERROR("String pool reference out of range");
+				return 0;
+			}
+			*string = s_pool_beg + ofs;
+			return aux_beg;
+		}
+
 		if (aux_beg + len <= aux_end)
 		{
 			const char *last = aux_beg + len - 1;
@@ -3,4 +3,7 @@
 namespace putki
 {
 	char* post_blob_load_string(const char **string, char *aux_beg, char *aux_end);	
+
+	// string table used to resolve pooled string references; pkgmgr sets it around post blob load.
+	void post_blob_load_set_string_pool(const char *beg, const char *end);
 }
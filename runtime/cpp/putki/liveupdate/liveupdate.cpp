@@ -8,6 +8,7 @@
 #include <putki/log/log.h>
 
 #include <map>
+#include <mutex>
 #include <iostream>
 #include <cstdlib>
 #include <vector>
@@ -48,6 +49,8 @@ namespace putki
 		PathMap s_path2ptr;
 		PathToId s_path2id;
 		pathid_t s_pathid_counter = 100;
+		// lazy packages hook up objects from the threads that resolve them.
+		std::mutex s_maps_lock;
 	}
 
 	namespace liveupdate
@@ -109,13 +112,28 @@ namespace putki
 				return;
 			}
 
+			std::lock_guard<std::mutex> lock(s_maps_lock);
 			pathid_t path_id = get_path_id(path);
 			s_path2ptr[path_id] = ptr;
 			s_ptr2path[ptr] = path_id;
 		}
 
+		void unhook_object(instance_t ptr)
+		{
+			std::lock_guard<std::mutex> lock(s_maps_lock);
+			PtrToPath::iterator i = s_ptr2path.find(ptr);
+			if (i == s_ptr2path.end())
+				return;
+
+			PathMap::iterator j = s_path2ptr.find(i->second);
+			if (j != s_path2ptr.end() && j->second == ptr)
+				s_path2ptr.erase(j);
+			s_ptr2path.erase(i);
+		}
+
 		bool update_ptr(instance_t *ptr)
 		{
+			std::lock_guard<std::mutex> lock(s_maps_lock);
 			PtrToPath::const_iterator i = s_ptr2path.find(*ptr);
 			if (i != s_ptr2path.end())
 			{
@@ -26,6 +26,7 @@ namespace putki
 		inline bool connected(data *d) { return false; }
 		inline void update(data *d) { }
 		inline void hookup_object(instance_t ptr, const char *path) { }
+		inline void unhook_object(instance_t ptr) { }
 		inline bool should_reconnect() { return false; }
 
 		#define LIVE_UPDATE(x) false
@@ -37,6 +38,8 @@ namespace putki
 		bool connected(data *d);
 		void update(data *d);
 		void hookup_object(instance_t ptr, const char *path);
+		// before the object is freed, so its memory is not mistaken for it when reused.
+		void unhook_object(instance_t ptr);
 		// returns true if updated, then pointer for new asset.
 		bool update_ptr(instance_t *ptr);
 
@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <cstring>
 
 namespace putki
 {
@@ -34,7 +35,7 @@ namespace putki
 			return false;
 		}
 
-		pkgmgr::loaded_package * from_file(const char *file)
+		pkgmgr::loaded_package * from_file(const char *file, bool lazy, pkgmgr::resolve_status *opt_out)
 		{
 			char ptr[256];
 			putki::format_package_path(file, ptr);
@@ -88,7 +89,7 @@ namespace putki
 			in.read(data, readsize - hdr_size);
 			in.close();
 			
-			pkgmgr::loaded_package *p = pkgmgr::parse(header, data, &load_external_file, 0);
+			pkgmgr::loaded_package *p = lazy ? pkgmgr::parse_lazy(header, data, &load_external_file, opt_out) : pkgmgr::parse(header, data, &load_external_file, opt_out);
 			if (!p)
 			{
 				delete [] header;
@@ -97,7 +98,7 @@ namespace putki
 			else
 			{
 				delete [] header;
-				// assume it's been wholly resolved.
+				// assume it's been wholly resolved. lazy packages only hook up what is loaded so far.
 				pkgmgr::register_for_liveupdate(p);
 				pkgmgr::free_on_release(p);
 			}
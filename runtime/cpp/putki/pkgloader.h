@@ -6,6 +6,8 @@ namespace putki
 {
 	namespace pkgloader
 	{
-		pkgmgr::loaded_package* from_file(const char *file);
+		// lazy loads slots on first resolve, see pkgmgr::parse_lazy. opt_out receives the resolve
+		// status, for resolving pointers into other packages.
+		pkgmgr::loaded_package* from_file(const char *file, bool lazy = false, pkgmgr::resolve_status *opt_out = 0);
 	}
 }
@@ -8,6 +8,11 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <mutex>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <cstddef>
@@ -20,15 +25,32 @@ namespace putki
 		static const int PKG_FLAG_EXTERNAL   = 2;
 		static const int PKG_FLAG_INTERNAL   = 4;
 		static const int PKG_FLAG_UNRESOLVED = 8;
+		// internal slot sharing its bytes with an earlier slot; it is not post-loaded again.
+		static const int PKG_FLAG_ALIAS      = 16;
+		// internal slot whose pointers go through the remap table of an import, written by compaction.
+		static const int PKG_FLAG_REMAPPED   = 32;
+
+		// package header flags
+		static const uint32_t PKG_HDR_STRING_POOL  = 1;
+		static const uint32_t PKG_HDR_SLOT_ALIASES = 2;
+		static const uint32_t PKG_HDR_KNOWN_FLAGS  = PKG_HDR_STRING_POOL | PKG_HDR_SLOT_ALIASES;
+
+		// format version is kept in the upper 16 bits of the header flags. version 0 packages
+		// use 16 bit slot & import indices, version 1 uses 32 bit ones.
+		static const uint32_t PKG_FORMAT_VERSION   = 1;
 	
 		struct package_slot
 		{
 			const char *path;
 			instance_t obj, obj_end;
 			int16_t flags, type_id;
-			int16_t file_index, file_slot_index;
+			int32_t file_index, file_slot_index;
+			// where an external slot is read from, kept for lazy loads.
+			uint32_t ext_begin, ext_end;
 		};
 
+		struct lazy_state;
+
 		struct loaded_package
 		{
 			char *data;
@@ -36,6 +58,17 @@ namespace putki
 			package_slot *slots;
 			unsigned int slots_size;
 			unsigned int unresolved;
+			uint32_t data_size;
+			lazy_state *lazy;
+			// objects are hooked up for liveupdate, lazy ones as they become ready.
+			bool liveupdate;
+		};
+
+		struct import
+		{
+			char *import_path;
+			char *remap_table;
+			uint32_t remaps_count;
 		};
 
 		struct pkg_ptrs
@@ -43,17 +76,18 @@ namespace putki
 			struct entry
 			{
 				instance_t *ptr;
-				short index;
+				uint32_t index;
 			};
 
 			std::vector<entry> entries;
+			bool wide;
 
 			static void ptrwalker_callback(putki::ptr_info* info, void* user_data)
 			{
 				pkg_ptrs* th = (pkg_ptrs*)user_data;
 				entry e;
 				e.ptr = info->ptr;
-				e.index = *((unsigned short *)info->ptr);
+				e.index = th->wide ? *((uint32_t *)info->ptr) : *((uint16_t *)info->ptr);
 				th->entries.push_back(e);
 			}
 		};
@@ -63,6 +97,35 @@ namespace putki
 			pkg_ptrs ptrs;
 		};
 
+		// slot states in lazily parsed packages.
+		enum
+		{
+			SLOT_PENDING = 0,
+			SLOT_LOADING = 1,
+			SLOT_READY   = 2
+		};
+
+		struct lazy_state
+		{
+			// held while slots are materialized, ready slots are read without it.
+			std::mutex lock;
+			std::atomic<int> *state;
+			load_external_file_fn ext_loader;
+			// owned copy of the header, the imports point into it.
+			char *header;
+			std::vector<import> imports;
+			char *pool_beg, *pool_end;
+			bool wide;
+			// slot that owns the bytes of each alias slot, -1 for the others.
+			std::vector<int32_t> alias_of;
+			// gets the pointers into other packages as slots are materialized, if given to parse_lazy.
+			resolve_status *status;
+		};
+
+		// rewrite pointers written with the slot numbering of an older package into ours.
+		static void remap_pointers(import *ip, bool wide, pkg_ptrs &ptrs, size_t beg, size_t end);
+		static instance_t materialize(loaded_package *lp, unsigned int slot);
+
 		resolve_status *alloc_resolve_status()
 		{
 			return new resolve_status();
@@ -79,8 +142,46 @@ namespace putki
 		}
 
 		// returns number of unresolved pointers remaining.
+		// pointers of a lazy package are resolved without holding its lock, aux may be lazy too and
+		// resolving it would take that lock.
+		static int resolve_lazy_pointers_with(loaded_package *target, resolve_status *s, loaded_package *aux)
+		{
+			std::vector<pkg_ptrs::entry> pending;
+			{
+				std::lock_guard<std::mutex> lock(target->lazy->lock);
+				for (unsigned int i=0; i<s->ptrs.entries.size(); i++)
+				{
+					pkg_ptrs::entry &e = s->ptrs.entries[i];
+					if (e.index && !(*e.ptr) && !target->slots[e.index - 1].obj)
+						pending.push_back(e);
+				}
+			}
+
+			std::vector<instance_t> found(pending.size());
+			for (size_t i=0;i!=pending.size();i++)
+				found[i] = resolve(aux, target->slots[pending[i].index - 1].path);
+
+			int unresolved = 0;
+			std::lock_guard<std::mutex> lock(target->lazy->lock);
+			for (size_t i=0;i!=pending.size();i++)
+			{
+				if (found[i] && !(*pending[i].ptr))
+					*pending[i].ptr = found[i];
+			}
+			for (unsigned int i=0; i<s->ptrs.entries.size(); i++)
+			{
+				pkg_ptrs::entry &e = s->ptrs.entries[i];
+				if (e.index && !(*e.ptr) && !target->slots[e.index - 1].obj)
+					unresolved++;
+			}
+			return unresolved;
+		}
+
 		int resolve_pointers_with(loaded_package *target, resolve_status *s, loaded_package *aux)
 		{
+			if (target->lazy)
+				return resolve_lazy_pointers_with(target, s, aux);
+
 			int resolved = 0, unresolved = 0;
 			for (unsigned int i=0; i<s->ptrs.entries.size(); i++)
 			{
@@ -105,7 +206,113 @@ namespace putki
 
 			return unresolved;
 		}
+
+		int unresolve_pointers_into(loaded_package *target, resolve_status *s, loaded_package *aux)
+		{
+			std::unique_lock<std::mutex> lock;
+			if (target->lazy)
+				lock = std::unique_lock<std::mutex>(target->lazy->lock);
+
+			int cleared = 0;
+			for (unsigned int i=0; i<s->ptrs.entries.size(); i++)
+			{
+				pkg_ptrs::entry &e = s->ptrs.entries[i];
+				char *p = (char *)*e.ptr;
+				if (p >= aux->data && p < aux->data + aux->data_size)
+				{
+					*e.ptr = 0;
+					cleared++;
+				}
+			}
+			return cleared;
+		}
+
+		uint32_t loaded_size(loaded_package *lp)
+		{
+			return lp->data_size;
+		}
 		
+#if defined(PUTKI_ENABLE_ACCESS_PROFILE)
+		struct access_profile
+		{
+			// resolve and touch come from any thread.
+			std::mutex lock;
+			// object to slot path, for the slots of all loaded packages.
+			std::map<instance_t, const char *> objs;
+			std::set<std::string> seen;
+			std::vector<std::string> order;
+		};
+
+		static access_profile s_access_profile;
+
+		static void access_profile_record_locked(const char *path)
+		{
+			if (s_access_profile.seen.insert(path).second)
+				s_access_profile.order.push_back(path);
+		}
+
+		static void access_profile_record(const char *path)
+		{
+			std::lock_guard<std::mutex> lock(s_access_profile.lock);
+			access_profile_record_locked(path);
+		}
+
+		static void access_profile_hookup(loaded_package *lp)
+		{
+			std::lock_guard<std::mutex> lock(s_access_profile.lock);
+			for (unsigned int i=0;i!=lp->slots_size;i++)
+			{
+				if (lp->slots[i].obj && (lp->slots[i].flags & PKG_FLAG_PATH))
+					s_access_profile.objs.insert(std::make_pair(lp->slots[i].obj, lp->slots[i].path));
+			}
+		}
+
+		static void access_profile_unhook(loaded_package *lp)
+		{
+			std::lock_guard<std::mutex> lock(s_access_profile.lock);
+			for (unsigned int i=0;i!=lp->slots_size;i++)
+			{
+				std::map<instance_t, const char *>::iterator j = s_access_profile.objs.find(lp->slots[i].obj);
+				if (j != s_access_profile.objs.end() && j->second == lp->slots[i].path)
+					s_access_profile.objs.erase(j);
+			}
+		}
+
+		void touch(instance_t obj)
+		{
+			std::lock_guard<std::mutex> lock(s_access_profile.lock);
+			std::map<instance_t, const char *>::iterator i = s_access_profile.objs.find(obj);
+			if (i != s_access_profile.objs.end())
+				access_profile_record_locked(i->second);
+		}
+
+		bool write_access_profile(const char *file)
+		{
+			std::ofstream out(file);
+			if (!out.good())
+			{
+				PTK_ERROR("Could not write access profile to " << file)
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(s_access_profile.lock);
+			for (size_t i=0;i!=s_access_profile.order.size();i++)
+				out << s_access_profile.order[i] << "\n";
+			PTK_DEBUG("Wrote access profile with " << s_access_profile.order.size() << " slots to " << file)
+			return true;
+		}
+
+		void clear_access_profile()
+		{
+			std::lock_guard<std::mutex> lock(s_access_profile.lock);
+			s_access_profile.seen.clear();
+			s_access_profile.order.clear();
+		}
+#else
+		void touch(instance_t) { }
+		bool write_access_profile(const char *) { return false; }
+		void clear_access_profile() { }
+#endif
+
 		uint16_t parse_int16(char **src)
 		{
 			uint16_t *ptr = (uint16_t*) *src;
@@ -120,6 +327,12 @@ namespace putki
 			return *ptr;
 		}
 
+		// slot and import indices are 32 bit from format version 1.
+		int32_t parse_index(char **src, bool wide)
+		{
+			return wide ? (int32_t) parse_int32(src) : (int16_t) parse_int16(src);
+		}
+
 		// look at the first bytes and say if valid and how big the header is.
 		bool get_header_info(char *beg, char *end, uint32_t *total_header_size, uint32_t *total_data_size)
 		{		
@@ -133,45 +346,61 @@ namespace putki
 			return true;
 		}
 		
-		// parse from buffer
-		loaded_package * parse(char *header, char *data, load_external_file_fn ext_loader, resolve_status *opt_out)
+		// parse from buffer. with lazy set, slots are left for materialize.
+		static loaded_package * parse_package(char *header, char *data, load_external_file_fn ext_loader, resolve_status *opt_out, lazy_state *lazy)
 		{
 			char *hdr_rp = header;
-			const int16_t max_imports = 256;
 		
 			// grab headers.
 			/* const int32_t hdr_tag = */ parse_int32(&hdr_rp);
-			/* const int32_t flags = */ parse_int32(&hdr_rp);
+			const uint32_t hdr_flags = parse_int32(&hdr_rp);
 			const int32_t hdr_sz = parse_int32(&hdr_rp);
 			const int32_t data_sz = parse_int32(&hdr_rp);
-			
-			const int16_t num_imports = parse_int16(&hdr_rp);
-			
-			if (num_imports > max_imports)
+
+			const uint32_t version = hdr_flags >> 16;
+			if (version > PKG_FORMAT_VERSION)
 			{
-				PTK_ERROR("num_imports too large! bump max_imports or fix the problem otherwise")
+				PTK_ERROR("Package format version " << version << " is newer than supported version " << PKG_FORMAT_VERSION)
 				return 0;
 			}
+
+			if (hdr_flags & 0xffff & ~PKG_HDR_KNOWN_FLAGS)
+			{
+				PTK_ERROR("Package uses unsupported header flags " << (hdr_flags & 0xffff))
+				return 0;
+			}
+
+			const bool wide = version >= 1;
+
+			char *pool_beg = 0, *pool_end = 0;
+			if (hdr_flags & PKG_HDR_STRING_POOL)
+			{
+				pool_beg = data + (parse_int32(&hdr_rp) - hdr_sz);
+				pool_end = data + (parse_int32(&hdr_rp) - hdr_sz);
+			}
 			
-			struct import
+			const int32_t num_imports = parse_index(&hdr_rp, wide);
+			if (num_imports < 0)
 			{
-				char *import_path;
-				char *remap_table;
-				uint16_t remaps_count;
-			} parsed_imports[max_imports];
+				PTK_ERROR("Broken import count " << num_imports)
+				return 0;
+			}
+			
+			std::vector<import> parsed_imports(num_imports);
+			const int remap_entry_size = wide ? 8 : 4;
 						
-			for (int16_t i=0;i!=num_imports;i++)
+			for (int32_t i=0;i!=num_imports;i++)
 			{
 				import *imp = &parsed_imports[i];
 				
 				uint16_t name_length = parse_int16(&hdr_rp);
-				imp->remaps_count = parse_int16(&hdr_rp);
+				imp->remaps_count = wide ? parse_int32(&hdr_rp) : parse_int16(&hdr_rp);
 				
 				imp->import_path = hdr_rp;
 				imp->remap_table = hdr_rp + name_length;
 				
 				hdr_rp += name_length;
-				hdr_rp += 4 * imp->remaps_count;
+				hdr_rp += remap_entry_size * imp->remaps_count;
 				
 				PTK_DEBUG("Import " << i << ", name:" << imp->import_path << " remaps:" << imp->remaps_count);
 			}
@@ -179,7 +408,7 @@ namespace putki
 			PTK_DEBUG("File has " << num_imports << " external imports, and it will be " << data_sz << " when loaded");
 			PTK_DEBUG("Throw-away header is " << hdr_sz << " bytes")
 			
-			int slot_count = parse_int16(&hdr_rp);
+			const uint32_t slot_count = wide ? parse_int32(&hdr_rp) : parse_int16(&hdr_rp);
 			
 			loaded_package *lp = new loaded_package();
 			lp->should_free = false;
@@ -187,14 +416,22 @@ namespace putki
 			lp->slots_size = slot_count;
 			lp->slots = new package_slot[slot_count];
 			lp->unresolved = 0;
+			lp->data_size = data_sz;
+			lp->lazy = 0;
+			lp->liveupdate = false;
 			
 			pkg_ptrs _out_internal;
 			pkg_ptrs &ptrs = opt_out ? opt_out->ptrs : _out_internal;
+			ptrs.wide = wide;
 			
 			char *fake_base = 0;
 			char *tail_ptr = data;
+
+			// the string pool lives in the data section too, externals go after it.
+			if (pool_end > tail_ptr)
+				tail_ptr = pool_end;
 			
-			for (int i=0;i!=slot_count;i++)
+			for (uint32_t i=0;i!=slot_count;i++)
 			{
 				// path if wanted.
 				uint16_t flags = parse_int16(&hdr_rp);
@@ -207,18 +444,28 @@ namespace putki
 				}
 				else
 				{
-					lp->slots[i].path = "<>";
+					// owned like the real paths, release frees them all.
+					lp->slots[i].path = strdup("<>");
 				}
 				
 				lp->slots[i].flags = flags;
 				
 				if (flags & PKG_FLAG_EXTERNAL)
 				{
-					lp->slots[i].file_index = parse_int16(&hdr_rp);
-					lp->slots[i].file_slot_index = parse_int16(&hdr_rp);
+					lp->slots[i].file_index = parse_index(&hdr_rp, wide);
+					lp->slots[i].file_slot_index = parse_index(&hdr_rp, wide);
 					lp->slots[i].type_id = parse_int16(&hdr_rp);
 					lp->slots[i].obj = fake_base + parse_int32(&hdr_rp);
 					lp->slots[i].obj_end = fake_base + parse_int32(&hdr_rp);
+
+					if (lp->slots[i].file_index < 0 || lp->slots[i].file_index >= num_imports)
+					{
+						PTK_ERROR("Slot " << i << " imports from file " << lp->slots[i].file_index << " but there are only " << num_imports)
+						lp->slots[i].flags = PKG_FLAG_UNRESOLVED;
+						lp->slots[i].file_index = -1;
+						lp->slots[i].obj = 0;
+						lp->slots[i].type_id = 0;
+					}
 				}
 				else if (flags & PKG_FLAG_INTERNAL)
 				{
@@ -226,6 +473,16 @@ namespace putki
 					lp->slots[i].obj = data + (parse_int32(&hdr_rp) - hdr_sz);
 					lp->slots[i].obj_end = data + (parse_int32(&hdr_rp) - hdr_sz);
 					lp->slots[i].type_id = parse_int16(&hdr_rp);
+
+					if (flags & PKG_FLAG_REMAPPED)
+					{
+						lp->slots[i].file_index = parse_index(&hdr_rp, wide);
+						if (lp->slots[i].file_index < 0 || lp->slots[i].file_index >= num_imports)
+						{
+							PTK_ERROR("Slot " << i << " uses remap table " << lp->slots[i].file_index << " but there are only " << num_imports)
+							lp->slots[i].file_index = -1;
+						}
+					}
 					
 					// where to insert the external references.
 					if (lp->slots[i].obj_end > tail_ptr)
@@ -251,29 +508,65 @@ namespace putki
 			int ext_loads = 0;
 			for (unsigned int i=0;i!=slot_count;i++)
 			{
-				if (lp->slots[i].file_index != -1)
+				if (lp->slots[i].flags & PKG_FLAG_EXTERNAL)
 				{
+					lp->slots[i].ext_begin = (uint32_t)((char*)lp->slots[i].obj - fake_base);
+					lp->slots[i].ext_end = (uint32_t)((char*)lp->slots[i].obj_end - fake_base);
+
 					// Allocate at tail_ptr and fire off load call.
-					ext_loader(lp->slots[i].file_index, parsed_imports[lp->slots[i].file_index].import_path,
-					           (char*)lp->slots[i].obj - fake_base,
-						     (char*)lp->slots[i].obj_end - fake_base,
-						     tail_ptr);
-						     
+					if (!lazy)
+					{
+						ext_loader(lp->slots[i].file_index, parsed_imports[lp->slots[i].file_index].import_path,
+						           lp->slots[i].ext_begin, lp->slots[i].ext_end, tail_ptr);
+						ext_loads++;
+					}
+
 					lp->slots[i].obj_end = tail_ptr + ((char*)lp->slots[i].obj_end - (char*)lp->slots[i].obj);
 					lp->slots[i].obj = tail_ptr;
 					tail_ptr = (char*)lp->slots[i].obj_end;
-					ext_loads++;
 				}
 			}
+
+			if (lazy)
+			{
+				lazy->ext_loader = ext_loader;
+				lazy->imports = parsed_imports;
+				lazy->pool_beg = pool_beg;
+				lazy->pool_end = pool_end;
+				lazy->wide = wide;
+				lazy->state = new std::atomic<int>[slot_count];
+				lazy->alias_of.resize(slot_count, -1);
+
+				std::map<instance_t, int32_t> owners;
+				for (unsigned int i=0;i!=slot_count;i++)
+				{
+					lazy->state[i].store(SLOT_PENDING, std::memory_order_relaxed);
+					if ((lp->slots[i].flags & PKG_FLAG_INTERNAL) && !(lp->slots[i].flags & PKG_FLAG_ALIAS))
+						owners.insert(std::make_pair(lp->slots[i].obj, (int32_t)i));
+				}
+
+				for (unsigned int i=0;i!=slot_count;i++)
+				{
+					if (!(lp->slots[i].flags & PKG_FLAG_ALIAS))
+						continue;
+					std::map<instance_t, int32_t>::iterator owner = owners.find(lp->slots[i].obj);
+					if (owner != owners.end())
+						lazy->alias_of[i] = owner->second;
+				}
+
+				lp->lazy = lazy;
+				return lp;
+			}
 						
 			// flush loads
 			if (ext_loads)
 				ext_loader(0, 0, 0, 0, 0);
 			
 			// resolve objects
+			post_blob_load_set_string_pool(pool_beg, pool_end);
 			for (unsigned int i=0;i!=slot_count;i++)
 			{
-				if (lp->slots[i].obj)
+				if (lp->slots[i].obj && !(lp->slots[i].flags & PKG_FLAG_ALIAS))
 				{
 					const size_t ps0 = ptrs.entries.size();
 
@@ -297,46 +590,16 @@ namespace putki
 					}
 					
 					if (lp->slots[i].file_index >= 0)
-					{
-						import *ip = &parsed_imports[lp->slots[i].file_index];
-						if (ip >= parsed_imports + max_imports)
-						{
-							PTK_ERROR("Reading out of bounds for import table. file_index is broken.")
-							continue;
-						}
-							
-						size_t ps1 = ptrs.entries.size();
-						for (size_t i=ps0;i!=ps1;i++)
-						{
-							// remap all the pointers.
-							//
-							// TODO: Maybe make this faster than this.
-							short ptr = ptrs.entries[i].index;
-							if (!ptr)
-								continue;
-							
-							ptr = ptr - 1; // real slot ofs
-							char *remap_table = ip->remap_table;
-							for (int j=0;j!=ip->remaps_count;j++)
-							{
-								int16_t from = parse_int16(&remap_table);
-								int16_t to = parse_int16(&remap_table);
-								if (ptr == from)
-								{
-									PTK_WARNING("Remapping slot " << from << " to " << to)
-									ptrs.entries[i].index = to + 1;
-									break;
-								}
-							}
-						}
-					}
+						remap_pointers(&parsed_imports[lp->slots[i].file_index], wide, ptrs, ps0, ptrs.entries.size());
 				}
 			}
 
+			post_blob_load_set_string_pool(0, 0);
+
 			int resolved = 0, unresolved = 0;
 			for (unsigned int i=0;i<ptrs.entries.size(); i++)
 			{
-				if (ptrs.entries[i].index > 0 && ptrs.entries[i].index <= (int)lp->slots_size)
+				if (ptrs.entries[i].index > 0 && ptrs.entries[i].index <= lp->slots_size)
 				{
 					package_slot *slot = &lp->slots[ptrs.entries[i].index-1];
 					*(ptrs.entries[i].ptr) = slot->obj;
@@ -359,8 +622,191 @@ namespace putki
 			
 			lp->unresolved = unresolved;
 
+#if defined(PUTKI_ENABLE_ACCESS_PROFILE)
+			access_profile_hookup(lp);
+#endif
 			return lp;
 		}
+
+		loaded_package * parse(char *header, char *data, load_external_file_fn ext_loader, resolve_status *opt_out)
+		{
+			return parse_package(header, data, ext_loader, opt_out, 0);
+		}
+
+		loaded_package * parse_lazy(char *header, char *data, load_external_file_fn ext_loader, resolve_status *opt_out)
+		{
+			uint32_t hdr_sz, data_sz;
+			if (!get_header_info(header, header + 16, &hdr_sz, &data_sz))
+				return 0;
+
+			lazy_state *lazy = new lazy_state();
+			lazy->state = 0;
+			lazy->status = opt_out;
+			lazy->header = new char[hdr_sz];
+			memcpy(lazy->header, header, hdr_sz);
+
+			loaded_package *lp = parse_package(lazy->header, data, ext_loader, opt_out, lazy);
+			if (!lp)
+			{
+				delete [] lazy->header;
+				delete lazy;
+				return 0;
+			}
+
+#if defined(PUTKI_ENABLE_ACCESS_PROFILE)
+			access_profile_hookup(lp);
+#endif
+			return lp;
+		}
+
+		static void remap_pointers(import *ip, bool wide, pkg_ptrs &ptrs, size_t beg, size_t end)
+		{
+			for (size_t i=beg;i!=end;i++)
+			{
+				// remap all the pointers.
+				//
+				// TODO: Maybe make this faster than this.
+				uint32_t ptr = ptrs.entries[i].index;
+				if (!ptr)
+					continue;
+				
+				ptr = ptr - 1; // real slot ofs
+				char *remap_table = ip->remap_table;
+				for (uint32_t j=0;j!=ip->remaps_count;j++)
+				{
+					uint32_t from = parse_index(&remap_table, wide);
+					uint32_t to = parse_index(&remap_table, wide);
+					if (ptr == from)
+					{
+						PTK_WARNING("Remapping slot " << from << " to " << to)
+						ptrs.entries[i].index = to + 1;
+						break;
+					}
+				}
+			}
+		}
+
+		// loads, post loads and fixes up a slot of a lazy package. handed out pointers must be valid,
+		// so everything reachable from the slot is materialized along with it, one wave of pointer
+		// targets at a time so the external reads of a wave go out together.
+		static instance_t materialize(loaded_package *lp, unsigned int slot)
+		{
+			lazy_state *lz = lp->lazy;
+			if (lz->state[slot].load(std::memory_order_acquire) == SLOT_READY)
+				return lp->slots[slot].obj;
+
+			std::lock_guard<std::mutex> lock(lz->lock);
+
+			pkg_ptrs ptrs;
+			ptrs.wide = lz->wide;
+
+			std::vector<unsigned int> wave, claimed, loading;
+			wave.push_back(slot);
+
+			post_blob_load_set_string_pool(lz->pool_beg, lz->pool_end);
+			while (!wave.empty())
+			{
+				claimed.clear();
+
+				int ext_loads = 0;
+				for (size_t k=0;k!=wave.size();k++)
+				{
+					const unsigned int i = wave[k];
+					if (lz->state[i].load(std::memory_order_relaxed) != SLOT_PENDING)
+						continue;
+
+					lz->state[i].store(SLOT_LOADING, std::memory_order_relaxed);
+					claimed.push_back(i);
+					loading.push_back(i);
+
+					package_slot *ps = &lp->slots[i];
+					if (ps->flags & PKG_FLAG_EXTERNAL)
+					{
+						lz->ext_loader(ps->file_index, lz->imports[ps->file_index].import_path, ps->ext_begin, ps->ext_end, ps->obj);
+						ext_loads++;
+					}
+				}
+
+				if (ext_loads)
+					lz->ext_loader(0, 0, 0, 0, 0);
+
+				wave.clear();
+				for (size_t k=0;k!=claimed.size();k++)
+				{
+					const unsigned int i = claimed[k];
+					package_slot *ps = &lp->slots[i];
+					if (!ps->obj)
+						continue;
+
+					if (ps->flags & PKG_FLAG_ALIAS)
+					{
+						if (lz->alias_of[i] >= 0)
+							wave.push_back(lz->alias_of[i]);
+						continue;
+					}
+
+					const size_t ps0 = ptrs.entries.size();
+					const type_record* record = get_type_record(ps->type_id);
+					if (record && record->post_blob_load)
+					{
+						char* obj_ptr = (char*)ps->obj;
+						if (record->post_blob_load(obj_ptr, obj_ptr + record->size, (char*)ps->obj_end) != ps->obj_end)
+						{
+							PTK_WARNING("Post load by type (" << ps->type_id << ") did not consume all data.");
+						}
+						else
+						{
+							record->walk_dependencies(obj_ptr, pkg_ptrs::ptrwalker_callback, &ptrs);
+						}
+					}
+					else if (!record)
+					{
+						PTK_ERROR("No type record for type " << ps->type_id);
+					}
+
+					if (ps->file_index >= 0)
+						remap_pointers(&lz->imports[ps->file_index], lz->wide, ptrs, ps0, ptrs.entries.size());
+
+					for (size_t j=ps0;j!=ptrs.entries.size();j++)
+					{
+						const uint32_t index = ptrs.entries[j].index;
+						if (index > 0 && index <= lp->slots_size && lz->state[index-1].load(std::memory_order_relaxed) == SLOT_PENDING)
+							wave.push_back(index - 1);
+					}
+				}
+			}
+			post_blob_load_set_string_pool(0, 0);
+
+			for (size_t i=0;i!=ptrs.entries.size();i++)
+			{
+				const uint32_t index = ptrs.entries[i].index;
+				if (index > 0 && index <= lp->slots_size)
+				{
+					package_slot *target = &lp->slots[index-1];
+					*(ptrs.entries[i].ptr) = target->obj;
+					if (target->flags & PKG_FLAG_UNRESOLVED)
+					{
+						lp->unresolved++;
+						if (lz->status)
+							lz->status->ptrs.entries.push_back(ptrs.entries[i]);
+					}
+				}
+				else
+				{
+					*(ptrs.entries[i].ptr) = 0;
+				}
+			}
+
+			for (size_t i=0;i!=loading.size();i++)
+			{
+				package_slot *ps = &lp->slots[loading[i]];
+				if (lp->liveupdate && ps->obj && ps->path)
+					putki::liveupdate::hookup_object(ps->obj, ps->path);
+				lz->state[loading[i]].store(SLOT_READY, std::memory_order_release);
+			}
+
+			return lp->slots[slot].obj;
+		}
 		
 		int num_unresolved_slots(loaded_package *lp)
 		{
@@ -384,8 +830,16 @@ namespace putki
 			// maybe check here that there is nothing unresolved left. or we might start pointing into junk when stuff
 			// start pointing into this.
 
+			// slots becoming ready in materialize are hooked up there.
+			std::unique_lock<std::mutex> lock;
+			if (lp->lazy)
+				lock = std::unique_lock<std::mutex>(lp->lazy->lock);
+
+			lp->liveupdate = true;
 			for (unsigned int i=0; i!=lp->slots_size; i++)
 			{
+				if (lp->lazy && lp->lazy->state[i].load(std::memory_order_acquire) != SLOT_READY)
+					continue;
 				if (lp->slots[i].obj && lp->slots[i].path)
 					putki::liveupdate::hookup_object(lp->slots[i].obj, lp->slots[i].path);
 			}
@@ -393,12 +847,33 @@ namespace putki
 
 		void release(loaded_package *lp)
 		{
+#if defined(PUTKI_ENABLE_ACCESS_PROFILE)
+			access_profile_unhook(lp);
+#endif
+			if (lp->liveupdate)
+			{
+				for (unsigned int i=0; i!=lp->slots_size; i++)
+				{
+					if (lp->lazy && lp->lazy->state[i].load(std::memory_order_acquire) != SLOT_READY)
+						continue;
+					if (lp->slots[i].obj && lp->slots[i].path)
+						putki::liveupdate::unhook_object(lp->slots[i].obj);
+				}
+			}
+
 			if (lp->should_free)
 				delete [] lp->data;
 			
 			for (int i=0;i!=lp->slots_size;i++)
 				::free((void*)lp->slots[i].path);
 
+			if (lp->lazy)
+			{
+				delete [] lp->lazy->state;
+				delete [] lp->lazy->header;
+				delete lp->lazy;
+			}
+
 			delete [] lp->slots;
 			delete lp;
 		}
@@ -409,6 +884,11 @@ namespace putki
 			for (unsigned int i=0; i<p->slots_size; i++)
 			{
 				if (p->slots[i].obj && p->slots[i].path && !strcmp(p->slots[i].path, path)) {
+#if defined(PUTKI_ENABLE_ACCESS_PROFILE)
+					access_profile_record(p->slots[i].path);
+#endif
+					if (p->lazy)
+						return materialize(p, i);
 					return p->slots[i].obj;
 				}
 			}
@@ -3,6 +3,13 @@
 #include <cstdint>
 #include "types.h"
 
+#if defined(PUTKI_ENABLE_ACCESS_PROFILE)
+	// mark an object as used, for the access order profile. compiled away when profiling is off.
+	#define PKG_TOUCH(x) putki::pkgmgr::touch((putki::instance_t)(x))
+#else
+	#define PKG_TOUCH(x) do { } while (0)
+#endif
+
 namespace putki
 {
 	namespace pkgmgr
@@ -19,10 +26,18 @@ namespace putki
 		// parse from buffer, takes ownership.
 		// if opt_out is passed in, it will be filled with resolve stauts.
 		loaded_package * parse(char *header, char *data, load_external_file_fn ext_loader, resolve_status *opt_out);
+
+		// like parse, but nothing is loaded up front. a slot is read, post loaded and has its pointers
+		// fixed up on its first resolve, along with everything reachable from it. ext_loader is called
+		// then, so it must stay usable for the life of the package; the header is copied. resolve may
+		// be called from several threads. pointers to unresolved slots are left null. if opt_out is
+		// passed in, those pointers are added to it as slots are materialized, and resolve_pointers_with
+		// resolves the ones added so far; it needs calling again when num_unresolved_slots goes up.
+		loaded_package * parse_lazy(char *header, char *data, load_external_file_fn ext_loader, resolve_status *opt_out);
 		void free_on_release(loaded_package *);
 		void release(loaded_package *);
 
-		// must be resolved & done.
+		// must be resolved & done. slots of lazy packages are registered as they are materialized.
 		void register_for_liveupdate(loaded_package *);
 
 		resolve_status *alloc_resolve_status();
@@ -31,10 +46,24 @@ namespace putki
 		// returns number of unresolved pointers remaining.
 		int resolve_pointers_with(loaded_package *target, resolve_status *s, loaded_package *aux);
 
+		// nulls the pointers in target that resolve_pointers_with pointed into aux, before aux is
+		// released. returns how many there were.
+		int unresolve_pointers_into(loaded_package *target, resolve_status *s, loaded_package *aux);
+
+		// bytes of the data buffer, including external slots.
+		uint32_t loaded_size(loaded_package *);
+
 		// resolev from package.
 		instance_t resolve(loaded_package *, const char *path);
 		const char *path_in_package_slot(loaded_package *, unsigned int slot, bool only_if_content);
 		int num_unresolved_slots(loaded_package *);
 		int next_unresolved_slot(loaded_package *p, int start);
+
+		// access order profile. records the order in which loaded slots are first resolved or
+		// touched, and writes it as one path per line for the builder (--access-profile) to lay out
+		// packages with. does nothing unless built with PUTKI_ENABLE_ACCESS_PROFILE.
+		void touch(instance_t obj);
+		bool write_access_profile(const char *file);
+		void clear_access_profile();
 	}
 }
@@ -0,0 +1,240 @@
+#include "residency.h"
+#include "pkgloader.h"
+#include "log/log.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace putki
+{
+	namespace residency
+	{
+		struct package
+		{
+			std::string file;
+			pkgmgr::loaded_package *pkg;
+			pkgmgr::resolve_status *rs;
+			int refs;
+			int priority;
+			unsigned long last_use;
+			// pointers into other packages that do not point anywhere yet.
+			int unresolved;
+			// packages this one has pointers into.
+			std::set<package*> uses;
+		};
+
+		typedef std::map<std::string, package*> packages_t;
+
+		struct data
+		{
+			uint64_t budget;
+			uint64_t resident;
+			unsigned long clock;
+			packages_t packages;
+		};
+
+		data * create(uint64_t budget_bytes)
+		{
+			data *d = new data();
+			d->budget = budget_bytes;
+			d->resident = 0;
+			d->clock = 0;
+			return d;
+		}
+
+		// resolve what can be resolved in target from source, and remember if it used anything.
+		static void link(package *target, package *source)
+		{
+			if (!target->unresolved || target == source)
+				return;
+
+			int left = pkgmgr::resolve_pointers_with(target->pkg, target->rs, source->pkg);
+			if (left < target->unresolved)
+			{
+				PTK_DEBUG("Resolved " << (target->unresolved - left) << " pointers in " << target->file << " with " << source->file)
+				target->uses.insert(source);
+			}
+			target->unresolved = left;
+		}
+
+		static void evict(data *d, package *p)
+		{
+			PTK_DEBUG("Evicting " << p->file << " (" << pkgmgr::loaded_size(p->pkg) << " bytes)")
+			d->packages.erase(p->file);
+
+			for (packages_t::iterator i=d->packages.begin();i!=d->packages.end();i++)
+			{
+				package *user = i->second;
+				if (!user->uses.erase(p))
+					continue;
+
+				user->unresolved += pkgmgr::unresolve_pointers_into(user->pkg, user->rs, p->pkg);
+
+				// point them at the same objects in another package if there is one.
+				for (packages_t::iterator j=d->packages.begin();j!=d->packages.end();j++)
+					link(user, j->second);
+			}
+
+			d->resident -= pkgmgr::loaded_size(p->pkg);
+			pkgmgr::free_resolve_status(p->rs);
+			pkgmgr::release(p->pkg);
+			delete p;
+		}
+
+		static bool is_used(data *d, package *p)
+		{
+			for (packages_t::iterator i=d->packages.begin();i!=d->packages.end();i++)
+			{
+				if (i->second->uses.count(p))
+					return true;
+			}
+			return false;
+		}
+
+		// next to go is the lowest priority, then one no other package points into, then the least
+		// recently used.
+		static package * eviction_candidate(data *d, package *keep)
+		{
+			package *best = 0;
+			bool best_used = false;
+			for (packages_t::iterator i=d->packages.begin();i!=d->packages.end();i++)
+			{
+				package *p = i->second;
+				if (p->refs > 0 || p == keep)
+					continue;
+
+				const bool used = is_used(d, p);
+				if (!best || p->priority < best->priority ||
+				    (p->priority == best->priority && (used < best_used ||
+				    (used == best_used && p->last_use < best->last_use))))
+				{
+					best = p;
+					best_used = used;
+				}
+			}
+			return best;
+		}
+
+		static void enforce_budget(data *d, package *keep)
+		{
+			while (d->resident > d->budget)
+			{
+				package *p = eviction_candidate(d, keep);
+				if (!p)
+				{
+					PTK_DEBUG("Resident packages use " << d->resident << " bytes, budget is " << d->budget << " but nothing can be evicted")
+					break;
+				}
+				evict(d, p);
+			}
+		}
+
+		static package * load(data *d, const char *file, int priority)
+		{
+			pkgmgr::resolve_status *rs = pkgmgr::alloc_resolve_status();
+			pkgmgr::loaded_package *pkg = pkgloader::from_file(file, false, rs);
+			if (!pkg)
+			{
+				PTK_ERROR("Could not load package " << file)
+				pkgmgr::free_resolve_status(rs);
+				return 0;
+			}
+
+			package *p = new package();
+			p->file = file;
+			p->pkg = pkg;
+			p->rs = rs;
+			p->refs = 0;
+			p->priority = priority;
+			p->last_use = ++d->clock;
+			p->unresolved = pkgmgr::num_unresolved_slots(pkg);
+
+			for (packages_t::iterator i=d->packages.begin();i!=d->packages.end();i++)
+			{
+				link(p, i->second);
+				link(i->second, p);
+			}
+
+			d->packages.insert(packages_t::value_type(p->file, p));
+			d->resident += pkgmgr::loaded_size(pkg);
+			PTK_DEBUG("Loaded " << file << " (" << pkgmgr::loaded_size(pkg) << " bytes), " << p->unresolved << " pointers left unresolved")
+			return p;
+		}
+
+		pkgmgr::loaded_package * acquire(data *d, const char *file, int priority)
+		{
+			package *p;
+			packages_t::iterator i = d->packages.find(file);
+			if (i != d->packages.end())
+			{
+				p = i->second;
+				p->last_use = ++d->clock;
+			}
+			else
+			{
+				p = load(d, file, priority);
+				if (!p)
+					return 0;
+			}
+
+			p->priority = priority;
+			p->refs++;
+			enforce_budget(d, p);
+			return p->pkg;
+		}
+
+		void release(data *d, const char *file)
+		{
+			packages_t::iterator i = d->packages.find(file);
+			if (i == d->packages.end() || i->second->refs <= 0)
+			{
+				PTK_WARNING("Releasing package " << file << " which is not acquired")
+				return;
+			}
+
+			i->second->refs--;
+			i->second->last_use = ++d->clock;
+			enforce_budget(d, 0);
+		}
+
+		bool prefetch(data *d, const char *file, int priority)
+		{
+			if (d->packages.count(file))
+				return true;
+
+			if (d->resident >= d->budget)
+				return false;
+
+			package *p = load(d, file, priority);
+			if (!p)
+				return false;
+
+			enforce_budget(d, 0);
+			return d->packages.count(file) != 0;
+		}
+
+		bool is_resident(data *d, const char *file)
+		{
+			return d->packages.count(file) != 0;
+		}
+
+		void set_budget(data *d, uint64_t budget_bytes)
+		{
+			d->budget = budget_bytes;
+			enforce_budget(d, 0);
+		}
+
+		uint64_t resident_bytes(data *d)
+		{
+			return d->resident;
+		}
+
+		void free(data *d)
+		{
+			while (!d->packages.empty())
+				evict(d, d->packages.begin()->second);
+			delete d;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include "pkgmgr.h"
+
+namespace putki
+{
+	namespace residency
+	{
+		// keeps packages loaded from file resident within a memory budget. pointers between resident
+		// packages are resolved as packages come and go, and pointers into an evicted package are
+		// pointed at another resident package with the same object, or nulled. not thread safe.
+		struct data;
+
+		data * create(uint64_t budget_bytes);
+		void free(data *);
+
+		// evicts unreferenced packages until the resident ones fit.
+		void set_budget(data *, uint64_t budget_bytes);
+		uint64_t resident_bytes(data *);
+
+		// loads the package if it is not resident and takes a reference to it. referenced packages
+		// are never evicted. among unreferenced ones, lower priority goes first.
+		pkgmgr::loaded_package * acquire(data *, const char *file, int priority);
+		void release(data *, const char *file);
+
+		// loads the package without taking a reference, if it fits within the budget.
+		bool prefetch(data *, const char *file, int priority);
+
+		bool is_resident(data *, const char *file);
+	}
+}
@@ -1,25 +1,35 @@
 #include "types.h"
-#include <map>
+#include <vector>
 
 namespace putki
 {	
-	std::map<int, type_record> type_records;
+	// indexed by type id. the compiler hands out ids densely from 1, so this stays small; unused
+	// entries have id -1.
+	std::vector<type_record> type_records;
 
 	void insert_type_records(const type_record* begin, const type_record* end)
 	{
 		for (const type_record* i = begin; i != end; i++)
 		{
-			type_records.insert(std::make_pair(i->id, *i));
+			if (i->id < 0)
+				continue;
+
+			if ((unsigned int)i->id >= type_records.size())
+			{
+				type_record empty = { -1, 0, 0, 0 };
+				type_records.resize(i->id + 1, empty);
+			}
+
+			// first registration wins, like the map insert did.
+			if (type_records[i->id].id != i->id)
+				type_records[i->id] = *i;
 		}
 	}
 
 	const type_record* get_type_record(int type)
 	{
-		std::map<int, type_record>::iterator i = type_records.find(type);
-		if (i != type_records.end())
-		{
-			return &i->second;
-		}
+		if ((unsigned int)type < type_records.size() && type_records[type].id == type)
+			return &type_records[type];
 		return 0;
 	}
 }
@@ -38,6 +38,8 @@ namespace putki
 		unsigned int offset;
 	};
 	
+	// records are copied into a table indexed by type id; register them all before loading, since
+	// get_type_record pointers move when the table grows.
 	void insert_type_records(const type_record* begin, const type_record* end);
 	const type_record* get_type_record(int type);
 }
@@ -55,3 +55,59 @@ solution "Test"
         putki_use_runtime_lib()
         putki_typedefs_runtime("src/types", true)
 
+
+    project "test-benchmark-builder"
+        kind "ConsoleApp"
+        language "C++"
+        targetname "test-benchmark-builder"
+
+        files { "src/benchmark/builder-bench.cpp" }
+        links { "test-putki-lib" }
+
+        putki_use_builder_lib()
+        putki_typedefs_builder("src/types", false)
+
+    project "test-benchmark-runtime"
+        kind "ConsoleApp"
+        language "C++"
+        targetname "test-benchmark-runtime"
+
+        files { "src/benchmark/runtime-bench.cpp" }
+        putki_use_runtime_lib()
+        putki_typedefs_runtime("src/types", true)
+
+        configuration {"gmake", "linux"}
+            links {"pthread"}
+        configuration {}
+
+    project "test-benchmark-bitstream"
+        kind "ConsoleApp"
+        language "C++"
+        targetname "test-benchmark-bitstream"
+
+        files { "src/benchmark/bitstream-bench.cpp" }
+        putki_use_runtime_lib()
+
+    project "test-builder-tests"
+        kind "ConsoleApp"
+        language "C++"
+        targetname "test-builder-tests"
+
+        files { "src/tests/builder-tests.cpp" }
+        links { "test-putki-lib" }
+
+        putki_use_builder_lib()
+        putki_typedefs_builder("src/types", false)
+
+    project "test-runtime-tests"
+        kind "ConsoleApp"
+        language "C++"
+        targetname "test-runtime-tests"
+
+        files { "src/tests/runtime-tests.cpp" }
+        putki_use_runtime_lib()
+        putki_typedefs_runtime("src/types", true)
+
+        configuration {"gmake", "linux"}
+            links {"pthread"}
+        configuration {}
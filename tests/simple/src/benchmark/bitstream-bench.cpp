@@ -0,0 +1,420 @@
+// Bitstream benchmark. Encodes and decodes a batch of synthetic entity updates with the
+// byte at a time templates netki::bitstream used to have, the word based buffer calls and
+// the writer/reader accumulators, then a snapshot sized array of compressed ints one value
+// at a time and with the bulk calls. Checks that they agree on the bytes and prints json.
+
+#include <netki/bitstream.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace legacy
+{
+	using netki::bitstream::buffer;
+	using netki::bitstream::bitofs_t;
+	using netki::bitstream::bits_left;
+	using netki::bitstream::bitmask;
+
+	// the previous implementation, kept here as the baseline.
+	inline void set_bits(uint8_t *in, bitofs_t ofs, uint8_t value)
+	{
+		if (!ofs)
+			*in = value;
+		else
+			(*in) = (*in) | (value << ofs);
+	}
+
+	template<int bits>
+	void insert_bits(buffer *target, uint32_t value)
+	{
+		if (bits_left(target) < bits)
+		{
+			target->error = 1;
+			return;
+		}
+
+		if (bits > 8)
+		{
+			legacy::insert_bits<(bits > 8 ? 8 : 1)>(target, value & 0xff);
+			legacy::insert_bits<(bits > 8 ? bits - 8 : 1)>(target, value >> 8);
+			return;
+		}
+
+		const bitofs_t left = (8 - target->bitpos);
+		set_bits(&target->buf[target->bytepos], target->bitpos, value);
+
+		bitofs_t np = target->bitpos + bits;
+
+		if (bits > left)
+			set_bits(&target->buf[target->bytepos+1], 0, value >> left);
+
+		target->bytepos = target->bytepos + (np >> 3);
+		target->bitpos = np & 7;
+	}
+
+	uint32_t read_bits(buffer *source, unsigned int count);
+
+	template<int bits>
+	uint32_t read_bits(buffer *source)
+	{
+		if (bits_left(source) < bits)
+		{
+			source->error = 1;
+			return 0;
+		}
+
+		if (bits > 8)
+			return legacy::read_bits(source, bits);
+
+		const bitofs_t left = (8 - source->bitpos);
+
+		uint32_t fetch_first = left < bits ? left : bits;
+		uint32_t value = (source->buf[source->bytepos] >> source->bitpos) & bitmask[fetch_first];
+
+		bitofs_t np = source->bitpos + bits;
+		source->bytepos = source->bytepos + (np >> 3);
+		source->bitpos = np & 7;
+
+		if (fetch_first != bits)
+		{
+			uint32_t remaining = bits - fetch_first;
+			value = value | ((source->buf[source->bytepos] & bitmask[remaining]) << fetch_first);
+			source->bitpos = remaining;
+		}
+
+		return value;
+	}
+
+	inline uint32_t read_bits(buffer *source, unsigned int count)
+	{
+		switch (count)
+		{
+			case 0: return 0;
+			case 1: return legacy::read_bits<1>(source);
+			case 2: return legacy::read_bits<2>(source);
+			case 3: return legacy::read_bits<3>(source);
+			case 4: return legacy::read_bits<4>(source);
+			case 5: return legacy::read_bits<5>(source);
+			case 6: return legacy::read_bits<6>(source);
+			case 7: return legacy::read_bits<7>(source);
+			case 8: return legacy::read_bits<8>(source);
+			default:
+				return legacy::read_bits<8>(source) | (legacy::read_bits(source, count - 8) << 8);
+		}
+	}
+}
+
+namespace
+{
+	struct result
+	{
+		std::string name;
+		double ms;
+	};
+
+	std::vector<result> results;
+
+	struct timer
+	{
+		timer(const char *name, int iterations = 1) : _name(name), _iterations(iterations), _begin(std::chrono::high_resolution_clock::now()) { }
+		~timer()
+		{
+			result r;
+			r.name = _name;
+			r.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _begin).count() / _iterations;
+			results.push_back(r);
+		}
+		const char *_name;
+		int _iterations;
+		std::chrono::high_resolution_clock::time_point _begin;
+	};
+
+	// field widths of one entity update: alive, state, team, position x/y/z, heading, health, id.
+	struct update
+	{
+		uint32_t alive, state, team, x, y, z, heading, health, id;
+	};
+
+	const unsigned int BITS_PER_UPDATE = 1 + 3 + 5 + 16 + 16 + 16 + 12 + 7 + 32;
+
+	template<typename Put>
+	void encode(Put put, const std::vector<update> & updates)
+	{
+		for (size_t i=0;i!=updates.size();i++)
+		{
+			const update & u = updates[i];
+			put(1, u.alive);
+			put(3, u.state);
+			put(5, u.team);
+			put(16, u.x);
+			put(16, u.y);
+			put(16, u.z);
+			put(12, u.heading);
+			put(7, u.health);
+			put(32, u.id);
+		}
+	}
+
+	template<typename Get>
+	uint32_t decode(Get get, size_t count)
+	{
+		// sum it up so nothing is optimized away.
+		uint32_t sum = 0;
+		for (size_t i=0;i!=count;i++)
+		{
+			sum += get(1);
+			sum += get(3);
+			sum += get(5);
+			sum += get(16);
+			sum += get(16);
+			sum += get(16);
+			sum += get(12);
+			sum += get(7);
+			sum += get(32);
+		}
+		return sum;
+	}
+
+	void reset(netki::bitstream::buffer *b, std::vector<char> & data)
+	{
+		b->buf = (uint8_t*) &data[0];
+		b->bufsize = (uint32_t) data.size();
+		b->bitpos = 0;
+		b->bytepos = 0;
+		b->error = 0;
+	}
+
+	// the legacy templates need the width at compile time.
+	struct legacy_put
+	{
+		netki::bitstream::buffer *b;
+		void operator()(int bits, uint32_t v) const
+		{
+			switch (bits)
+			{
+				case 1: legacy::insert_bits<1>(b, v); break;
+				case 3: legacy::insert_bits<3>(b, v); break;
+				case 5: legacy::insert_bits<5>(b, v); break;
+				case 7: legacy::insert_bits<7>(b, v); break;
+				case 12: legacy::insert_bits<12>(b, v); break;
+				case 16: legacy::insert_bits<16>(b, v); break;
+				case 32: legacy::insert_bits<32>(b, v); break;
+			}
+		}
+	};
+
+	struct legacy_get
+	{
+		netki::bitstream::buffer *b;
+		uint32_t operator()(int bits) const { return legacy::read_bits(b, bits); }
+	};
+
+	struct buffer_put
+	{
+		netki::bitstream::buffer *b;
+		void operator()(int bits, uint32_t v) const { netki::bitstream::insert_bits(b, bits, v); }
+	};
+
+	struct buffer_get
+	{
+		netki::bitstream::buffer *b;
+		uint32_t operator()(int bits) const { return netki::bitstream::read_bits(b, bits); }
+	};
+
+	struct writer_put
+	{
+		netki::bitstream::writer *w;
+		void operator()(int bits, uint32_t v) const { netki::bitstream::put_bits(w, bits, v); }
+	};
+
+	struct reader_get
+	{
+		netki::bitstream::reader *r;
+		uint32_t operator()(int bits) const { return netki::bitstream::get_bits(r, bits); }
+	};
+}
+
+int main(int argc, char **argv)
+{
+	const char *json_out = 0;
+	int iterations = 50;
+	int count = 20000;
+
+	for (int i=1;i<argc;i++)
+	{
+		if (!strcmp(argv[i], "--json") && i+1 < argc)
+			json_out = argv[++i];
+		else if (!strcmp(argv[i], "--iterations") && i+1 < argc)
+			iterations = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--updates") && i+1 < argc)
+			count = atoi(argv[++i]);
+	}
+
+	std::vector<update> updates(count);
+	srand(1234);
+	for (int i=0;i!=count;i++)
+	{
+		update & u = updates[i];
+		u.alive = rand() & 1;
+		u.state = rand() & 7;
+		u.team = rand() & 31;
+		u.x = rand() & 0xffff;
+		u.y = rand() & 0xffff;
+		u.z = rand() & 0xffff;
+		u.heading = rand() & 0xfff;
+		u.health = rand() & 0x7f;
+		u.id = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	}
+
+	const size_t bytes = (size_t)count * BITS_PER_UPDATE / 8 + 16;
+	std::vector<char> legacy_data(bytes), buffer_data(bytes), writer_data(bytes);
+	netki::bitstream::buffer b;
+	uint32_t sums[3] = { 0, 0, 0 };
+
+	{
+		timer t("legacy_insert", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, legacy_data);
+			legacy_put p = { &b };
+			encode(p, updates);
+		}
+	}
+	{
+		timer t("legacy_read", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, legacy_data);
+			legacy_get g = { &b };
+			sums[0] = decode(g, updates.size());
+		}
+	}
+	{
+		timer t("buffer_insert", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, buffer_data);
+			buffer_put p = { &b };
+			encode(p, updates);
+		}
+	}
+	{
+		timer t("buffer_read", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, buffer_data);
+			buffer_get g = { &b };
+			sums[1] = decode(g, updates.size());
+		}
+	}
+	{
+		timer t("writer_insert", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, writer_data);
+			netki::bitstream::writer w;
+			netki::bitstream::begin_write(&w, &b);
+			writer_put p = { &w };
+			encode(p, updates);
+			netki::bitstream::end_write(&w);
+		}
+	}
+	{
+		timer t("reader_read", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, writer_data);
+			netki::bitstream::reader r;
+			netki::bitstream::begin_read(&r, &b);
+			reader_get g = { &r };
+			sums[2] = decode(g, updates.size());
+			netki::bitstream::end_read(&r);
+		}
+	}
+
+	// mostly small ids and counters with the odd large value, like snapshot arrays.
+	std::vector<uint32_t> ints(count * 4);
+	for (size_t i=0;i!=ints.size();i++)
+	{
+		const int r = rand() % 16;
+		ints[i] = r < 10 ? rand() & 0xff : r < 14 ? rand() & 0xffff : r < 15 ? ((uint32_t)rand() << 16) ^ (uint32_t)rand() : 0xffffffff;
+	}
+
+	const size_t int_bytes = ints.size() * 5 + 16;
+	std::vector<char> single_data(int_bytes), bulk_data(int_bytes);
+	std::vector<uint32_t> single_out(ints.size()), bulk_out(ints.size());
+	int single_end = 0, bulk_end = 0;
+
+	{
+		timer t("compressed_insert_single", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, single_data);
+			for (size_t j=0;j!=ints.size();j++)
+				netki::bitstream::insert_compressed_int(&b, ints[j]);
+			single_end = b.bytepos * 8 + b.bitpos;
+		}
+	}
+	{
+		timer t("compressed_read_single", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, single_data);
+			for (size_t j=0;j!=ints.size();j++)
+				single_out[j] = netki::bitstream::read_compressed_int(&b);
+		}
+	}
+	{
+		timer t("compressed_insert_bulk", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, bulk_data);
+			netki::bitstream::insert_compressed_ints(&b, &ints[0], ints.size());
+			bulk_end = b.bytepos * 8 + b.bitpos;
+		}
+	}
+	{
+		timer t("compressed_read_bulk", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			reset(&b, bulk_data);
+			netki::bitstream::read_compressed_ints(&b, &bulk_out[0], bulk_out.size());
+		}
+	}
+
+	const size_t used = (size_t)count * BITS_PER_UPDATE / 8;
+	const bool same_ints = single_end == bulk_end && !memcmp(&single_data[0], &bulk_data[0], (single_end + 7) / 8) &&
+	                       single_out == ints && bulk_out == ints;
+	const bool same = same_ints && !memcmp(&legacy_data[0], &buffer_data[0], used) && !memcmp(&legacy_data[0], &writer_data[0], used) &&
+	                  sums[0] == sums[1] && sums[0] == sums[2];
+
+	std::stringstream out;
+	out << "{\n\t\"benchmark\": \"bitstream\",\n\t\"updates\": " << count << ",\n\t\"bytes\": " << used;
+	out << ",\n\t\"identical\": " << (same ? "true" : "false") << ",\n\t\"iterations\": " << iterations << ",\n\t\"results_ms\": {";
+	for (unsigned int i=0;i!=results.size();i++)
+	{
+		char num[64];
+		sprintf(num, "%.4f", results[i].ms);
+		out << (i ? "," : "") << "\n\t\t\"" << results[i].name << "\": " << num;
+	}
+	out << "\n\t}\n}\n";
+
+	if (json_out)
+	{
+		std::ofstream f(json_out);
+		f << out.str();
+	}
+	else
+	{
+		std::cout << out.str();
+	}
+
+	return same ? 0 : 1;
+}
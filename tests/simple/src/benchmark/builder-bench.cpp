@@ -0,0 +1,430 @@
+// Builder side benchmark. Generates a synthetic data set out of the test types,
+// times the builder hot paths on it and writes the results as json. The package
+// it writes is picked up by runtime-bench.
+
+#include <putki/builder/build.h>
+#include <putki/builder/builder.h>
+#include <putki/builder/package.h>
+#include <putki/builder/inputset.h>
+#include <putki/builder/source.h>
+#include <putki/builder/parse.h>
+#include <putki/builder/typereg.h>
+#include <putki/builder/db.h>
+#include <putki/builder/write.h>
+#include <putki/builder/binary.h>
+#include <putki/builder/log.h>
+#include <putki/sys/files.h>
+#include <putki/sys/clock.h>
+#include <putki/sys/thread.h>
+#include <putki/sys/sstream.h>
+#include <putki/runtime.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+namespace inki
+{
+	void bind_test_proj();
+}
+
+namespace
+{
+	struct result
+	{
+		std::string name;
+		double ms;
+	};
+
+	std::vector<result> results;
+
+	struct timer
+	{
+		timer(const char *name) : _name(name), _begin(putki::sys::time_us()) { }
+		~timer()
+		{
+			result r;
+			r.name = _name;
+			r.ms = (putki::sys::time_us() - _begin) / 1000.0;
+			results.push_back(r);
+		}
+		const char *_name;
+		long long _begin;
+	};
+
+	unsigned int rng_state = 12345;
+	unsigned int rng()
+	{
+		rng_state = rng_state * 1103515245 + 12345;
+		return (rng_state >> 8);
+	}
+
+	void write_obj(const std::string &objpath, const std::string &path, const std::string &type, const std::string &data)
+	{
+		std::string full = objpath + "/" + path + ".json";
+		std::string content = "{\n\t\"type\": \"" + type + "\",\n\t\"data\": {" + data + "\n\t},\n\t\"aux\": [\n\t]\n}\n";
+		putki::sys::mk_dir_for_path(full.c_str());
+		putki::sys::write_file(full.c_str(), content.c_str(), (unsigned long) content.size());
+	}
+
+	// half Dummy objects, half TestArrays pointing at ptr_density of them each.
+	void generate(const std::string &objpath, int objects, int ptr_density, std::vector<std::string> *paths)
+	{
+		const int dummies = objects / 2 > 0 ? objects / 2 : 1;
+		char buf[256];
+
+		for (int i=0;i<dummies;i++)
+		{
+			sprintf(buf, "bench/dummy%d", i);
+			sprintf(buf + 128, "\n\t\t\"Debug\": \"Dummy number %d\"", i);
+			write_obj(objpath, buf, "Dummy", buf + 128);
+			paths->push_back(buf);
+		}
+
+		for (int i=0;i<objects-dummies;i++)
+		{
+			putki::sstream data;
+			data << "\n\t\t\"IntArray\": [";
+			for (int j=0;j<16;j++)
+				data << (j ? "," : "") << (int)(rng() % 100000);
+			data << "],\n\t\t\"StringArray\": [\"first string\", \"second string\", \"third string\"],\n\t\t\"PtrArray\": [";
+			for (int j=0;j<ptr_density;j++)
+				data << (j ? ", " : "") << "\"bench/dummy" << (int)(rng() % dummies) << "\"";
+			data << "],\n\t\t\"ByteArray\": \"aaabacadaeafagah\"";
+
+			sprintf(buf, "bench/arrays%d", i);
+			write_obj(objpath, buf, "TestArrays", data.c_str());
+			paths->push_back(buf);
+		}
+	}
+
+	// few objects with big pod arrays, for the package writing of bulk data.
+	void generate_large(const std::string &objpath, int objects, int array_size, std::vector<std::string> *paths)
+	{
+		char buf[256];
+		for (int i=0;i<objects;i++)
+		{
+			putki::sstream data;
+			data << "\n\t\t\"IntArray\": [";
+			for (int j=0;j<array_size;j++)
+				data << (j ? "," : "") << (int)(rng() % 100000);
+			data << "],\n\t\t\"ByteArray\": \"";
+			for (int j=0;j<array_size;j++)
+			{
+				char hex[3] = { (char)('a' + (j & 0xf)), (char)('a' + ((j >> 4) & 0xf)), 0 };
+				data << hex;
+			}
+			data << "\"";
+
+			sprintf(buf, "bench/large%d", i);
+			write_obj(objpath, buf, "TestArrays", data.c_str());
+			paths->push_back(buf);
+		}
+	}
+
+	struct counting_walker : public putki::depwalker_i
+	{
+		int pointers;
+		bool pointer_pre(putki::instance_t *on, const char *ptr_type)
+		{
+			pointers++;
+			return true;
+		}
+	};
+
+	struct null_resolver : public putki::load_resolver_i
+	{
+		void resolve_pointer(putki::instance_t *ptr, const char *path)
+		{
+			*ptr = 0;
+		}
+	};
+}
+
+int main(int argc, char **argv)
+{
+	int objects = 2000;
+	int ptr_density = 4;
+	int large_objects = 4;
+	int array_size = 256 * 1024;
+	int threads = 0;
+	const char *base = "bench-data";
+	const char *json_out = 0;
+	bool string_pool = false;
+
+	for (int i=1;i<argc;i++)
+	{
+		if (!strcmp(argv[i], "--objects") && i+1 < argc)
+			objects = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--ptr-density") && i+1 < argc)
+			ptr_density = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--large-objects") && i+1 < argc)
+			large_objects = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--array-size") && i+1 < argc)
+			array_size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--base") && i+1 < argc)
+			base = argv[++i];
+		else if (!strcmp(argv[i], "--json") && i+1 < argc)
+			json_out = argv[++i];
+		else if (!strcmp(argv[i], "--string-pool"))
+			string_pool = true;
+	}
+
+	putki::set_loglevel(putki::LOG_WARNING);
+	inki::bind_test_proj();
+
+	putki::runtime::descptr rt = putki::runtime::running();
+	std::string basepath(base);
+	std::string objpath = basepath + "/data/objs";
+	std::string respath = basepath + "/data/res";
+	std::string input_db = basepath + "/out/.bench-input-db";
+
+	std::vector<std::string> paths, large_paths;
+	{
+		timer t("generate");
+		generate(objpath, objects, ptr_density, &paths);
+		generate_large(objpath, large_objects, array_size, &large_paths);
+	}
+
+	// input set, first without and then with a previous input db.
+	remove(input_db.c_str());
+	{
+		timer t("inputset_scan_cold");
+		putki::inputset::data *is = putki::inputset::open(objpath.c_str(), respath.c_str(), input_db.c_str());
+		putki::inputset::write(is);
+		putki::inputset::release(is);
+	}
+	{
+		timer t("inputset_scan_warm");
+		putki::inputset::release(putki::inputset::open(objpath.c_str(), respath.c_str(), input_db.c_str()));
+	}
+
+	{
+		timer t("parse_and_fill");
+		null_resolver resolver;
+		for (unsigned int i=0;i!=paths.size();i++)
+		{
+			std::string file = objpath + "/" + paths[i] + ".json";
+			putki::parse::data *pd = putki::parse::parse(file.c_str());
+			if (!pd)
+				continue;
+
+			putki::parse::node *root = putki::parse::get_root(pd);
+			putki::type_handler_i *th = putki::typereg_get_handler(putki::parse::get_value_string(putki::parse::get_object_item(root, "type")));
+			if (th)
+			{
+				putki::instance_t obj = th->alloc();
+				th->fill_from_parsed(putki::parse::get_object_item(root, "data"), obj, &resolver);
+				th->free(obj);
+			}
+			putki::parse::free(pd);
+		}
+	}
+
+	putki::builder::data *builder = putki::builder::create(rt, base, true, "Default", threads);
+
+	putki::sys::mutex in_db_mtx, tmp_db_mtx, out_db_mtx;
+	putki::db::data *input = putki::db::create(0, &in_db_mtx);
+	putki::db::data *tmp = putki::db::create(input, &tmp_db_mtx);
+	putki::db::data *output = putki::db::create(tmp, &out_db_mtx);
+
+	putki::load_tree_into_db(objpath.c_str(), input);
+	putki::builder::build_context *ctx = putki::builder::create_context(builder, input, tmp, output);
+
+	putki::package::data *pkg = putki::package::create(output);
+	putki::package::set_string_pool(pkg, string_pool);
+	for (unsigned int i=0;i!=paths.size();i++)
+	{
+		putki::builder::context_add_to_build(ctx, paths[i].c_str());
+		putki::package::add(pkg, paths[i].c_str(), true);
+	}
+
+	putki::package::data *large_pkg = putki::package::create(output);
+	for (unsigned int i=0;i!=large_paths.size();i++)
+	{
+		putki::builder::context_add_to_build(ctx, large_paths[i].c_str());
+		putki::package::add(large_pkg, large_paths[i].c_str(), true);
+	}
+
+	putki::builder::context_finalize(ctx);
+	{
+		timer t("context_build");
+		putki::builder::context_build(ctx);
+	}
+
+	{
+		timer t("post_build_ptr_update");
+		putki::build::post_build_ptr_update(input, output, putki::builder::num_threads(builder));
+	}
+
+	// the built object cache, json against binary.
+	{
+		std::vector<putki::type_handler_i*> ths;
+		std::vector<putki::instance_t> objs;
+		for (unsigned int i=0;i!=paths.size();i++)
+		{
+			putki::type_handler_i *th;
+			putki::instance_t obj;
+			if (putki::db::fetch(output, paths[i].c_str(), &th, &obj, false))
+			{
+				ths.push_back(th);
+				objs.push_back(obj);
+			}
+		}
+
+		// full walks from every object, through the generated virtuals and through the layout tables.
+		int virtual_pointers = 0, layout_pointers = 0;
+		{
+			timer t("walk_dependencies_virtual");
+			for (unsigned int i=0;i!=objs.size();i++)
+			{
+				counting_walker w;
+				w.pointers = 0;
+				ths[i]->walk_dependencies(objs[i], &w, true);
+				virtual_pointers += w.pointers;
+			}
+		}
+		{
+			timer t("walk_dependencies_layout");
+			for (unsigned int i=0;i!=objs.size();i++)
+			{
+				counting_walker w;
+				w.pointers = 0;
+				putki::walk_dependencies(ths[i], objs[i], &w, true);
+				layout_pointers += w.pointers;
+			}
+		}
+		if (virtual_pointers != layout_pointers)
+		{
+			std::cerr << "walk_dependencies saw " << layout_pointers << " pointers, the virtual walk " << virtual_pointers << std::endl;
+			return 1;
+		}
+
+		putki::db::snapshot *snap = putki::db::take_snapshot(output);
+		{
+			timer t("cache_write_json");
+			for (unsigned int i=0;i!=objs.size();i++)
+			{
+				putki::write::scoped_stream ss;
+				putki::write::write_object_into_stream(*ss.stream, output, ths[i], objs[i]);
+			}
+		}
+		{
+			timer t("cache_write_json_compact");
+			for (unsigned int i=0;i!=objs.size();i++)
+			{
+				putki::write::scoped_stream ss;
+				putki::write::write_object_into_stream(*ss.stream, output, ths[i], objs[i], true);
+			}
+		}
+		{
+			timer t("cache_write_binary");
+			for (unsigned int i=0;i!=objs.size();i++)
+			{
+				putki::sstream ss;
+				putki::write::write_object_binary(ss, snap, putki::db::pathof(snap, objs[i]), ths[i], objs[i]);
+			}
+		}
+
+		std::vector<std::string> blobs(objs.size());
+		for (unsigned int i=0;i!=objs.size();i++)
+		{
+			putki::sstream ss;
+			ths[i]->write_binary(snap, objs[i], ss);
+			blobs[i].assign(ss.c_str(), ss.size());
+		}
+		putki::db::free_snapshot(snap);
+
+		{
+			timer t("cache_read_binary");
+			null_resolver resolver;
+			for (unsigned int i=0;i!=blobs.size();i++)
+			{
+				putki::binary::reader in;
+				putki::binary::init(&in, blobs[i].data(), blobs[i].data() + blobs[i].size());
+				putki::instance_t obj = ths[i]->alloc();
+				ths[i]->read_binary(&in, obj, &resolver);
+				ths[i]->free(obj);
+			}
+		}
+	}
+
+	const long bufsize = 256 * 1024 * 1024;
+	char *buf = new char[bufsize];
+	long large_bytes;
+	{
+		timer t("package_write_large_arrays");
+		putki::sstream manifest;
+		large_bytes = putki::package::write(large_pkg, rt, buf, bufsize, putki::builder::get_build_db(builder), manifest);
+	}
+
+	// the main package goes last so it is what is left in the buffer.
+	long bytes;
+	{
+		timer t("package_write");
+		putki::sstream manifest;
+		bytes = putki::package::write(pkg, rt, buf, bufsize, putki::builder::get_build_db(builder), manifest);
+	}
+
+	if (bytes < 0 || large_bytes < 0)
+	{
+		std::cerr << "package write failed" << std::endl;
+		return 1;
+	}
+
+	std::string pkg_path = basepath + "/out/bench.pkg";
+	putki::sys::mk_dir_for_path(pkg_path.c_str());
+	putki::sys::write_file(pkg_path.c_str(), buf, bytes);
+
+	// and where the runtime package loader looks for it, for the residency benchmark.
+	std::string loader_path = std::string(putki::builder::out_path(builder)) + "/packages/bench.pkg";
+	putki::sys::mk_dir_for_path(loader_path.c_str());
+	putki::sys::write_file(loader_path.c_str(), buf, bytes);
+
+	// runtime-bench resolves these.
+	std::string paths_file = basepath + "/out/bench.paths";
+	std::ofstream pf(paths_file.c_str());
+	for (unsigned int i=0;i!=paths.size();i++)
+		pf << paths[i] << "\n";
+	pf.close();
+
+	delete [] buf;
+	putki::package::free(pkg);
+	putki::package::free(large_pkg);
+	putki::db::free_and_destroy_objs(input);
+	putki::db::free_and_destroy_objs(tmp);
+	putki::db::free_and_destroy_objs(output);
+	putki::builder::context_destroy(ctx);
+	putki::builder::free(builder);
+
+	putki::sstream out;
+	out << "{\n\t\"benchmark\": \"builder\",\n\t\"objects\": " << objects << ",\n\t\"ptr_density\": " << ptr_density;
+	out << ",\n\t\"large_objects\": " << large_objects << ",\n\t\"array_size\": " << array_size;
+	out << ",\n\t\"string_pool\": " << (string_pool ? "true" : "false");
+	out << ",\n\t\"package_bytes\": " << (long long)bytes << ",\n\t\"large_package_bytes\": " << (long long)large_bytes << ",\n\t\"results_ms\": {";
+	for (unsigned int i=0;i!=results.size();i++)
+	{
+		char num[64];
+		sprintf(num, "%.3f", results[i].ms);
+		out << (i ? "," : "") << "\n\t\t\"" << results[i].name.c_str() << "\": " << num;
+	}
+	out << "\n\t}\n}\n";
+
+	if (json_out)
+	{
+		std::ofstream f(json_out);
+		f.write(out.c_str(), out.size());
+	}
+	else
+	{
+		std::cout.write(out.c_str(), out.size());
+	}
+
+	return 0;
+}
@@ -0,0 +1,233 @@
+// Runtime side benchmark. Loads the package written by builder-bench and times
+// pkgmgr::parse and pkgmgr::resolve on it, eagerly and lazily, and package residency evicting
+// and reloading it. Results are written as json.
+
+#include <outki/test_proj.h>
+
+#include <putki/pkgmgr.h>
+#include <putki/residency.h>
+#include <putki/config.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	struct result
+	{
+		std::string name;
+		double ms;
+	};
+
+	std::vector<result> results;
+
+	struct timer
+	{
+		timer(const char *name, int iterations = 1) : _name(name), _iterations(iterations), _begin(std::chrono::high_resolution_clock::now()) { }
+		~timer()
+		{
+			result r;
+			r.name = _name;
+			r.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _begin).count() / _iterations;
+			results.push_back(r);
+		}
+		const char *_name;
+		int _iterations;
+		std::chrono::high_resolution_clock::time_point _begin;
+	};
+
+	bool read_file(const char *path, std::vector<char> *out)
+	{
+		std::ifstream f(path, std::ios::binary);
+		if (!f.good())
+			return false;
+		f.seekg(0, std::ios::end);
+		out->resize((size_t)f.tellg());
+		f.seekg(0, std::ios::beg);
+		f.read(&(*out)[0], out->size());
+		return true;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *base = "bench-data";
+	const char *json_out = 0;
+	int iterations = 20;
+
+	for (int i=1;i<argc;i++)
+	{
+		if (!strcmp(argv[i], "--base") && i+1 < argc)
+			base = argv[++i];
+		else if (!strcmp(argv[i], "--json") && i+1 < argc)
+			json_out = argv[++i];
+		else if (!strcmp(argv[i], "--iterations") && i+1 < argc)
+			iterations = atoi(argv[++i]);
+	}
+
+	outki::bind_test_proj();
+
+	std::string pkg_path = std::string(base) + "/out/bench.pkg";
+	std::vector<char> file;
+	if (!read_file(pkg_path.c_str(), &file))
+	{
+		std::cerr << "Could not read " << pkg_path << ", run builder-bench first." << std::endl;
+		return 1;
+	}
+
+	std::vector<std::string> paths;
+	std::ifstream pf((std::string(base) + "/out/bench.paths").c_str());
+	std::string line;
+	while (std::getline(pf, line))
+	{
+		if (!line.empty())
+			paths.push_back(line);
+	}
+
+	uint32_t hdr_size, data_size;
+	if (!putki::pkgmgr::get_header_info(&file[0], &file[0] + file.size(), &hdr_size, &data_size))
+	{
+		std::cerr << "Bad package header in " << pkg_path << std::endl;
+		return 1;
+	}
+
+	// parse patches up the data in place, so every iteration gets a fresh copy.
+	std::vector<char*> copies;
+	for (int i=0;i<iterations;i++)
+	{
+		char *data = new char[data_size];
+		memcpy(data, &file[hdr_size], file.size() - hdr_size);
+		copies.push_back(data);
+	}
+
+	putki::pkgmgr::loaded_package *pkg = 0;
+	{
+		timer t("pkgmgr_parse", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			putki::pkgmgr::loaded_package *p = putki::pkgmgr::parse(&file[0], copies[i], 0, 0);
+			if (i == iterations - 1)
+				pkg = p;
+			else if (p)
+				putki::pkgmgr::release(p);
+		}
+	}
+
+	if (!pkg)
+	{
+		std::cerr << "Failed to parse " << pkg_path << std::endl;
+		return 1;
+	}
+
+	int found = 0;
+	{
+		timer t("pkgmgr_resolve_all", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			found = 0;
+			for (unsigned int j=0;j!=paths.size();j++)
+			{
+				if (putki::pkgmgr::resolve(pkg, paths[j].c_str()))
+					found++;
+			}
+		}
+	}
+
+	putki::pkgmgr::release(pkg);
+
+	// lazy parse with every path resolved from several threads at once, each thread starting at
+	// a different place so they race for the same slots.
+	const int threads = 4;
+	std::atomic<int> lazy_found(0);
+	{
+		timer t("pkgmgr_lazy_resolve_threads", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			memcpy(copies[i], &file[hdr_size], file.size() - hdr_size);
+			putki::pkgmgr::loaded_package *lazy = putki::pkgmgr::parse_lazy(&file[0], copies[i], 0, 0);
+			if (!lazy)
+				break;
+
+			lazy_found = 0;
+			std::vector<std::thread> workers;
+			for (int k=0;k<threads;k++)
+			{
+				workers.push_back(std::thread([&, k] {
+					for (size_t j=0;j!=paths.size();j++)
+					{
+						if (putki::pkgmgr::resolve(lazy, paths[(j + k * paths.size() / threads) % paths.size()].c_str()))
+							lazy_found++;
+					}
+				}));
+			}
+			for (int k=0;k<threads;k++)
+				workers[k].join();
+			putki::pkgmgr::release(lazy);
+		}
+	}
+
+	if (lazy_found != found * threads)
+	{
+		std::cerr << "Lazy resolve found " << lazy_found << " objects, expected " << (found * threads) << std::endl;
+		return 1;
+	}
+
+	for (int i=0;i<iterations;i++)
+		delete [] copies[i];
+
+	// with no budget the package is evicted on every release and loaded again on acquire.
+	const std::string out_prefix = std::string(base) + "/out";
+	putki::set_output_path_prefix(out_prefix.c_str());
+	putki::residency::data *resident = putki::residency::create(0);
+	{
+		timer t("residency_evict_reload", iterations);
+		for (int i=0;i<iterations;i++)
+		{
+			putki::pkgmgr::loaded_package *p = putki::residency::acquire(resident, "bench.pkg", 0);
+			if (!p || (!paths.empty() && !putki::pkgmgr::resolve(p, paths[0].c_str())))
+			{
+				std::cerr << "Residency could not load bench.pkg from " << out_prefix << std::endl;
+				return 1;
+			}
+			putki::residency::release(resident, "bench.pkg");
+			if (putki::residency::is_resident(resident, "bench.pkg"))
+			{
+				std::cerr << "bench.pkg stayed resident without a budget" << std::endl;
+				return 1;
+			}
+		}
+	}
+	putki::residency::free(resident);
+
+	std::stringstream out;
+	out << "{\n\t\"benchmark\": \"runtime\",\n\t\"package_bytes\": " << file.size() << ",\n\t\"paths\": " << paths.size();
+	out << ",\n\t\"resolved\": " << found << ",\n\t\"iterations\": " << iterations << ",\n\t\"results_ms\": {";
+	for (unsigned int i=0;i!=results.size();i++)
+	{
+		char num[64];
+		sprintf(num, "%.4f", results[i].ms);
+		out << (i ? "," : "") << "\n\t\t\"" << results[i].name << "\": " << num;
+	}
+	out << "\n\t}\n}\n";
+
+	if (json_out)
+	{
+		std::ofstream f(json_out);
+		f << out.str();
+	}
+	else
+	{
+		std::cout << out.str();
+	}
+
+	return 0;
+}
@@ -0,0 +1,437 @@
+// Builder side tests. Builds a small data set out of the test types and writes the packages
+// runtime-tests loads and checks. Returns non-zero if any check failed.
+
+#include <putki/builder/build.h>
+#include <putki/builder/builder.h>
+#include <putki/builder/build-db.h>
+#include <putki/builder/inputset.h>
+#include <putki/builder/package.h>
+#include <putki/builder/source.h>
+#include <putki/builder/write.h>
+#include <putki/builder/db.h>
+#include <putki/builder/log.h>
+#include <putki/sys/files.h>
+#include <putki/sys/thread.h>
+#include <putki/sys/clock.h>
+#include <putki/sys/sstream.h>
+#include <putki/runtime.h>
+
+#include <inki/types/t1.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+namespace inki
+{
+	void bind_test_proj();
+}
+
+namespace
+{
+	int failures = 0;
+
+	#define CHECK(x) do { if (!(x)) { std::cerr << __FILE__ << " (" << __LINE__ << "): check failed: " << #x << std::endl; failures++; } } while (0)
+
+	void write_obj(const std::string &objpath, const char *path, const char *type, const std::string &data)
+	{
+		std::string full = objpath + "/" + path + ".json";
+		std::string content = std::string("{\n\t\"type\": \"") + type + "\",\n\t\"data\": {" + data + "\n\t},\n\t\"aux\": [\n\t]\n}\n";
+		putki::sys::mk_dir_for_path(full.c_str());
+		putki::sys::write_file(full.c_str(), content.c_str(), (unsigned long) content.size());
+	}
+
+	// same_a and same_b are byte identical once built, for the slot alias packages.
+	void generate(const std::string &objpath)
+	{
+		write_obj(objpath, "tests/dummy0", "Dummy", "\n\t\t\"Debug\": \"first dummy\"");
+		write_obj(objpath, "tests/dummy1", "Dummy", "\n\t\t\"Debug\": \"second dummy\"");
+		write_obj(objpath, "tests/same_a", "Dummy", "\n\t\t\"Debug\": \"same\"");
+		write_obj(objpath, "tests/same_b", "Dummy", "\n\t\t\"Debug\": \"same\"");
+		write_obj(objpath, "tests/arrays", "TestArrays", "\n\t\t\"IntArray\": [1, -2, 300000],\n\t\t\"StringArray\": [\"one\", \"two\"],\n\t\t\"PtrArray\": [\"tests/dummy0\", \"tests/dummy1\"],\n\t\t\"ByteArray\": \"bacdpp\",\n\t\t\"EnumArray\": [\"VALUE_500\", \"DEFAULT\"]");
+		write_obj(objpath, "tests/aliased", "TestArrays", "\n\t\t\"PtrArray\": [\"tests/same_a\", \"tests/same_b\", \"tests/dummy0\"]");
+	}
+
+	// everything the packages are written from, built the way a full build does it.
+	struct built_data
+	{
+		putki::builder::data *builder;
+		putki::sys::mutex in_db_mtx, tmp_db_mtx, out_db_mtx;
+		putki::db::data *input, *tmp, *output;
+		putki::builder::build_context *ctx;
+	};
+
+	void build(built_data *bd, putki::runtime::descptr rt, const char *base, const char **paths, unsigned int count)
+	{
+		bd->builder = putki::builder::create(rt, base, true, "Default", 0);
+		bd->input = putki::db::create(0, &bd->in_db_mtx);
+		bd->tmp = putki::db::create(bd->input, &bd->tmp_db_mtx);
+		bd->output = putki::db::create(bd->tmp, &bd->out_db_mtx);
+		putki::load_tree_into_db(putki::builder::obj_path(bd->builder), bd->input);
+		bd->ctx = putki::builder::create_context(bd->builder, bd->input, bd->tmp, bd->output);
+		for (unsigned int i=0;i!=count;i++)
+			putki::builder::context_add_to_build(bd->ctx, paths[i]);
+		putki::builder::context_finalize(bd->ctx);
+		putki::builder::context_build(bd->ctx);
+		putki::build::post_build_ptr_update(bd->input, bd->output, putki::builder::num_threads(bd->builder));
+	}
+
+	void release(built_data *bd)
+	{
+		putki::db::free_and_destroy_objs(bd->input);
+		putki::db::free_and_destroy_objs(bd->tmp);
+		putki::db::free_and_destroy_objs(bd->output);
+		putki::builder::context_destroy(bd->ctx);
+		putki::builder::free(bd->builder);
+	}
+
+	std::string package_dir(built_data *bd)
+	{
+		return std::string(putki::builder::out_path(bd->builder)) + "/packages";
+	}
+
+	// into the directory the runtime package loader reads from, with the manifest later
+	// packages are patched against.
+	bool write_package(built_data *bd, putki::package::data *pkg, const char *name)
+	{
+		const long bufsize = 16 * 1024 * 1024;
+		std::vector<char> buf(bufsize);
+		putki::sstream manifest;
+		long bytes = putki::package::write(pkg, putki::builder::runtime(bd->builder), &buf[0], bufsize, putki::builder::get_build_db(bd->builder), manifest);
+		putki::package::free(pkg);
+		if (bytes < 0)
+			return false;
+
+		std::string path = package_dir(bd) + "/" + name;
+		std::string manifest_path = path + ".manifest";
+		putki::sys::mk_dir_for_path(path.c_str());
+		return putki::sys::write_file(path.c_str(), &buf[0], bytes) && putki::sys::write_file(manifest_path.c_str(), manifest.c_str(), (unsigned long) manifest.size());
+	}
+
+	// tests/arrays and tests/dummy1 are stored without paths, tests/dummy0 with one.
+	void test_pathless_slots(built_data *bd)
+	{
+		putki::package::data *pkg = putki::package::create(bd->output);
+		putki::package::add(pkg, "tests/arrays", false);
+		putki::package::add(pkg, "tests/dummy1", false);
+		putki::package::add(pkg, "tests/dummy0", true);
+		CHECK(write_package(bd, pkg, "pathless.pkg"));
+	}
+
+	putki::package::data *contents_package(built_data *bd)
+	{
+		putki::package::data *pkg = putki::package::create(bd->output);
+		putki::package::add(pkg, "tests/arrays", true);
+		putki::package::add(pkg, "tests/aliased", true);
+		putki::package::add(pkg, "tests/dummy0", true);
+		return pkg;
+	}
+
+	// the same objects with each package option, plus a patch on top of base.pkg and the patch
+	// compacted into one file. runtime-tests checks they all load the same.
+	void test_packages(built_data *bd)
+	{
+		CHECK(write_package(bd, contents_package(bd), "plain.pkg"));
+
+		putki::package::data *pool = contents_package(bd);
+		putki::package::set_string_pool(pool, true);
+		CHECK(write_package(bd, pool, "pool.pkg"));
+
+		putki::package::data *alias = contents_package(bd);
+		putki::package::set_slot_aliases(alias, true);
+		CHECK(write_package(bd, alias, "alias.pkg"));
+
+		putki::package::data *base = putki::package::create(bd->output);
+		putki::package::add(base, "tests/dummy0", true);
+		putki::package::add(base, "tests/dummy1", true);
+		putki::package::add(base, "tests/same_a", true);
+		putki::package::add(base, "tests/same_b", true);
+		CHECK(write_package(bd, base, "base.pkg"));
+
+		const std::string dir = package_dir(bd);
+		putki::package::data *patch = contents_package(bd);
+		putki::package::add_previous_package(patch, dir.c_str(), "base.pkg");
+		CHECK(write_package(bd, patch, "patch.pkg"));
+
+		CHECK(putki::package::compact(dir.c_str(), "patch.pkg", "compact.pkg"));
+	}
+
+	// built objects written to the binary cache and loaded back into an empty database.
+	void test_binary_cache(built_data *bd, const std::string &cache_dir)
+	{
+		const char *paths[] = { "tests/dummy0", "tests/arrays" };
+		putki::db::snapshot *snapshot = putki::db::take_snapshot(bd->output);
+		std::string truncated;
+		for (unsigned int i=0;i!=2;i++)
+		{
+			putki::type_handler_i *th;
+			putki::instance_t obj;
+			CHECK(putki::db::fetch(bd->output, paths[i], &th, &obj));
+
+			putki::sstream ss;
+			putki::write::write_object_binary(ss, snapshot, paths[i], th, obj);
+			std::string file = cache_dir + "/" + paths[i] + ".bin";
+			putki::sys::mk_dir_for_path(file.c_str());
+			CHECK(putki::sys::write_file(file.c_str(), ss.c_str(), (unsigned long) ss.size()));
+			truncated.assign(ss.c_str(), ss.size() - 3);
+		}
+		putki::db::free_snapshot(snapshot);
+
+		putki::sys::mutex mtx;
+		putki::db::data *loaded = putki::db::create(0, &mtx);
+		putki::type_handler_i *th;
+		putki::instance_t obj;
+
+		CHECK(putki::is_cached_object_current(cache_dir.c_str(), "tests/arrays"));
+		putki::load_file_into_db(cache_dir.c_str(), "tests/arrays", loaded, false);
+		CHECK(putki::db::fetch(loaded, "tests/arrays", &th, &obj, false));
+		inki::test_arrays *arrays = (inki::test_arrays *) obj;
+		if (arrays)
+		{
+			CHECK(arrays->int_array.size() == 3 && arrays->int_array[0] == 1 && arrays->int_array[1] == -2 && arrays->int_array[2] == 300000);
+			CHECK(arrays->string_array.size() == 2 && arrays->string_array[0] == "one" && arrays->string_array[1] == "two");
+			CHECK(arrays->byte_array.size() == 3 && arrays->byte_array[0] == 16 && arrays->byte_array[1] == 35 && arrays->byte_array[2] == 255);
+			CHECK(arrays->enum_array.size() == 2 && (int) arrays->enum_array[0] == 500 && (int) arrays->enum_array[1] == 0);
+			// pointers come back unresolved, by path.
+			CHECK(arrays->ptr_array.size() == 2);
+			for (unsigned int i=0;i!=arrays->ptr_array.size() && i!=2;i++)
+			{
+				const char *target = putki::db::is_unresolved_pointer(loaded, arrays->ptr_array[i]);
+				CHECK(target && !strcmp(target, i ? "tests/dummy1" : "tests/dummy0"));
+			}
+		}
+
+		putki::load_file_into_db(cache_dir.c_str(), "tests/dummy0", loaded, false);
+		CHECK(putki::db::fetch(loaded, "tests/dummy0", &th, &obj, false));
+		inki::dummy *dummy = (inki::dummy *) obj;
+		CHECK(dummy && dummy->debug == "first dummy" && (int) dummy->enum_value == 100);
+
+		// a cut short file is not inserted at all.
+		std::string file = cache_dir + "/tests/truncated.bin";
+		putki::sys::write_file(file.c_str(), truncated.c_str(), (unsigned long) truncated.size());
+		putki::load_file_into_db(cache_dir.c_str(), "tests/truncated", loaded, false);
+		CHECK(!putki::db::fetch(loaded, "tests/truncated", &th, &obj, false));
+
+		putki::db::free_and_destroy_objs(loaded);
+	}
+
+	bool same_signature(void *, const char *path, bool external_resource, char *sig_out)
+	{
+		strcpy(sig_out, external_resource ? "sig-png" : "sig-y");
+		return true;
+	}
+
+	bool new_signature(void *, const char *path, bool external_resource, char *sig_out)
+	{
+		strcpy(sig_out, external_resource ? "sig-png" : "sig-y2");
+		return true;
+	}
+
+	bool png_changed(void *, const char *path, bool external_resource)
+	{
+		return external_resource && !strcmp(path, "res/x.png");
+	}
+
+	// the build wide lines (g, n, k, l) and the per record ones (m, x) stored and loaded back.
+	void test_build_db(const std::string &base)
+	{
+		const std::string path = base + "/test.build-db";
+		putki::build_db::data *d = putki::build_db::create(path.c_str(), false);
+		putki::build_db::set_inputs_signature(d, "inputs-sig");
+		putki::build_db::set_packaging_signature(d, "packaging-sig");
+		putki::build_db::set_package_file(d, "packages/a.pkg", "12:34");
+		putki::build_db::set_package_contents(d, "a.pkg", "contents-sig");
+
+		putki::build_db::record *y = putki::build_db::create_record("tests/y", "sig-y");
+		putki::build_db::add_output(y, "tests/y", "default");
+		putki::build_db::commit_record(d, y);
+
+		putki::build_db::record *x = putki::build_db::create_record("tests/x", "sig-x");
+		putki::build_db::add_input_dependency(x, "tests/y", "sig-y");
+		putki::build_db::add_external_resource_dependency(x, "res/x.png", "sig-png");
+		putki::build_db::add_output(x, "tests/x", "default");
+		putki::build_db::commit_record(d, x);
+
+		putki::build_db::record *z = putki::build_db::create_record("tests/z", "sig-z");
+		putki::build_db::add_input_dependency(z, "tests/y", "sig-y");
+		putki::build_db::add_output(z, "tests/z", "default");
+		putki::build_db::commit_record(d, z);
+
+		const std::string x_sig = putki::build_db::get_input_signature(x);
+		putki::build_db::store(d);
+		putki::build_db::release(d);
+
+		d = putki::build_db::create(path.c_str(), true);
+		CHECK(!strcmp(putki::build_db::get_inputs_signature(d), "inputs-sig"));
+		CHECK(!strcmp(putki::build_db::get_packaging_signature(d), "packaging-sig"));
+		const char *stamp = putki::build_db::get_package_file(d, "packages/a.pkg");
+		CHECK(stamp && !strcmp(stamp, "12:34"));
+		const char *contents = putki::build_db::get_package_contents(d, "a.pkg");
+		CHECK(contents && !strcmp(contents, "contents-sig"));
+
+		x = putki::build_db::find(d, "tests/x");
+		CHECK(x != 0);
+		if (!x)
+		{
+			putki::build_db::release(d);
+			return;
+		}
+
+		CHECK(x_sig == putki::build_db::get_input_signature(x));
+		CHECK(!putki::build_db::is_dirty(x));
+
+		char sig[SIG_BUF_SIZE];
+		const char *changed;
+		CHECK(putki::build_db::current_input_signature(x, same_signature, 0, sig, &changed) == 2);
+		CHECK(x_sig == sig && !changed);
+		CHECK(putki::build_db::current_input_signature(x, new_signature, 0, sig, &changed) == 2);
+		CHECK(x_sig != sig && changed && !strcmp(changed, "tests/y"));
+
+		putki::build_db::mark_dirty_records(d, png_changed, 0);
+		CHECK(putki::build_db::is_dirty(x));
+		putki::build_db::store(d);
+		putki::build_db::release(d);
+
+		// the flag is kept until the record is replaced.
+		d = putki::build_db::create(path.c_str(), true);
+		x = putki::build_db::find(d, "tests/x");
+		z = putki::build_db::find(d, "tests/z");
+		CHECK(x && putki::build_db::is_dirty(x));
+		CHECK(z && !putki::build_db::is_dirty(z));
+		putki::build_db::release(d);
+	}
+
+	// how many times each object went through a data builder.
+	putki::sys::mutex s_built_mtx;
+	std::map<std::string, int> s_built;
+
+	struct counting_builder : putki::builder::handler_i
+	{
+		virtual const char *version() { return "counting-builder"; }
+
+		virtual bool handle(putki::builder::build_context *ctx, putki::builder::data *builder, putki::build_db::record *record, putki::db::data *input, const char *path, putki::instance_t obj)
+		{
+			putki::sys::scoped_maybe_lock lk(&s_built_mtx);
+			s_built[path]++;
+			return true;
+		}
+	};
+
+	counting_builder s_counting_builder;
+
+	void register_counting_builders(putki::builder::data *builder)
+	{
+		putki::builder::add_data_builder(builder, "Dummy", &s_counting_builder);
+		putki::builder::add_data_builder(builder, "TestArrays", &s_counting_builder);
+	}
+
+	void incremental_packages(putki::db::data *out, putki::build::packaging_config *pconf)
+	{
+		putki::package::data *main = putki::package::create(out);
+		putki::package::add(main, "tests/arrays", true);
+		putki::build::commit_package(main, pconf, "main.pkg");
+
+		putki::package::data *other = putki::package::create(out);
+		putki::package::add(other, "tests/other", true);
+		putki::build::commit_package(other, pconf, "other.pkg");
+	}
+
+	int built(const char *path)
+	{
+		std::map<std::string, int>::iterator i = s_built.find(path);
+		return i != s_built.end() ? i->second : 0;
+	}
+
+	std::string full_build(const std::string &base, bool reset)
+	{
+		s_built.clear();
+		putki::builder::data *builder = putki::builder::create(putki::runtime::running(), base.c_str(), reset, "Default", 0);
+		putki::build::full_build(builder, false);
+		putki::builder::write_build_db(builder);
+		std::string packages = std::string(putki::builder::out_path(builder)) + "/packages/";
+		putki::builder::free(builder);
+		return packages;
+	}
+
+	bool same_stamp(const putki::sys::file_info &a, const putki::sys::file_info &b)
+	{
+		return a.mtime == b.mtime && a.mtime_ns == b.mtime_ns && a.size == b.size;
+	}
+
+	// builds twice without changes and once more after editing tests/dummy1. only what changed
+	// goes through a builder again and only the package it is in is written again.
+	void test_incremental(const std::string &base)
+	{
+		const std::string objpath = base + "/data/objs";
+		generate(objpath);
+		write_obj(objpath, "tests/other", "Dummy", "\n\t\t\"Debug\": \"other\"");
+
+		putki::builder::set_builder_configurator(register_counting_builders);
+		putki::builder::set_packager(incremental_packages);
+
+		const std::string packages = full_build(base, true);
+		const std::string main_pkg = packages + "main.pkg", other_pkg = packages + "other.pkg";
+		CHECK(built("tests/arrays") == 1 && built("tests/dummy0") == 1 && built("tests/dummy1") == 1 && built("tests/other") == 1);
+		CHECK(!built("tests/same_a") && !built("tests/aliased"));
+
+		putki::sys::file_info main0, other0, main1, other1;
+		CHECK(putki::sys::stat(main_pkg.c_str(), &main0) && putki::sys::stat(other_pkg.c_str(), &other0));
+
+		// stamps have to be able to tell the builds apart.
+		putki::sys::sleep_ms(1100);
+		full_build(base, false);
+		CHECK(s_built.empty());
+		CHECK(putki::sys::stat(main_pkg.c_str(), &main1) && same_stamp(main0, main1));
+		CHECK(putki::sys::stat(other_pkg.c_str(), &other1) && same_stamp(other0, other1));
+
+		putki::sys::sleep_ms(1100);
+		write_obj(objpath, "tests/dummy1", "Dummy", "\n\t\t\"Debug\": \"edited dummy\"");
+		full_build(base, false);
+		// tests/arrays only points at it, the pointer is hooked up again when packaging.
+		CHECK(built("tests/dummy1") == 1 && s_built.size() == 1);
+		CHECK(putki::sys::stat(main_pkg.c_str(), &main1) && !same_stamp(main0, main1));
+		CHECK(putki::sys::stat(other_pkg.c_str(), &other1) && same_stamp(other0, other1));
+
+		putki::builder::set_builder_configurator(0);
+		putki::builder::set_packager(0);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *base = "test-data";
+	for (int i=1;i<argc;i++)
+	{
+		if (!strcmp(argv[i], "--base") && i+1 < argc)
+			base = argv[++i];
+	}
+
+	putki::set_loglevel(putki::LOG_WARNING);
+	inki::bind_test_proj();
+
+	std::string objpath = std::string(base) + "/data/objs";
+	generate(objpath);
+
+	const char *paths[] = { "tests/dummy0", "tests/dummy1", "tests/same_a", "tests/same_b", "tests/arrays", "tests/aliased" };
+	built_data bd;
+	build(&bd, putki::runtime::running(), base, paths, sizeof(paths) / sizeof(paths[0]));
+	test_pathless_slots(&bd);
+	test_packages(&bd);
+	test_binary_cache(&bd, std::string(base) + "/cache");
+	release(&bd);
+
+	test_build_db(base);
+	test_incremental(std::string(base) + "/incremental");
+
+	if (failures)
+	{
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "All builder tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,331 @@
+// Runtime side tests. Loads the packages written by builder-tests and checks what comes out
+// of them, and round trips the netki packets. Returns non-zero if any check failed.
+
+#include <outki/types/t1.h>
+#include <outki/test_proj.h>
+#include <netki/test_proj.h>
+#include <netki/delta.h>
+
+#include <putki/pkgmgr.h>
+#include <putki/pkgloader.h>
+#include <putki/residency.h>
+#include <putki/config.h>
+
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	int failures = 0;
+
+	#define CHECK(x) do { if (!(x)) { std::cerr << __FILE__ << " (" << __LINE__ << "): check failed: " << #x << std::endl; failures++; } } while (0)
+
+	// slots stored without a path get a placeholder name, which release frees with the rest.
+	void test_pathless_slots()
+	{
+		putki::pkgmgr::loaded_package *pkg = putki::pkgloader::from_file("pathless.pkg");
+		CHECK(pkg != 0);
+		if (!pkg)
+			return;
+
+		unsigned int slots = 0, named = 0;
+		for (;putki::pkgmgr::path_in_package_slot(pkg, slots, false);slots++)
+		{
+			if (!strcmp(putki::pkgmgr::path_in_package_slot(pkg, slots, false), "tests/dummy0"))
+				named++;
+		}
+		CHECK(slots == 3 && named == 1);
+
+		outki::dummy *d = (outki::dummy *) putki::pkgmgr::resolve(pkg, "tests/dummy0");
+		CHECK(d && !strcmp(d->debug, "first dummy"));
+		CHECK(!putki::pkgmgr::resolve(pkg, "tests/arrays"));
+		putki::pkgmgr::release(pkg);
+
+		// without a budget every release evicts, so each acquire loads it again.
+		putki::residency::data *resident = putki::residency::create(0);
+		for (int i=0;i<3;i++)
+		{
+			putki::pkgmgr::loaded_package *p = putki::residency::acquire(resident, "pathless.pkg", 0);
+			CHECK(p && putki::pkgmgr::resolve(p, "tests/dummy0"));
+			putki::residency::release(resident, "pathless.pkg");
+			CHECK(!putki::residency::is_resident(resident, "pathless.pkg"));
+		}
+		putki::residency::free(resident);
+	}
+
+	// what pkgloader does, but counting the reads from other package files.
+	int external_loads = 0;
+
+	bool counting_loader(int file_index, const char *path, uint32_t beg, uint32_t end, void *target)
+	{
+		if (!path)
+			return true;
+
+		external_loads++;
+		char buf[1024];
+		putki::format_package_path(path, buf);
+		std::ifstream in(buf, std::ios::binary);
+		in.seekg(beg, std::ios::beg);
+		in.read((char*)target, end - beg);
+		return in.gcount() == (std::streamsize)(end - beg);
+	}
+
+	putki::pkgmgr::loaded_package *load(const char *file, bool lazy)
+	{
+		char buf[1024];
+		putki::format_package_path(file, buf);
+		std::ifstream in(buf, std::ios::binary);
+		char header_peek[16];
+		in.read(header_peek, sizeof(header_peek));
+
+		uint32_t hdr_size, data_size;
+		if (!in.good() || !putki::pkgmgr::get_header_info(header_peek, header_peek + sizeof(header_peek), &hdr_size, &data_size))
+			return 0;
+
+		in.seekg(0, std::ios::end);
+		unsigned long size = (unsigned long)in.tellg();
+		char *header = new char[hdr_size];
+		char *data = new char[data_size];
+		in.seekg(0, std::ios::beg);
+		in.read(header, hdr_size);
+		in.read(data, size - hdr_size);
+
+		putki::pkgmgr::loaded_package *p = lazy ? putki::pkgmgr::parse_lazy(header, data, &counting_loader, 0) : putki::pkgmgr::parse(header, data, &counting_loader, 0);
+		delete [] header;
+		if (!p)
+			delete [] data;
+		else
+			putki::pkgmgr::free_on_release(p);
+		return p;
+	}
+
+	// the second word of the header, format version in the upper half.
+	unsigned int header_flags(const char *file)
+	{
+		char buf[1024];
+		putki::format_package_path(file, buf);
+		std::ifstream in(buf, std::ios::binary);
+		unsigned char hdr[8] = { 0 };
+		in.read((char *)hdr, sizeof(hdr));
+		return hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((unsigned int)hdr[7] << 24);
+	}
+
+	// what builder-tests put into every package made by contents_package.
+	void check_contents(putki::pkgmgr::loaded_package *pkg)
+	{
+		outki::test_arrays *arrays = (outki::test_arrays *) putki::pkgmgr::resolve(pkg, "tests/arrays");
+		CHECK(arrays != 0);
+		if (arrays)
+		{
+			CHECK(arrays->int_array_size == 3 && arrays->int_array[0] == 1 && arrays->int_array[1] == -2 && arrays->int_array[2] == 300000);
+			CHECK(arrays->string_array_size == 2 && !strcmp(arrays->string_array[0], "one") && !strcmp(arrays->string_array[1], "two"));
+			CHECK(arrays->byte_array_size == 3 && arrays->byte_array[0] == 16 && arrays->byte_array[1] == 35 && arrays->byte_array[2] == 255);
+			CHECK(arrays->enum_array_size == 2 && (int) arrays->enum_array[0] == 500 && (int) arrays->enum_array[1] == 0);
+			CHECK(arrays->ptr_array_size == 2);
+			if (arrays->ptr_array_size == 2)
+			{
+				CHECK(arrays->ptr_array[0] && !strcmp(arrays->ptr_array[0]->debug, "first dummy"));
+				CHECK(arrays->ptr_array[1] && !strcmp(arrays->ptr_array[1]->debug, "second dummy"));
+			}
+		}
+
+		outki::dummy *dummy = (outki::dummy *) putki::pkgmgr::resolve(pkg, "tests/dummy0");
+		CHECK(dummy && !strcmp(dummy->debug, "first dummy") && (int) dummy->enum_value == 100);
+		CHECK(!arrays || arrays->ptr_array_size != 2 || arrays->ptr_array[0] == dummy);
+
+		outki::test_arrays *aliased = (outki::test_arrays *) putki::pkgmgr::resolve(pkg, "tests/aliased");
+		CHECK(aliased && aliased->ptr_array_size == 3 && !aliased->int_array_size);
+		if (aliased && aliased->ptr_array_size == 3)
+		{
+			CHECK(aliased->ptr_array[0] && !strcmp(aliased->ptr_array[0]->debug, "same"));
+			CHECK(aliased->ptr_array[1] && !strcmp(aliased->ptr_array[1]->debug, "same"));
+			CHECK(aliased->ptr_array[2] == dummy);
+		}
+	}
+
+	// shares the two identical dummies only if the package was written with slot aliases.
+	bool shares_same(putki::pkgmgr::loaded_package *pkg)
+	{
+		outki::test_arrays *aliased = (outki::test_arrays *) putki::pkgmgr::resolve(pkg, "tests/aliased");
+		return aliased && aliased->ptr_array_size == 3 && aliased->ptr_array[0] == aliased->ptr_array[1];
+	}
+
+	void test_packages()
+	{
+		const char *files[] = { "plain.pkg", "pool.pkg", "alias.pkg", "patch.pkg", "compact.pkg" };
+		for (unsigned int i=0;i!=sizeof(files)/sizeof(files[0]);i++)
+		{
+			CHECK((header_flags(files[i]) >> 16) == 1);
+			for (int lazy=0;lazy!=2;lazy++)
+			{
+				external_loads = 0;
+				putki::pkgmgr::loaded_package *pkg = load(files[i], lazy != 0);
+				CHECK(pkg != 0);
+				if (!pkg)
+					continue;
+
+				check_contents(pkg);
+				CHECK(shares_same(pkg) == !strcmp(files[i], "alias.pkg"));
+
+				// the patch reads the dummies out of base.pkg, compacted they are in the file.
+				if (!strcmp(files[i], "patch.pkg"))
+					CHECK(external_loads > 0);
+				else
+					CHECK(external_loads == 0);
+				putki::pkgmgr::release(pkg);
+			}
+		}
+
+		CHECK((header_flags("pool.pkg") & 1) && !(header_flags("plain.pkg") & 1));
+		CHECK((header_flags("alias.pkg") & 2) && !(header_flags("plain.pkg") & 2));
+	}
+
+	// main.pkg of the incremental builds, written again with the edit in it.
+	void test_incremental()
+	{
+		putki::pkgmgr::loaded_package *pkg = putki::pkgloader::from_file("main.pkg");
+		CHECK(pkg != 0);
+		if (!pkg)
+			return;
+
+		outki::test_arrays *arrays = (outki::test_arrays *) putki::pkgmgr::resolve(pkg, "tests/arrays");
+		CHECK(arrays && arrays->ptr_array_size == 2);
+		if (arrays && arrays->ptr_array_size == 2)
+		{
+			CHECK(arrays->ptr_array[0] && !strcmp(arrays->ptr_array[0]->debug, "first dummy"));
+			CHECK(arrays->ptr_array[1] && !strcmp(arrays->ptr_array[1]->debug, "edited dummy"));
+		}
+		putki::pkgmgr::release(pkg);
+	}
+
+	netki::test_packet make_packet(uint32_t sequence)
+	{
+		netki::test_packet p;
+		p.sequence = sequence;
+		p.name = "packet";
+		p.flags = 0xa5;
+		const int32_t deltas[] = { 0, -1, 1, -100000, 2147483647, -2147483647 - 1 };
+		const uint32_t ids[] = { 0, 15, 16, 4095, 4096, 65536, 0xffffffffu };
+		p.deltas.assign(deltas, deltas + sizeof(deltas) / sizeof(deltas[0]));
+		p.ids.assign(ids, ids + sizeof(ids) / sizeof(ids[0]));
+		p.main.id = 7;
+		p.main.x = 1.5f;
+		p.main.visible = true;
+		p.entries.resize(2);
+		p.entries[1].id = 100000;
+		p.entries[1].x = -3.25f;
+		return p;
+	}
+
+	void test_netki_full()
+	{
+		CHECK(netki::test_packet().health == 100);
+
+		char data[4096];
+		netki::bitstream::buffer buf;
+		netki::bitstream::init_buffer(&buf, data);
+		const netki::test_packet p = make_packet(1);
+		CHECK(netki::test_proj_encode(&buf, netki::test_packet::TYPE_ID, &p));
+		netki::bitstream::flip_buffer(&buf);
+
+		netki::decoded_packet decoded;
+		CHECK(netki::test_proj_decode(&buf, netki::test_packet::TYPE_ID, &decoded));
+		CHECK(decoded.packet && *(netki::test_packet *) decoded.packet == p);
+		CHECK(!buf.error && netki::bitstream::bits_left(&buf) < 8);
+		netki::free_packet(&decoded);
+
+		// cut short, the read fails instead of making something up.
+		netki::bitstream::init_buffer(&buf, data);
+		p.write_into_bitstream(&buf);
+		buf.bytepos -= 4;
+		netki::bitstream::flip_buffer(&buf);
+		netki::test_packet q;
+		CHECK(!q.read_from_bitstream(&buf));
+	}
+
+	// sender and receiver baselines, each packet decoded from what was written for it.
+	void test_netki_delta()
+	{
+		netki::delta::baseline_ring<netki::test_packet, 8> *sent = new netki::delta::baseline_ring<netki::test_packet, 8>();
+		netki::delta::baseline_ring<netki::test_packet, 8> *received = new netki::delta::baseline_ring<netki::test_packet, 8>();
+		netki::delta::reset(sent);
+		netki::delta::reset(received);
+
+		char data[4096];
+		netki::bitstream::buffer buf;
+		int full_bytes = 0;
+		for (uint32_t seq=1;seq!=6;seq++)
+		{
+			netki::test_packet p = make_packet(seq);
+			p.health = 100 - (int)seq;
+			p.main.x = (float)seq;
+			if (seq == 4)
+				p.entries.push_back(netki::test_packet_entry());
+
+			netki::bitstream::init_buffer(&buf, data);
+			netki::delta::write(&buf, sent, seq, p);
+			const int bytes = buf.bytepos;
+			netki::bitstream::flip_buffer(&buf);
+
+			netki::test_packet decoded;
+			uint32_t decoded_seq;
+			CHECK(netki::delta::read(&buf, received, &decoded, &decoded_seq));
+			CHECK(decoded_seq == seq && decoded == p);
+
+			// nothing acked yet the first time, written in full. later only the changes go.
+			if (seq == 1)
+				full_bytes = bytes;
+			else
+				CHECK(bytes < full_bytes);
+			netki::delta::acknowledge(sent, seq);
+		}
+
+		// a delta against a baseline the receiver does not have fails.
+		netki::delta::reset(received);
+		netki::bitstream::init_buffer(&buf, data);
+		netki::delta::write(&buf, sent, 6, make_packet(6));
+		netki::bitstream::flip_buffer(&buf);
+		netki::test_packet decoded;
+		uint32_t decoded_seq;
+		CHECK(!netki::delta::read(&buf, received, &decoded, &decoded_seq));
+
+		delete sent;
+		delete received;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *base = "test-data";
+	for (int i=1;i<argc;i++)
+	{
+		if (!strcmp(argv[i], "--base") && i+1 < argc)
+			base = argv[++i];
+	}
+
+	outki::bind_test_proj();
+
+	const std::string out_prefix = std::string(base) + "/out";
+	putki::set_output_path_prefix(out_prefix.c_str());
+
+	test_pathless_slots();
+	test_packages();
+
+	const std::string incremental_prefix = std::string(base) + "/incremental/out";
+	putki::set_output_path_prefix(incremental_prefix.c_str());
+	test_incremental();
+
+	test_netki_full();
+	test_netki_delta();
+
+	if (failures)
+	{
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "All runtime tests passed" << std::endl;
+	return 0;
+}